@@ -2,6 +2,7 @@
 
 #include "HardwareSerial.h"
 #include "PS2MouseHandler.h"
+#include "ps2.h"
 
 PS2MouseHandler::PS2MouseHandler(int clock_pin, int data_pin, int mode)
 {
@@ -91,6 +92,9 @@ uint8_t PS2MouseHandler::get_button_mask(int button)
 
 int PS2MouseHandler::initialise()
 {
+  // The bus itself is driven by lib/synaptics_touchpad/ps2.h. Without a
+  // callback every byte the mouse sends is kept for read_byte().
+  ps2::begin(_clock_pin, _data_pin, nullptr);
 
   int counter = 0;
   int return_value = 0;
@@ -105,15 +109,13 @@ int PS2MouseHandler::initialise()
 
 int PS2MouseHandler::try_initialise()
 {
-  pull_high(_clock_pin); // idle state
-  pull_high(_data_pin);
   delay(500);  // let mouse power on
   write(0xff); // Send Reset to the mouse
   if (_no_mouse)
   {
     return 100; // no mouse
   }
-  uint8_t bat_code = read_byte(); // Read BAT completion code
+  uint8_t bat_code = ps2::read_byte(ps2::reset_timeout_ms); // Read BAT completion code
   if (bat_code == 0xFC)
   { // error?
     _no_mouse = true;
@@ -149,7 +151,6 @@ void PS2MouseHandler::set_mode(int data)
     disable_data_reporting(); // Tell the mouse to stop sending data.
   }
   write(data); // Send Set Mode
-  read_byte(); // Read Ack byte
   if (_mode == PS2_MOUSE_STREAM)
   {
     enable_data_reporting(); // Tell the mouse to start sending data again
@@ -162,10 +163,7 @@ void PS2MouseHandler::set_mode(int data)
 
 int PS2MouseHandler::get_device_id()
 {
-  write(0xf2);          // Ask mouse for device ID.
-  int id = read_byte(); // Read first byte - gives overall device id
-  read_byte();          // try to read second byte if sent - refines device type - not needed
-  return id;
+  return ps2::device_id(); // 0x03 once the scroll wheel is on
 }
 
 void PS2MouseHandler::set_remote_mode()
@@ -187,9 +185,7 @@ void PS2MouseHandler::set_sample_rate(int rate, bool ignore_sample_rate)
     disable_data_reporting(); // Tell the mouse to stop sending data.
   }
   write(0xf3); // Tell the mouse we are going to set the sample rate.
-  read_byte(); // Read Ack Byte
   write(rate); // Send Set Sample Rate
-  read_byte(); // Read ack byte
   if (_mode == PS2_MOUSE_STREAM && !ignore_sample_rate)
   {
     enable_data_reporting(); // Tell the mouse to start sending data again
@@ -213,7 +209,6 @@ void PS2MouseHandler::enable_data_reporting()
   if (!_enabled)
   {
     write(0xf4); // Send enable data reporting
-    read_byte(); // Read Ack Byte
     _enabled = true;
   }
 }
@@ -224,7 +219,6 @@ void PS2MouseHandler::disable_data_reporting()
   if (!_disabled)
   {
     write(0xf5); // Send disable data reporting
-    read_byte(); // Read Ack Byte
     _disabled = true;
   }
 }
@@ -236,9 +230,7 @@ void PS2MouseHandler::set_resolution(int resolution)
     enable_data_reporting();
   }
   write(0xe8);       // Send Set Resolution
-  read_byte();       // Read ack Byte
   write(resolution); // Send resolution setting
-  read_byte();       // Read ack Byte
   if (_mode == PS2_MOUSE_STREAM)
   {
     disable_data_reporting();
@@ -246,97 +238,16 @@ void PS2MouseHandler::set_resolution(int resolution)
   delayMicroseconds(100);
 }
 
+// Sends a byte and waits for the mouse to acknowledge it.
 void PS2MouseHandler::write(int data)
 {
-  char i;
-  char parity = 1;
-  unsigned long start_time = millis();
-  pull_high(_data_pin);
-  pull_high(_clock_pin);
-  delayMicroseconds(300);
-  pull_low(_clock_pin);
-  delayMicroseconds(300);
-  pull_low(_data_pin);
-  delayMicroseconds(10);
-  pull_high(_clock_pin); // Start Bit
-  // wait for mouse to take control of clock
-  while (digitalRead(_clock_pin))
-  {
-    if (millis() - start_time >= 100)
-    {
-      // no connection to mouse
-      pull_high(_data_pin); // back to waiting
-      _no_mouse = true;
-      return;
-    }
-  }
-  _no_mouse = false; // connection to mouse OK
-  // clock is low, and we are clear to send data
-  for (i = 0; i < 8; i++)
-  {
-    if (data & 0x01)
-    {
-      pull_high(_data_pin);
-    }
-    else
-    {
-      pull_low(_data_pin);
-    }
-    // wait for clock cycle
-    while (!digitalRead(_clock_pin))
-    {
-      ;
-    }
-    while (digitalRead(_clock_pin))
-    {
-      ;
-    }
-    parity = parity ^ (data & 0x01);
-    data = data >> 1;
-  }
-  // parity
-  if (parity)
-  {
-    pull_high(_data_pin);
-  }
-  else
-  {
-    pull_low(_data_pin);
-  }
-  // wait for clock cycle
-  while (!digitalRead(_clock_pin))
-  {
-    ;
-  }
-  while (digitalRead(_clock_pin))
-  {
-    ;
-  }
-  pull_high(_data_pin); // release data line
-  while (digitalRead(_data_pin))
-  {
-    ;
-  } // wait for mouse to take over data line
-  while (digitalRead(_clock_pin))
-  {
-    ;
-  } // wait for mouse to take over clock
-  while ((!digitalRead(_clock_pin)) && (!digitalRead(_data_pin)))
-  {
-    ;
-  } // wait for mouse to release clock and data
-}
-
-void PS2MouseHandler::hold_incoming_data()
-{
-  pull_low(_clock_pin);
+  _no_mouse = !ps2::write_byte(data);
 }
 
 void PS2MouseHandler::get_data()
 {
   _last_status = _status;                             // save copy of status byte
   write(0xeb);                                        // Send Read Data
-  read_byte();                                        // Read Ack Byte
   _status = read();                                   // Status byte
   _x_movement = read_movement_9(bitRead(_status, 4)); // X Movement Packet
   _y_movement = read_movement_9(bitRead(_status, 5)); // Y Movement Packet
@@ -358,90 +269,16 @@ uint8_t PS2MouseHandler::read()
 
 uint8_t PS2MouseHandler::read_byte()
 {
-  uint8_t data = 0;
-  unsigned long start_time = millis();
-  pull_high(_clock_pin);
-  pull_high(_data_pin);
-  delayMicroseconds(50);
-
-  // read start bit but check for timeout
-  while (digitalRead(_clock_pin))
-  {
-    if (millis() - start_time > 100)
-    {
-      // timeout
-      return 0;
-    }
-  }
-  // delayMicroseconds(5);
-  while (!digitalRead(_clock_pin))
-  {
-    ;
-  }
-  // read data bits
-  for (int i = 0; i < 8; i++)
-  {
-    bitWrite(data, i, read_bit());
-  }
-  read_bit(); // Partiy Bit
-  read_bit(); // Stop bit should be 1
-  return data;
-}
-
-int PS2MouseHandler::read_bit()
-{
-  while (digitalRead(_clock_pin))
-  {
-    ;
-  }
-  int bit = digitalRead(_data_pin);
-  while (!digitalRead(_clock_pin))
-  {
-    ;
-  }
-  return bit;
+  return ps2::read_byte();
 }
 
+// The decoding is shared with the firmware's own mouse fallback.
 int16_t PS2MouseHandler::read_movement_9(bool sign_bit)
 {
-  // movement data is a 9 bit signed int using status bit and data reading
-  int16_t value = read();
-  // use status bit to get sign of reading
-  if (sign_bit)
-  {
-    // fill upper byte with 1's for negative number
-    value |= 0xFF00;
-  }
-  return value;
+  return ps2::movement(read(), sign_bit);
 }
 
 int8_t PS2MouseHandler::read_movement_z()
 {
-  // z data can be mixed with extra button data so only the lower nibble is movement
-  // 4 bit signed
-  uint8_t value = read(); // an 8 bit unsigned value
-  // test bit 3 for sign
-  if (bitRead(value, 3))
-  {
-    // negative - set upper nibble to 1's
-    value |= 0xF0;
-  }
-  else
-  {
-    // positive - set upper nibble to 0's
-    value &= 0x0F;
-  }
-  return value;
-}
-
-void PS2MouseHandler::pull_low(int pin)
-{
-  pinMode(pin, OUTPUT);
-  digitalWrite(pin, LOW);
-}
-
-void PS2MouseHandler::pull_high(int pin)
-{
-  pinMode(pin, INPUT);
-  digitalWrite(pin, HIGH);
+  return ps2::wheel_movement(read());
 }
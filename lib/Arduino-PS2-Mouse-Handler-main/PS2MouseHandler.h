@@ -24,15 +24,11 @@ class PS2MouseHandler
     uint8_t _device_id;
     int get_device_id();
     uint8_t read_byte();
-    int read_bit();
     int16_t read_movement_9(bool);
     int8_t read_movement_z();
     uint8_t get_button_mask(int);
-    void pull_high(int);
-    void pull_low(int);
     void set_mode(int);
     void write(int);
-    void hold_incoming_data();
     uint8_t read();
     int try_initialise();
 
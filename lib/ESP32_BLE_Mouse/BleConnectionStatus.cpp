@@ -1,4 +1,5 @@
 #include "BleConnectionStatus.h"
+#include <cstring>
 
 BleConnectionStatus::BleConnectionStatus(void) {
 }
@@ -8,6 +9,15 @@ void BleConnectionStatus::onConnect(BLEServer* pServer)
   this->connected = true;
   BLE2902* desc = (BLE2902*)this->inputMouse->getDescriptorByUUID(BLEUUID((uint16_t)0x2902));
   desc->setNotifications(true);
+  desc = (BLE2902*)this->inputPen->getDescriptorByUUID(BLEUUID((uint16_t)0x2902));
+  desc->setNotifications(true);
+}
+
+void BleConnectionStatus::onConnect(BLEServer* pServer, esp_ble_gatts_cb_param_t* param)
+{
+  // Remember the central, so that the connection parameters can be changed later.
+  this->server = pServer;
+  memcpy(this->remoteAddress, param->connect.remote_bda, sizeof(esp_bd_addr_t));
 }
 
 void BleConnectionStatus::onDisconnect(BLEServer* pServer)
@@ -15,4 +25,6 @@ void BleConnectionStatus::onDisconnect(BLEServer* pServer)
   this->connected = false;
   BLE2902* desc = (BLE2902*)this->inputMouse->getDescriptorByUUID(BLEUUID((uint16_t)0x2902));
   desc->setNotifications(false);
+  desc = (BLE2902*)this->inputPen->getDescriptorByUUID(BLEUUID((uint16_t)0x2902));
+  desc->setNotifications(false);
 }
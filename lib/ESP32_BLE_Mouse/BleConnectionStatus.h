@@ -13,8 +13,12 @@ public:
   BleConnectionStatus(void);
   bool connected = false;
   void onConnect(BLEServer* pServer);
+  void onConnect(BLEServer* pServer, esp_ble_gatts_cb_param_t* param);
   void onDisconnect(BLEServer* pServer);
   BLECharacteristic* inputMouse;
+  BLECharacteristic* inputPen;
+  BLEServer* server = nullptr;
+  esp_bd_addr_t remoteAddress;
 };
 
 #endif // CONFIG_BT_ENABLED
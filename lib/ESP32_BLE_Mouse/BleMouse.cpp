@@ -7,6 +7,7 @@
 #include "HIDKeyboardTypes.h"
 #include <driver/adc.h>
 #include "sdkconfig.h"
+#include <new>
 
 #include "BleConnectionStatus.h"
 #include "BleMouse.h"
@@ -23,6 +24,7 @@ static const uint8_t _hidReportDescriptor[] = {
     USAGE_PAGE(1), 0x01, // USAGE_PAGE (Generic Desktop)
     USAGE(1), 0x02,      // USAGE (Mouse)
     COLLECTION(1), 0x01, // COLLECTION (Application)
+    REPORT_ID(1), MOUSE_REPORT_ID, //   REPORT_ID (1)
     USAGE(1), 0x01,      //   USAGE (Pointer)
     COLLECTION(1), 0x00, //   COLLECTION (Physical)
     // ------------------------------------------------- Buttons (Left, Right, Middle, Back, Forward)
@@ -57,23 +59,70 @@ static const uint8_t _hidReportDescriptor[] = {
     REPORT_COUNT(1), 0x01,    //     REPORT_COUNT (1)
     HIDINPUT(1), 0x06,        //     INPUT (Data, Var, Rel)
     END_COLLECTION(0),        //   END_COLLECTION
-    END_COLLECTION(0)         // END_COLLECTION
+    END_COLLECTION(0),        // END_COLLECTION
+
+    // The pad as a pen, for the absolute mode: the whole report area maps to
+    // the screen.
+    USAGE_PAGE(1), 0x0d,           // USAGE_PAGE (Digitizers)
+    USAGE(1), 0x02,                // USAGE (Pen)
+    COLLECTION(1), 0x01,           // COLLECTION (Application)
+    REPORT_ID(1), PEN_REPORT_ID,   //   REPORT_ID (2)
+    USAGE(1), 0x20,                //   USAGE (Stylus)
+    COLLECTION(1), 0x00,           //   COLLECTION (Physical)
+    // ------------------------------------------------- Tip, barrel, in range
+    USAGE(1), 0x42,           //     USAGE (Tip Switch)
+    USAGE(1), 0x44,           //     USAGE (Barrel Switch)
+    USAGE(1), 0x32,           //     USAGE (In Range)
+    LOGICAL_MINIMUM(1), 0x00, //     LOGICAL_MINIMUM (0)
+    LOGICAL_MAXIMUM(1), 0x01, //     LOGICAL_MAXIMUM (1)
+    REPORT_SIZE(1), 0x01,     //     REPORT_SIZE (1)
+    REPORT_COUNT(1), 0x03,    //     REPORT_COUNT (3)
+    HIDINPUT(1), 0x02,        //     INPUT (Data, Variable, Absolute) ;3 bits
+    // ------------------------------------------------- Padding
+    REPORT_SIZE(1), 0x05,  //     REPORT_SIZE (5)
+    REPORT_COUNT(1), 0x01, //     REPORT_COUNT (1)
+    HIDINPUT(1), 0x03,     //     INPUT (Constant, Variable, Absolute) ;5 bit padding
+    // ------------------------------------------------- X/Y position
+    USAGE_PAGE(1), 0x01,            //     USAGE_PAGE (Generic Desktop)
+    USAGE(1), 0x30,                 //     USAGE (X)
+    USAGE(1), 0x31,                 //     USAGE (Y)
+    LOGICAL_MINIMUM(1), 0x00,       //     LOGICAL_MINIMUM (0)
+    LOGICAL_MAXIMUM(2), 0xff, 0x7f, //     LOGICAL_MAXIMUM (32767)
+    REPORT_SIZE(1), 0x10,           //     REPORT_SIZE (16)
+    REPORT_COUNT(1), 0x02,          //     REPORT_COUNT (2)
+    HIDINPUT(1), 0x02,              //     INPUT (Data, Variable, Absolute) ;2 words (X,Y)
+    // ------------------------------------------------- Tip pressure
+    USAGE_PAGE(1), 0x0d,            //     USAGE_PAGE (Digitizers)
+    USAGE(1), 0x30,                 //     USAGE (Tip Pressure)
+    LOGICAL_MINIMUM(1), 0x00,       //     LOGICAL_MINIMUM (0)
+    LOGICAL_MAXIMUM(2), 0xff, 0x00, //     LOGICAL_MAXIMUM (255)
+    REPORT_SIZE(1), 0x08,           //     REPORT_SIZE (8)
+    REPORT_COUNT(1), 0x01,          //     REPORT_COUNT (1)
+    HIDINPUT(1), 0x02,              //     INPUT (Data, Variable, Absolute) ;1 byte (Pressure)
+    END_COLLECTION(0),              //   END_COLLECTION
+    END_COLLECTION(0)               // END_COLLECTION
 };
 
 BleMouse::BleMouse(std::string deviceName, std::string deviceManufacturer, uint8_t batteryLevel) : _buttons(0),
-                                                                                                   hid(0)
+                                                                                                   hid(0),
+                                                                                                   started(false),
+                                                                                                   setupStackHighWaterMark(0)
 {
   this->deviceName = deviceName;
   this->deviceManufacturer = deviceManufacturer;
   this->batteryLevel = batteryLevel;
-  this->connectionStatus = new BleConnectionStatus();
 }
 
+// The setup task deletes itself once advertising has started, so its stack
+// goes back to the heap. Most of it is used by BLEDevice::init. The memory
+// budget printed at boot shows how much was left.
+static const uint32_t SERVER_STACK_SIZE = 8192;
+
 void BleMouse::begin(void)
 {
   xTaskCreate(this->taskServer,
-              "server", // 任务名称
-              20000,    // 堆栈
+              "server",          // 任务名称
+              SERVER_STACK_SIZE, // 堆栈
               (void *)this,
               5,
               NULL);
@@ -106,6 +155,22 @@ void BleMouse::move(signed char x, signed char y, signed char wheel, signed char
   }
 }
 
+void BleMouse::moveTo(uint16_t x, uint16_t y, uint8_t pen, uint8_t pressure)
+{
+  if (this->isConnected())
+  {
+    uint8_t m[6];
+    m[0] = pen;
+    m[1] = x;
+    m[2] = x >> 8;
+    m[3] = y;
+    m[4] = y >> 8;
+    m[5] = pressure;
+    this->inputPen->setValue(m, 6);
+    this->inputPen->notify();
+  }
+}
+
 void BleMouse::buttons(uint8_t b)
 {
   if (b != _buttons)
@@ -134,7 +199,7 @@ bool BleMouse::isPressed(uint8_t b)
 
 bool BleMouse::isConnected(void)
 {
-  return this->connectionStatus->connected;
+  return this->connectionStatus.connected;
 }
 
 void BleMouse::setBatteryLevel(uint8_t level)
@@ -144,25 +209,45 @@ void BleMouse::setBatteryLevel(uint8_t level)
     this->hid->setBatteryLevel(this->batteryLevel);
 }
 
+// Connection parameters, in units of 1.25 ms for the intervals and 10 ms for
+// the timeout. While idle, the slave latency lets us skip up to 30 connection
+// events when there is nothing to send, but we can still send on the very
+// next one, so waking up costs no latency.
+static const uint16_t ACTIVE_MIN_INTERVAL = 6;
+static const uint16_t ACTIVE_MAX_INTERVAL = 12;
+static const uint16_t IDLE_LATENCY = 30;
+static const uint16_t SUPERVISION_TIMEOUT = 400;
+
+void BleMouse::setIdle(bool idle)
+{
+  if (!this->isConnected() || this->connectionStatus.server == nullptr)
+    return;
+  this->connectionStatus.server->updateConnParams(this->connectionStatus.remoteAddress,
+                                                   ACTIVE_MIN_INTERVAL, ACTIVE_MAX_INTERVAL,
+                                                   idle ? IDLE_LATENCY : 0, SUPERVISION_TIMEOUT);
+}
+
 void BleMouse::taskServer(void *pvParameter)
 {
   BleMouse *bleMouseInstance = (BleMouse *)pvParameter; // static_cast<BleMouse *>(pvParameter);
   BLEDevice::init(bleMouseInstance->deviceName);
   BLEServer *pServer = BLEDevice::createServer();
-  pServer->setCallbacks(bleMouseInstance->connectionStatus);
+  pServer->setCallbacks(&bleMouseInstance->connectionStatus);
 
-  bleMouseInstance->hid = new BLEHIDDevice(pServer);
-  bleMouseInstance->inputMouse = bleMouseInstance->hid->inputReport(0); // <-- input REPORTID from report map
-  bleMouseInstance->connectionStatus->inputMouse = bleMouseInstance->inputMouse;
+  bleMouseInstance->hid = new (bleMouseInstance->hidStorage) BLEHIDDevice(pServer);
+  bleMouseInstance->inputMouse = bleMouseInstance->hid->inputReport(MOUSE_REPORT_ID); // <-- input REPORTID from report map
+  bleMouseInstance->inputPen = bleMouseInstance->hid->inputReport(PEN_REPORT_ID);
+  bleMouseInstance->connectionStatus.inputMouse = bleMouseInstance->inputMouse;
+  bleMouseInstance->connectionStatus.inputPen = bleMouseInstance->inputPen;
 
   bleMouseInstance->hid->manufacturer()->setValue(bleMouseInstance->deviceManufacturer);
 
   bleMouseInstance->hid->pnp(0x02, 0xe502, 0xa111, 0x0210);
   bleMouseInstance->hid->hidInfo(0x00, 0x02);
 
-  BLESecurity *pSecurity = new BLESecurity();
+  static BLESecurity security;
 
-  pSecurity->setAuthenticationMode(ESP_LE_AUTH_BOND);
+  security.setAuthenticationMode(ESP_LE_AUTH_BOND);
 
   bleMouseInstance->hid->reportMap((uint8_t *)_hidReportDescriptor, sizeof(_hidReportDescriptor));
   bleMouseInstance->hid->startServices();
@@ -176,5 +261,8 @@ void BleMouse::taskServer(void *pvParameter)
   bleMouseInstance->hid->setBatteryLevel(bleMouseInstance->batteryLevel);
 
   ESP_LOGD(LOG_TAG, "Advertising started!");
-  vTaskDelay(portMAX_DELAY); // delay(portMAX_DELAY);
+  // Everything from here on runs in the BLE stack's own tasks.
+  bleMouseInstance->setupStackHighWaterMark = uxTaskGetStackHighWaterMark(NULL);
+  bleMouseInstance->started = true;
+  vTaskDelete(NULL);
 }
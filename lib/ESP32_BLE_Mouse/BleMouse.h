@@ -14,12 +14,30 @@
 #define MOUSE_FORWARD 16
 #define MOUSE_ALL (MOUSE_LEFT | MOUSE_RIGHT | MOUSE_MIDDLE) # For compatibility with the Mouse library
 
+// The pen report of moveTo(): a state, a position from 0 to PEN_MAX on both
+// axes, mapped by the host to the whole screen, and the tip pressure from 0
+// to PEN_PRESSURE_MAX.
+#define PEN_TIP 1
+#define PEN_BARREL 2
+#define PEN_IN_RANGE 4
+#define PEN_MAX 32767
+#define PEN_PRESSURE_MAX 255
+
+#define MOUSE_REPORT_ID 1
+#define PEN_REPORT_ID 2
+
 class BleMouse {
 private:
   uint8_t _buttons;
-  BleConnectionStatus* connectionStatus;
+  BleConnectionStatus connectionStatus;
   BLEHIDDevice* hid;
+  // The HID device needs the server, so it is only constructed in here once
+  // BLE is up.
+  alignas(BLEHIDDevice) uint8_t hidStorage[sizeof(BLEHIDDevice)];
+  volatile bool started;
+  uint32_t setupStackHighWaterMark;
   BLECharacteristic* inputMouse;
+  BLECharacteristic* inputPen;
   void buttons(uint8_t b);
   void rawAction(uint8_t msg[], char msgSize);
   static void taskServer(void* pvParameter);
@@ -29,11 +47,17 @@ public:
   void end(void);
   void click(uint8_t b = MOUSE_LEFT);
   void move(signed char x, signed char y, signed char wheel = 0, signed char hWheel = 0);
+  void moveTo(uint16_t x, uint16_t y, uint8_t pen = PEN_IN_RANGE | PEN_TIP, uint8_t pressure = 0);
   void press(uint8_t b = MOUSE_LEFT);   // press LEFT by default
   void release(uint8_t b = MOUSE_LEFT); // release LEFT by default
   bool isPressed(uint8_t b = MOUSE_LEFT); // check LEFT by default
   bool isConnected(void);
   void setBatteryLevel(uint8_t level);
+  void setIdle(bool idle);
+  // True once advertising has started and the setup task is gone.
+  bool isStarted(void) { return started; }
+  // Least stack the setup task had left, in bytes.
+  uint32_t setupStackHighWater(void) { return setupStackHighWaterMark; }
   uint8_t batteryLevel;
   std::string deviceManufacturer;
   std::string deviceName;
@@ -1,4 +1,5 @@
 #include "PS2Mouse.h"
+#include "ps2.h"
 
 /*
 • $FF Reset
@@ -52,6 +53,9 @@ PS2Mouse::PS2Mouse()
 bool PS2Mouse::begin()
 {
   byte minor, major, modelCode;
+  // The bus is driven by lib/synaptics_touchpad/ps2.h, which keeps every
+  // byte for get() as there is no callback.
+  ps2::begin(_scl, _sda, nullptr);
   for (uint8_t i = 0; i < 3; i++)
   {              // -“how many times have you rebooted your computer?”
     send(0xFF);  // -“three dude, you always say 'overload three times'” =)
@@ -107,78 +111,24 @@ bool PS2Mouse::begin()
   // send(0xF3);                                         // F3 Set Sample Rate (argument $00-$FF)
   // send(0x14);                                         // Sample Rate argument Valid sample rates are 10, 20, 40, 60, 80, 100, and 200 samples/sec
 
-  send(0xF4);   // Enable command
-  set_CLOCK(1); // Release PS/2 bus inhibit
+  send(0xF4); // Enable command
   Serial.println(", state: init completed");
   return true;
 }
 
 void PS2Mouse::send(byte value)
 {
-  byte i, ack, p = 1;
-  set_CLOCK(0);
-  delayMicroseconds(100);
-  set_DATA(0);
-  set_CLOCK(1);
-  for (i = 0; i < 8; i++)
-  {
-    wait_CLOCK(0);
-    set_DATA(value & 0x01);
-    p = p + value;
-    wait_CLOCK(1);
-    value = value >> 1;
-  }
-  wait_CLOCK(0);
-  set_DATA(p & 0x01);
-  wait_CLOCK(1);
-  wait_CLOCK(0);
-  set_DATA(1);
-  wait_CLOCK(1);
-  wait_CLOCK(0);
-  if (read_DATA() == 1)
-  {
-    error("Missing line control bit!");
-  }
-  wait_CLOCK(1);
-  ack = get();
-  if (ack != 0xFA)
+  if (!ps2::write_byte(value))
   {
     error("Probably got an FE or FC error code");
   }
 }
 
+// The bus is never inhibited between bytes any more, so handler makes no
+// difference.
 byte PS2Mouse::get(bool handler)
 {
-  byte i, bit, value = 0, p = 0;
-  set_CLOCK(1);
-  wait_CLOCK(0);
-  wait_CLOCK(1);
-  for (i = 0; i < 8; i++)
-  {
-    wait_CLOCK(0);
-    bit = read_DATA();
-    value = value + (bit << i);
-    p = p + bit;
-    wait_CLOCK(1);
-  }
-  wait_CLOCK(0);
-  p = p + read_DATA();
-  if ((p & 0x01) == 0)
-  {
-    error("Parity!");
-  }
-  wait_CLOCK(1);
-  wait_CLOCK(0);
-  if (read_DATA() == 0)
-  {
-    error("Framing!");
-  }
-  delayMicroseconds(50);
-  if (!handler)
-  {
-    set_CLOCK(0);
-  }
-  return value;
+  return ps2::read_byte();
 }
 
 void PS2Mouse::error(const char *e)
@@ -187,34 +137,6 @@ void PS2Mouse::error(const char *e)
   Serial.println(e);
 }
 
-void PS2Mouse::wait_CLOCK(byte state)
-{
-  unsigned long saveTime = millis();
-  while (digitalRead(_scl) != state)
-  {
-    if (millis() - saveTime > 50)
-    {
-      error("Timeout SCL");
-      break;
-    }
-  }
-}
-
-void PS2Mouse::set_CLOCK(byte state)
-{
-  state == 1 ? high(_scl) : low(_scl);
-}
-
-byte PS2Mouse::read_DATA()
-{
-  return digitalRead(_sda);
-}
-
-void PS2Mouse::set_DATA(byte data)
-{
-  data == 1 ? high(_sda) : low(_sda);
-}
-
 void PS2Mouse::send_tp_arg(byte arg)
 {
   byte i;
@@ -225,18 +147,6 @@ void PS2Mouse::send_tp_arg(byte arg)
   };
 }
 
-void PS2Mouse::high(uint8_t pin)
-{
-  pinMode(pin, INPUT);
-  digitalWrite(pin, HIGH);
-}
-
-void PS2Mouse::low(uint8_t pin)
-{
-  pinMode(pin, OUTPUT);
-  digitalWrite(pin, LOW);
-}
-
 void PS2Mouse::getAbsoluteAxis(byte *raw, uint16_t &x, uint16_t &y)
 {
   x = ((raw[3] & 0x10) >> 4) << 12 | (raw[1] & 0xF) << 8 | raw[4];
@@ -1,12 +1,14 @@
 #include "PS2Touchpad.h"
+#include "ps2.h"
 
 PS2Touchpad::PS2Touchpad(int dataPin, int clockPin)
     : _dataPin(dataPin), _clockPin(clockPin) {}
 
 void PS2Touchpad::begin()
 {
-    pinMode(_dataPin, INPUT_PULLUP);
-    pinMode(_clockPin, INPUT_PULLUP);
+    // The bus is driven by lib/synaptics_touchpad/ps2.h. Without a callback
+    // every byte the touchpad sends is kept for readResponse().
+    ps2::begin(_clockPin, _dataPin, nullptr);
     log("PS/2 communication initialized.");
 }
 
@@ -15,12 +17,11 @@ void PS2Touchpad::init()
     log("Initializing PS/2 Touchpad...");
     // Step 0: reset
     sendCommand(0xFF);
-    uint8_t response = readResponse();
+    uint8_t response = ps2::read_byte(ps2::reset_timeout_ms);
+    logHex("Self test: ", response);
 
     // Step 1: Read Device Type (0xF2)
-    sendCommand(0xF2);
-    response = readResponse();
-    if (response == 0xFA)
+    if (sendCommand(0xF2))
     {
         log("ACK received for 0xF2 (Read Device Type)");
     }
@@ -35,9 +36,7 @@ void PS2Touchpad::init()
     delay(100); // Possible delay for stability
 
     // Step 2: Set Defaults (0xF6)
-    sendCommand(0xF6);
-    response = readResponse();
-    if (response == 0xFA)
+    if (sendCommand(0xF6))
     {
         log("ACK received for 0xF6 (Set Defaults)");
     }
@@ -47,9 +46,7 @@ void PS2Touchpad::init()
     }
 
     // Step 3: Set Sample Rate (0xF3) - with different data values
-    sendCommand(0xF3);
-    response = readResponse();
-    if (response == 0xFA)
+    if (sendCommand(0xF3))
     {
         log("ACK received for 0xF3 (Set Sample Rate)");
     }
@@ -57,14 +54,13 @@ void PS2Touchpad::init()
     {
         logError("No ACK for 0xF3");
     }
-    sendCommand(0x0A); // Sample rate = 10
-    response = readResponse();
-    logHex("Sample rate set to 10: ", response);
+    if (sendCommand(0x0A)) // Sample rate = 10
+    {
+        log("Sample rate set to 10");
+    }
 
     // Step 4: Set Resolution (0xE8)
-    sendCommand(0xE8);
-    response = readResponse();
-    if (response == 0xFA)
+    if (sendCommand(0xE8))
     {
         log("ACK received for 0xE8 (Set Resolution)");
     }
@@ -72,17 +68,16 @@ void PS2Touchpad::init()
     {
         logError("No ACK for 0xE8");
     }
-    sendCommand(0x00); // Resolution = 0
-    response = readResponse();
-    logHex("Resolution set to 0: ", response);
+    if (sendCommand(0x00)) // Resolution = 0
+    {
+        log("Resolution set to 0");
+    }
 
     // Repeat some more sample rate changes with different values
     uint8_t sampleRates[] = {0x14, 0x3C, 0x28, 0x14, 0x14};
     for (int i = 0; i < 5; i++)
     {
-        sendCommand(0xF3);
-        response = readResponse();
-        if (response == 0xFA)
+        if (sendCommand(0xF3))
         {
             log("ACK received for 0xF3 (Set Sample Rate)");
         }
@@ -90,15 +85,14 @@ void PS2Touchpad::init()
         {
             logError("No ACK for 0xF3");
         }
-        sendCommand(sampleRates[i]);
-        response = readResponse();
-        logHex("Sample rate set to: ", sampleRates[i]);
+        if (sendCommand(sampleRates[i]))
+        {
+            logHex("Sample rate set to: ", sampleRates[i]);
+        }
     }
 
     // Step 5: Status Request (0xE9)
-    sendCommand(0xE9);
-    response = readResponse();
-    if (response == 0xFA)
+    if (sendCommand(0xE9))
     {
         log("ACK received for 0xE9 (Status Request)");
     }
@@ -116,9 +110,7 @@ void PS2Touchpad::init()
     logHex("Status byte 3: ", status[2]);
 
     // Step 6: Reset (0xFF)
-    sendCommand(0xFF);
-    response = readResponse();
-    if (response == 0xFA)
+    if (sendCommand(0xFF))
     {
         log("ACK received for 0xFF (Reset)");
     }
@@ -130,70 +122,15 @@ void PS2Touchpad::init()
     delay(100); // Possible delay for device to reset
 }
 
-void PS2Touchpad::sendCommand(uint8_t command)
+// Returns whether the touchpad acknowledged the command.
+bool PS2Touchpad::sendCommand(uint8_t command)
 {
-    // PS/2 Command sending protocol
-    pinMode(_clockPin, OUTPUT);
-    pinMode(_dataPin, OUTPUT);
-    digitalWrite(_clockPin, HIGH);
-    digitalWrite(_dataPin, HIGH);
-    delayMicroseconds(300); // Bus idle
-
-    digitalWrite(_clockPin, LOW); // Start condition
-    delayMicroseconds(300);       // Hold low to start frame
-
-    // Send each bit of the command (8 bits)
-    for (int i = 0; i < 8; i++)
-    {
-        digitalWrite(_dataPin, (command & 1) ? HIGH : LOW);
-        delayMicroseconds(30);         // Setup time
-        digitalWrite(_clockPin, HIGH); // Clock high
-        delayMicroseconds(30);         // Data read time
-        digitalWrite(_clockPin, LOW);  // Clock low
-        command >>= 1;
-    }
-
-    // Parity bit
-    digitalWrite(_dataPin, HIGH); // Assume parity bit is 1 for now
-    delayMicroseconds(30);
-    digitalWrite(_clockPin, HIGH);
-    delayMicroseconds(30);
-    digitalWrite(_clockPin, LOW);
-
-    // Stop condition
-    digitalWrite(_dataPin, HIGH); // Data line released
-    delayMicroseconds(30);
-    digitalWrite(_clockPin, HIGH); // Release clock line
+    return ps2::write_byte(command);
 }
 
 uint8_t PS2Touchpad::readResponse()
 {
-    pinMode(_dataPin, INPUT);
-    pinMode(_clockPin, INPUT);
-
-    uint8_t response = 0;
-    for (int i = 0; i < 8; i++)
-    {
-        while (digitalRead(_clockPin) == LOW)
-            ;                                     // Wait for clock line to go high
-        delayMicroseconds(15);                    // Small delay
-        response |= (digitalRead(_dataPin) << i); // Read the data bit
-        while (digitalRead(_clockPin) == HIGH)
-            ; // Wait for clock line to go low
-    }
-
-    // Read parity bit (ignored for now)
-    while (digitalRead(_clockPin) == LOW)
-        ;
-    while (digitalRead(_clockPin) == HIGH)
-        ;
-
-    // Stop bit
-    while (digitalRead(_clockPin) == LOW)
-        ;
-    while (digitalRead(_clockPin) == HIGH)
-        ;
-
+    uint8_t response = ps2::read_byte();
     logHex("Response received: ", response);
     return response;
 }
@@ -14,7 +14,7 @@ private:
     int _dataPin;
     int _clockPin;
 
-    void sendCommand(uint8_t command);
+    bool sendCommand(uint8_t command);
     uint8_t readResponse();
     void log(const char *message);
     void logHex(const char *message, uint8_t value);
@@ -1,4 +1,5 @@
 #include "SynapticsHandler.h"
+#include "ps2.h"
 
 SynapticsHandler::SynapticsHandler(int clock_pin, int data_pin)
 {
@@ -12,6 +13,9 @@ SynapticsHandler::SynapticsHandler(int clock_pin, int data_pin)
 
 bool SynapticsHandler::initialize()
 {
+    // The bus is driven by lib/synaptics_touchpad/ps2.h. Without a callback
+    // every byte the touchpad sends is kept for read_byte().
+    ps2::begin(_clock_pin, _data_pin, nullptr);
 
     int counter = 0;
     int return_value = 0;
@@ -26,9 +30,6 @@ bool SynapticsHandler::initialize()
 
 bool SynapticsHandler::try_initialise()
 {
-    // Reset pins to idle state
-    pull_high(_clock_pin);
-    pull_high(_data_pin);
     delay(500); // Power-up delay
 
     // Reset the touchpad
@@ -118,12 +119,6 @@ bool SynapticsHandler::get_data()
         return false;
     }
 
-    // Read acknowledge byte
-    if (read_byte() != 0xFA)
-    {
-        return false;
-    }
-
     // Parse data based on current mode
     if (_absolute_mode)
     {
@@ -172,137 +167,13 @@ void SynapticsHandler::parse_relative_packet()
         _y_rel |= 0xFF00;
 }
 
-// Low level communication methods (similar to PS2MouseHandler)
-void SynapticsHandler::write(uint8_t data)
-{
-    char parity = 1;
-    unsigned long start_time = millis();
-
-    pull_high(_data_pin);
-    pull_high(_clock_pin);
-    delayMicroseconds(300);
-    pull_low(_clock_pin);
-    delayMicroseconds(300);
-    pull_low(_data_pin);
-    delayMicroseconds(10);
-    pull_high(_clock_pin);
-
-    // Wait for device to take control of clock
-    while (digitalRead(_clock_pin))
-    {
-        if (millis() - start_time >= 100)
-        {
-            return; // Timeout
-        }
-    }
-
-    // Send data bits
-    for (int i = 0; i < 8; i++)
-    {
-        if (data & 0x01)
-        {
-            pull_high(_data_pin);
-        }
-        else
-        {
-            pull_low(_data_pin);
-        }
-
-        while (!digitalRead(_clock_pin))
-        {
-        }
-        while (digitalRead(_clock_pin))
-        {
-        }
-
-        parity ^= (data & 0x01);
-        data >>= 1;
-    }
-
-    // Send parity bit
-    if (parity)
-    {
-        pull_high(_data_pin);
-    }
-    else
-    {
-        pull_low(_data_pin);
-    }
-
-    while (!digitalRead(_clock_pin))
-    {
-    }
-    while (digitalRead(_clock_pin))
-    {
-    }
-
-    pull_high(_data_pin);
-    while (digitalRead(_data_pin))
-    {
-    }
-    while (digitalRead(_clock_pin))
-    {
-    }
-    while (!digitalRead(_clock_pin) && !digitalRead(_data_pin))
-    {
-    }
-}
-
-// Other helper methods remain similar to PS2MouseHandler
-void SynapticsHandler::pull_low(int pin)
-{
-    pinMode(pin, OUTPUT);
-    digitalWrite(pin, LOW);
-}
-
-void SynapticsHandler::pull_high(int pin)
-{
-    pinMode(pin, INPUT);
-    digitalWrite(pin, HIGH);
-}
-
+// The acknowledge byte is read by ps2::write_byte(), which also resends
+// the byte when the touchpad asks for it.
 uint8_t SynapticsHandler::read_byte()
 {
     _last_operation = "read_byte";
-    uint8_t data = 0;
-    unsigned long timeout = millis() + 100; // 100ms超时
-
-    pull_high(_clock_pin);
-    pull_high(_data_pin);
-    delayMicroseconds(50);
-
-    // 等待时钟低电平，带超时检查
-    while (digitalRead(_clock_pin))
-    {
-        if (millis() > timeout)
-        {
-            _last_byte = 0xFF;
-            return 0xFF; // 超时返回
-        }
-    }
-
-    for (int i = 0; i < 8; i++)
-    {
-        bitWrite(data, i, read_bit());
-    }
-
-    read_bit(); // 奇偶校验位
-    read_bit(); // 停止位
-
-    _last_byte = data;
-    return data;
-}
-
-int SynapticsHandler::read_bit()
-{
-    while (digitalRead(_clock_pin))
-    {
-    }
-    int bit = digitalRead(_data_pin);
-    while (!digitalRead(_clock_pin))
-    {
-    }
-    return bit;
+    _last_byte = ps2::read_byte();
+    return _last_byte;
 }
 
 // 在 SynapticsHandler.cpp 文件中添加以下方法实现：
@@ -316,13 +187,7 @@ bool SynapticsHandler::enable_palm_detection(bool enable)
 
     // 发送开启/关闭掌部检测的命令
     uint8_t cmd = enable ? 0xF8 : 0xF9;
-    if (!send_command(cmd))
-    {
-        return false;
-    }
-
-    // 等待确认
-    return (read_byte() == 0xFA);
+    return send_command(cmd);
 }
 
 bool SynapticsHandler::enable_multi_finger(bool enable)
@@ -334,13 +199,7 @@ bool SynapticsHandler::enable_multi_finger(bool enable)
 
     // 发送开启/关闭多指触控的命令
     uint8_t cmd = enable ? 0xF6 : 0xF7;
-    if (!send_command(cmd))
-    {
-        return false;
-    }
-
-    // 等待确认
-    return (read_byte() == 0xFA);
+    return send_command(cmd);
 }
 
 bool SynapticsHandler::set_sample_rate(uint8_t rate)
@@ -351,35 +210,18 @@ bool SynapticsHandler::set_sample_rate(uint8_t rate)
         return false;
     }
 
-    // 等待确认
-    if (read_byte() != 0xFA)
-    {
-        return false;
-    }
-
     // 发送采样率值
-    if (!send_command(rate))
-    {
-        return false;
-    }
-
-    // 等待最终确认
-    return (read_byte() == 0xFA);
+    return send_command(rate);
 }
 
 bool SynapticsHandler::send_command(uint8_t command)
 {
     _last_operation = "send_command";
-    write(command);
-    delayMicroseconds(100);
-
-    uint8_t ack = read_byte();
-    if (ack != 0xFA)
+    if (!ps2::write_byte(command))
     {
         Serial.print("Command 0x");
         Serial.print(command, HEX);
-        Serial.print(" failed, received: 0x");
-        Serial.println(ack, HEX);
+        Serial.println(" failed");
         return false;
     }
     return true;
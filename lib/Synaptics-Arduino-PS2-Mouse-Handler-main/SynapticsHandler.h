@@ -44,12 +44,8 @@ private:
   const char *_last_operation; // 存储最后执行的操作名称
 
   // Private methods
-  void pull_high(int pin);
-  void pull_low(int pin);
   bool try_initialise();
-  void write(uint8_t data);
   uint8_t read_byte();
-  int read_bit();
   bool send_command(uint8_t command);
   bool read_touchpad_id();
   bool set_touchpad_mode(uint8_t mode);
@@ -0,0 +1,1567 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+#include <ps2.h>
+#include <trace.h>
+#include "decoder.h"
+
+// 在文件顶部定义或注释掉 DEBUG 宏
+// #define DEBUG
+#define INFO
+// 打印手势状态机的每一次状态转换
+// #define TRACE_GESTURES
+
+// On the host, the log goes to stdout.
+#ifdef ARDUINO
+#define log_printf(fmt, ...) Serial.printf((fmt), ##__VA_ARGS__)
+#else
+#define log_printf(fmt, ...) printf((fmt), ##__VA_ARGS__)
+#endif
+
+// 定义调试输出宏
+#ifdef DEBUG
+#define debug_printf(fmt, ...) log_printf((fmt), ##__VA_ARGS__)
+#define info_printf(fmt, ...) log_printf((fmt), ##__VA_ARGS__)
+#define info_trace(id, ...) trace::event((id), ##__VA_ARGS__)
+#elif defined(INFO)
+#define debug_printf(fmt, ...)
+#define info_printf(fmt, ...) log_printf((fmt), ##__VA_ARGS__)
+#define info_trace(id, ...) trace::event((id), ##__VA_ARGS__)
+#else
+#define debug_printf(fmt, ...)
+#define info_printf(fmt, ...)
+#define info_trace(id, ...)
+#endif
+
+using std::abs;
+
+#ifndef min
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
+#ifndef max
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+#ifndef sign
+#define sign(x) ((x) > 0 ? (1) : ((x) < 0 ? (-1) : (0)))
+#endif
+
+namespace decoder
+{
+  tuning::Settings settings = tuning::defaults;
+
+  namespace
+  {
+    // 噪声自动校准：手指静止时统计原始坐标逐帧变化的方差，得出每个轴的防抖阈值并保存到 NVS
+    const int calibration_settle_frames = 10;       // 手指放下后先等这么多帧再统计
+    const int calibration_still_frames = 5;         // 连续这么多帧没有明显移动才算静止
+    const float calibration_rest_gate_mm = 0.3;     // 一帧内原始坐标变化超过这个距离就不算静止
+    const int max_interpolated_frames = 3;          // 最多补上这么多连续丢失的帧
+    const int max_lost_frames = 40;                 // 更长的间隔是触摸板停止发送，不算丢包
+    const unsigned long calibration_samples = 4000; // 每轮校准的样本数，大约是 50 秒的静止触摸
+    const float calibration_sigmas = 3.0;           // 阈值是滤波后抖动标准差的多少倍
+    const float calibration_min_mm = 0.02;          // 校准结果的下限和上限，防止异常数据
+    const float calibration_max_mm = 0.3;
+    const float calibration_weight = 0.25;          // 新一轮结果的权重，之前的结果占其余部分
+    const float calibration_save_change = 0.05;     // 变化超过这个比例才保存，减少 flash 写入
+
+    Hooks hooks;
+    Stats stats_;
+
+    // The packet being collected by frame_byte().
+    uint64_t frame_buffer = 0;
+    int frame_index = 0;
+    uint32_t frame_started = 0; // when byte 0 arrived
+    volatile bool resync_requested = false;
+
+    unsigned long global_tick = 0;
+    unsigned long session_started_tick = 0;
+    unsigned long button_released_tick = 0;
+
+    // 轻触、拖动和滚动的状态机，配置来自 settings
+    // 预先点击：手指放上去且静止时立即按下按键，不等抬起，也不经过 frames_delay 的延迟。
+    // 如果之后变成了移动、拖动或手掌，立即松开按键作为纠正。
+    gesture::Config gesture_config(const tuning::Settings &values)
+    {
+      return {.tap_time = values.tap_time_threshold,
+              .tap_movement = values.tap_tracking_threshold,
+              .tap_z = values.tap_z_threshold,
+              .drag_window = values.tap_and_pan_as_drag_threshold,
+              .speculative = values.speculative_tap,
+              .speculative_delay = values.speculative_tap_delay};
+    }
+    gesture::Engine gestures(gesture_config(tuning::defaults));
+
+    // Clickpad 按键区域：按下底部左侧为左键，底部右侧为右键
+    uint8_t clickpad_buttons = 0; // 当前按住的物理按键（HID 按键掩码）
+    uint8_t guest_buttons = 0;    // 直通设备（指点杆等）或代替触控板的鼠标按住的按键
+    short pressing_finger = 0;    // 按下按键的手指，0 是主手指，1 是副手指
+
+    // Recent contact shape and motion, used to tell palms from fingers.
+    struct palm_history
+    {
+      SimpleAverage<int16_t, 8> z;
+      SimpleAverage<int16_t, 8> width;
+      SimpleAverage<int16_t, 8> speed;
+      bool palm;
+    };
+
+    struct finger_state
+    {
+      SimpleAverage<int16_t, position_average_frames> x;
+      SimpleAverage<int16_t, position_average_frames> y;
+      short z;
+      palm_history history;
+      // Identity of the physical finger. It changes whenever the state is reset.
+      uint16_t id;
+      // Movement per packet of this finger, used to predict where it will be.
+      int velocity_x;
+      int velocity_y;
+    };
+
+    // A rectangle on the pad, in touchpad units, that maps a press to a button.
+    struct button_zone
+    {
+      int x_min;
+      int x_max;
+      int y_min;
+      int y_max;
+      uint8_t button;
+    };
+
+    RingBuffer<report, 32> reports;
+    // 解析任务（核心 1）把延迟过的报告交给发送任务（核心 0），两边都不加锁
+    SpscQueue<report, 32> output_channel;
+    // 进入发送通道的最后一个报告的按键和 pen 状态，这些变化不能丢
+    uint8_t sent_held_buttons = 0;
+    uint8_t sent_pen = 0;
+    // 最后一个离开延迟的触摸板报告按住的按键。直通设备的报告不经过延迟，
+    // 所以它的按键在离开延迟时才加上，否则延迟中的旧报告会把它重新按下
+    uint8_t delayed_held_buttons = 0;
+    // 拖动接手了预先按下的左键：再发送这么多个延迟的报告，拖动按住左键的那个报告才发出，
+    // 那时才松开预先按下的左键，中间不会松开
+    int speculative_handover = 0;
+    // 上一次交接还在延迟中时，新的预先按下不发送，按普通的轻触处理，
+    // 否则它会在拖动的松开之前按下
+    bool speculation_deferred = false;
+    unsigned long speculative_down_ticks = 0; // 预先按下时距离手指放上的 tick 数
+    float scroll_amount_rollover = 0;
+    finger_state finger_states[2]; // 0 is primary, 1 is secondary
+    short finger_count = 0;
+    bool button_down = false; // 上一帧 clickpad 是否按下
+    uint16_t next_finger_id = 0;
+
+    // Jitter of a resting finger, collected for the noise calibration.
+    struct noise_calibration
+    {
+      RunningVariance x;
+      RunningVariance y;
+      int raw_x;
+      int raw_y;
+      int frames;       // since the finger went down
+      int still_frames; // since it last moved
+    };
+    noise_calibration calibration;
+    // Packet timing, for count_lost_frames() and parse_finger_packet(). The
+    // times are only compared once a packet came at the current rate.
+    uint32_t last_packet_us = 0;
+    uint32_t last_primary_us = 0;
+    uint32_t last_extended_us = 0;
+    bool packet_timed = false;
+    bool primary_timed = false;
+    bool extended_timed = false;
+    bool counted_high_rate = false;
+    // The packets that parse_finger_packet() interpolates between.
+    uint64_t last_primary = 0;
+    uint64_t last_extended = 0; // 0 if the second finger isn't down
+    // 变量
+    float scale_tracking_x, scale_tracking_y;
+    float scale_scroll_x, scale_scroll_y;
+    float noise_threshold_tracking_x, noise_threshold_tracking_y;
+    float noise_threshold_scrolling_x, noise_threshold_scrolling_y;
+    float max_delta_x, max_delta_y;
+    float slow_scroll_threshold;
+    float calibration_rest_gate_x, calibration_rest_gate_y;
+    float proximity_threshold_x, proximity_threshold_y;
+    float palm_max_speed;
+    button_zone button_zones[2]; // 0 is lower-left, 1 is lower-right
+    // 绝对模式映射到屏幕的区域（触摸板单位），以及 16.16 定点的缩放系数
+    int absolute_x_min, absolute_x_max, absolute_y_min, absolute_y_max;
+    uint32_t absolute_scale_x, absolute_scale_y;
+    uint8_t pen_state = 0;     // 上一次发出的 pen 状态
+    uint16_t pen_x = 0;        // 上一次发出的笔的位置，抬笔时留在这里
+    uint16_t pen_y = 0;
+    uint32_t pressure_scale;   // z 到笔尖压力的 8.8 定点缩放系数
+    uint8_t press_z = 0;       // 按下 clickpad 时的 z，0 表示没有按下
+    bool deep_pressed = false; // 这次按下已经算作深按
+
+    // 将值转换为HID值
+    float to_hid_value(float value, float threshold, float scale_factor)
+    {
+      const float hid_max = 127.0F;
+      if (abs(value) < threshold)
+      {
+        return 0;
+      }
+      return sign(value) * min(max(abs(value) * scale_factor, 1.0F), hid_max);
+    }
+
+    // Forgets everything about a finger, e.g. when it is lifted or when we can't
+    // tell whether it is still the same physical finger.
+    void reset_finger(finger_state &finger)
+    {
+      finger.x.reset();
+      finger.y.reset();
+      finger.history.z.reset();
+      finger.history.width.reset();
+      finger.history.speed.reset();
+      finger.history.palm = false;
+      finger.id = next_finger_id++;
+      finger.velocity_x = 0;
+      finger.velocity_y = 0;
+    }
+
+    // Distance, in touchpad units, between (x, y) and where the finger is
+    // expected to be by now.
+    int predicted_distance(const finger_state &finger, int x, int y)
+    {
+      int predicted_x = finger.x.average() + finger.velocity_x;
+      int predicted_y = finger.y.average() + finger.velocity_y;
+      return abs(x - predicted_x) + abs(y - predicted_y);
+    }
+
+    // Finds which of the tracked fingers is at (x, y), after some fingers have
+    // been lifted. Each finger is extrapolated from its recent velocity, and the
+    // nearest one wins. Returns -1 if no finger is close enough, i.e. the
+    // position belongs to a finger we have not been tracking.
+    int match_finger(int x, int y)
+    {
+      int match = -1;
+      int best = proximity_threshold_x + proximity_threshold_y;
+      for (int i = 0; i < 2; i++)
+      {
+        if (finger_states[i].x.count() == 0)
+        {
+          continue;
+        }
+        int distance = predicted_distance(finger_states[i], x, y);
+        if (distance < best)
+        {
+          best = distance;
+          match = i;
+        }
+      }
+
+      if (match < 0)
+      {
+        stats_.finger_resets++;
+      }
+      else
+      {
+        stats_.finger_matches++;
+      }
+      debug_printf("Finger match: %d, id: %d, matches: %lu, resets: %lu\n", match,
+                   match < 0 ? -1 : finger_states[match].id, stats_.finger_matches, stats_.finger_resets);
+      return match;
+    }
+
+    // Takes the movement out of every delayed report, keeping the buttons.
+    void freeze_reports()
+    {
+      for (int part = 0; part < 2; part++)
+      {
+        for (report &item : reports.segment(part))
+        {
+          item.x = 0;
+          item.y = 0;
+          item.scroll = 0;
+        }
+      }
+    }
+
+    // Feeds one frame of a contact into its history and returns whether it is a
+    // palm. A palm is heavy or wide, and slow, over the whole history window.
+    // Once a contact is deemed a palm it stays one until it is lifted, since palms
+    // tend to lighten up just before leaving the pad. What it moved before it was
+    // recognised is taken back from the report delay.
+    bool classify_palm(finger_state &finger, int z, int width, int delta_x, int delta_y)
+    {
+      palm_history &history = finger.history;
+      history.z.filter(z);
+      history.width.filter(width);
+      history.speed.filter(abs(delta_x) + abs(delta_y));
+      if (!history.palm && history.z.count() >= settings.palm_min_frames)
+      {
+        bool heavy = history.z.average() >= settings.palm_z_threshold;
+        bool wide = history.width.average() >= settings.palm_width_threshold;
+        bool slow = history.speed.average() < palm_max_speed;
+        history.palm = (heavy || wide) && slow;
+        if (history.palm)
+        {
+          stats_.palms++;
+          freeze_reports();
+          debug_printf("Palm detected, z: %d, w: %d\n", history.z.average(), history.width.average());
+        }
+      }
+      return history.palm;
+    }
+
+    // Turns the collected jitter into per-axis noise thresholds. Reports come
+    // from the change of an average over position_average_frames frames. With
+    // noise of deviation s, that change has a deviation of sqrt(2) s divided by
+    // the number of frames, and sqrt(2) s is exactly the deviation we measured.
+    void finish_noise_calibration()
+    {
+      float measured[2] = {
+          calibration_sigmas * sqrtf(calibration.x.variance()) / position_average_frames /
+              synaptics::units_per_mm_x,
+          calibration_sigmas * sqrtf(calibration.y.variance()) / position_average_frames /
+              synaptics::units_per_mm_y,
+      };
+      float current[2] = {settings.noise_floor_x_mm, settings.noise_floor_y_mm};
+      float calibrated[2];
+      bool changed = false;
+      for (int i = 0; i < 2; i++)
+      {
+        measured[i] = min(max(measured[i], calibration_min_mm), calibration_max_mm);
+        // The first result is taken as it is. Later ones only nudge it, so that a
+        // single odd session can't throw it off.
+        calibrated[i] = current[i] == 0 ? measured[i]
+                                        : current[i] + (measured[i] - current[i]) * calibration_weight;
+        changed = changed || current[i] == 0 ||
+                  abs(calibrated[i] - current[i]) > current[i] * calibration_save_change;
+      }
+      calibration.x.reset();
+      calibration.y.reset();
+      info_printf("Noise calibration, measured: %.3f, %.3f mm, noise floor: %.3f, %.3f mm\n",
+                  measured[0], measured[1], calibrated[0], calibrated[1]);
+
+      if (changed)
+      {
+        tuning::Settings values = settings;
+        values.noise_floor_x_mm = calibrated[0];
+        values.noise_floor_y_mm = calibrated[1];
+        apply_settings(values);
+        if (hooks.save_calibration != nullptr)
+        {
+          hooks.save_calibration(values);
+        }
+      }
+    }
+
+    // Collects the jitter of a single resting finger in the background. Between
+    // two frames, the raw position of a finger that doesn't move only changes by
+    // noise. Frames with a clear move are left out, and so are the first frames
+    // after touching down, when the contact is still settling.
+    void calibrate_noise(int x, int y, int fingers)
+    {
+      if (!settings.noise_calibration || fingers != 1 || button_down ||
+          finger_states[0].history.palm)
+      {
+        calibration.frames = 0;
+        calibration.still_frames = 0;
+        return;
+      }
+
+      int raw_delta_x = x - calibration.raw_x;
+      int raw_delta_y = y - calibration.raw_y;
+      calibration.raw_x = x;
+      calibration.raw_y = y;
+      if (calibration.frames++ < calibration_settle_frames)
+      {
+        return;
+      }
+      if (abs(raw_delta_x) > calibration_rest_gate_x || abs(raw_delta_y) > calibration_rest_gate_y)
+      {
+        calibration.still_frames = 0;
+        return;
+      }
+      if (++calibration.still_frames < calibration_still_frames)
+      {
+        return;
+      }
+
+      calibration.x.add(raw_delta_x);
+      calibration.y.add(raw_delta_y);
+      if (calibration.x.count() >= calibration_samples)
+      {
+        finish_noise_calibration();
+      }
+    }
+
+    // Maps a tap report button (1 = left, 2 = right, 3 = middle) to a HID mask.
+    uint8_t tap_button_mask(uint8_t button)
+    {
+      const uint8_t masks[] = {0, MOUSE_LEFT, MOUSE_RIGHT, MOUSE_MIDDLE};
+      return button < sizeof(masks) ? masks[button] : 0;
+    }
+
+    // Returns the button of the zone containing (x, y), or 0 if there is none.
+    uint8_t find_button_zone(int x, int y)
+    {
+      if (!settings.button_zones_enabled)
+      {
+        return 0;
+      }
+      for (const button_zone &zone : button_zones)
+      {
+        if (x >= zone.x_min && x < zone.x_max && y >= zone.y_min && y < zone.y_max)
+        {
+          return zone.button;
+        }
+      }
+      return 0;
+    }
+
+    // Decides which button a clickpad press means. The pad only tells us that it
+    // has been pressed, not by which finger. A finger resting in a button zone is
+    // the one pressing, even while another finger is moving the cursor. If both
+    // fingers are in a zone, the one closer to the bottom edge wins. Outside the
+    // zones, the finger count decides, just like tapping.
+    uint8_t attribute_press(int x, int y, int fingers)
+    {
+      pressing_finger = 0;
+      uint8_t button = find_button_zone(x, y);
+
+      if (fingers >= 2 && finger_states[1].x.count() > 0)
+      {
+        int secondary_x = finger_states[1].x.average();
+        int secondary_y = finger_states[1].y.average();
+        uint8_t secondary_button = find_button_zone(secondary_x, secondary_y);
+        if (secondary_button != 0 && (button == 0 || secondary_y < y))
+        {
+          pressing_finger = 1;
+          button = secondary_button;
+        }
+      }
+
+      if (button == 0)
+      {
+        button = fingers >= 3 ? MOUSE_MIDDLE : fingers == 2 ? MOUSE_RIGHT : MOUSE_LEFT;
+      }
+      return button;
+    }
+
+    void queue_report(uint8_t buttons, int8_t x, int8_t y, float scroll, bool LR_scroll = false)
+    {
+      report item = {.buttons = buttons};
+      item.held_buttons = clickpad_buttons | gestures.held_buttons();
+      if (button_released_tick != 0 &&
+          global_tick - button_released_tick < settings.frames_stablization)
+      {
+        if (!gestures.dragging())
+        {
+          item.x = 0;
+          item.y = 0;
+          item.scroll = 0;
+        }
+        else
+        {
+          item.x = x;
+          item.y = y;
+          item.scroll = 0;
+        }
+      }
+      else
+      {
+        if (scroll > -1.0F && scroll < 1.0F)
+        {
+          scroll_amount_rollover += scroll;
+          if (scroll_amount_rollover >= 1.0F)
+          {
+            scroll = 1.0F;
+            scroll_amount_rollover -= 1.0F;
+          }
+          else if (scroll_amount_rollover <= -1.0F)
+          {
+            scroll = -1.0F;
+            scroll_amount_rollover += 1.0F;
+          }
+          else
+          {
+            scroll = 0;
+          }
+        }
+        item.x = x;
+        item.y = y;
+        item.scroll = scroll;
+        item.LR_scroll = LR_scroll;
+      }
+      if (!reports.push_back(item))
+      {
+        // The queue is full, e.g. after a burst of garbled packets. Fold the
+        // report into the newest one rather than lose a click or a release.
+        report &newest = *reports.peek_back();
+        newest.buttons |= item.buttons;
+        newest.held_buttons = item.held_buttons;
+        newest.x = max(min(newest.x + item.x, 127), -127);
+        newest.y = max(min(newest.y + item.y, 127), -127);
+        if (item.scroll != 0)
+        {
+          newest.scroll = max(min(newest.scroll + item.scroll, 127), -127);
+          newest.LR_scroll = item.LR_scroll;
+        }
+      }
+    }
+
+    // Hands a report over to the output task. The report can't be changed
+    // anymore after this. When the channel is full, a move is dropped, but a
+    // report that presses or releases a button, clicks, or changes the pen waits
+    // for room: losing one would leave a button stuck on the host.
+    void send_report(const report &item)
+    {
+      bool changes_state = item.absolute ? item.pen != sent_pen
+                                         : item.speculative || item.buttons != 0 ||
+                                               item.held_buttons != sent_held_buttons;
+      while (!output_channel.push(item))
+      {
+        if (!changes_state || hooks.wait_for_output == nullptr)
+        {
+          stats_.channel_overflows++;
+          return;
+        }
+        stats_.channel_waits++;
+        hooks.wait_for_output();
+      }
+      if (item.absolute)
+      {
+        sent_pen = item.pen;
+      }
+      else if (!item.speculative)
+      {
+        sent_held_buttons = item.held_buttons;
+      }
+      stats_.channel_max_depth = max(stats_.channel_max_depth, output_channel.size());
+      if (hooks.report_ready != nullptr)
+      {
+        hooks.report_ready();
+      }
+    }
+
+    // A tap click reached the host latency ticks after the touch.
+    void count_tap_click(unsigned long latency)
+    {
+      stats_.tap_clicks++;
+      stats_.tap_click_ticks += latency;
+      debug_printf("Click latency: %lu\n", latency);
+    }
+
+    // Presses the buttons of a speculative tap right away, or releases them with
+    // 0. They skip the report delay and are held independently of the buttons in
+    // the reports.
+    void send_speculative(uint8_t buttons)
+    {
+      report item = {.buttons = 0};
+      item.held_buttons = buttons;
+      item.speculative = true;
+      send_report(item);
+    }
+
+    // Movement from a mouse-like device. There are no gestures to run, so it
+    // goes straight out without the report delay, and the touchpad reports
+    // still in the delay can't hold it back.
+    void send_mouse_movement(uint8_t status, uint8_t x_byte, uint8_t y_byte, int wheel)
+    {
+      int x = ps2::movement(x_byte, status & 0x10);
+      int y = ps2::movement(y_byte, status & 0x20);
+
+      // The button bits are the same as in HID. Y and the wheel grow upwards.
+      guest_buttons = status & (MOUSE_LEFT | MOUSE_RIGHT | MOUSE_MIDDLE);
+      report item = {.buttons = 0};
+      item.mouse = true;
+      item.held_buttons = delayed_held_buttons | guest_buttons;
+      item.x = max(min(x, 127), -127);
+      item.y = max(min(-y, 127), -127);
+      send_report(item);
+      if (wheel != 0)
+      {
+        item.x = 0;
+        item.y = 0;
+        item.scroll = -wheel;
+        send_report(item);
+      }
+    }
+
+    // A plain or wheel mouse found instead of a touchpad.
+    void parse_mouse_packet(uint64_t packet)
+    {
+      int wheel = synaptics::protocol == synaptics::Protocol::IntelliMouse ? ps2::wheel_movement(packet >> 24) : 0;
+      send_mouse_movement(packet, packet >> 8, packet >> 16, wheel);
+    }
+
+    // A packet of the guest device behind the pad, e.g. a pointing stick. Its
+    // three bytes are encapsulated in bytes 1, 4 and 5 of a packet with w = 3.
+    void parse_guest_packet(uint64_t packet)
+    {
+      uint8_t status = packet >> 8;
+      // The acknowledge of a pass-through command comes the same way.
+      if (!synaptics::pass_through || status == 0xFA || (status & 0x08) == 0)
+      {
+        return;
+      }
+      send_mouse_movement(status, packet >> 32, packet >> 40, 0);
+    }
+
+    // Normalizes z to the tip pressure, from 0 at pressure_z_min to
+    // PEN_PRESSURE_MAX at pressure_z_max.
+    uint8_t tip_pressure(int z)
+    {
+      int pressure = (z - settings.pressure_z_min) * (int)pressure_scale >> 8;
+      return max(min(pressure, PEN_PRESSURE_MAX), 0);
+    }
+
+    // Follows z through a clickpad press, and returns true on the packet where
+    // the press becomes a deep press: z has gone past deep_press_z, and has risen
+    // by deep_press_rise since the pad went down. A press is deep only once.
+    bool detect_deep_press(bool button, int z)
+    {
+      if (!button || z == 0)
+      {
+        press_z = 0;
+        deep_pressed = false;
+        return false;
+      }
+      if (press_z == 0)
+      {
+        press_z = z;
+        return false;
+      }
+      if (deep_pressed || settings.deep_press_button == 0 ||
+          z < settings.deep_press_z || z - press_z < settings.deep_press_rise)
+      {
+        return false;
+      }
+      deep_pressed = true;
+      info_trace(trace::TRACE_DEEP_PRESS, z, z - press_z);
+      return true;
+    }
+
+    // The absolute mode: the region of the pad set in the tuning maps to the
+    // whole screen, like a graphics tablet. A finger on the pad hovers the pen,
+    // and pressing the pad puts its tip down, or its barrel button with two
+    // fingers. A deep press adds the barrel button too. The tip pressure follows
+    // z. Only the primary finger counts, and there are no gestures, so the
+    // position goes out right away.
+    void parse_absolute_packet(uint64_t packet, int w)
+    {
+      // Reference: Section 3.2.1, Figure 3-4
+      int x = (packet >> 32) & 0x00FF | (packet >> 0) & 0x0F00 |
+              (packet >> 16) & 0x1000;
+      int y = (packet >> 40) & 0x00FF | (packet >> 4) & 0x0F00 |
+              (packet >> 17) & 0x1000;
+      int z = (packet >> 16) & 0xFF;
+      bool button = (packet >> 24) & 0x01;
+      detect_deep_press(button, z);
+      if (z == 0)
+      {
+        lift_pen();
+        return;
+      }
+
+      // Beyond the region, the pen stays on its edge.
+      x = max(min(x, absolute_x_max), absolute_x_min);
+      y = max(min(y, absolute_y_max), absolute_y_min);
+      report item = {.buttons = 0};
+      item.absolute = true;
+      item.pen = PEN_IN_RANGE | (button ? (w == 0 || deep_pressed ? PEN_TIP | PEN_BARREL : PEN_TIP) : 0);
+      item.pressure = button ? tip_pressure(z) : 0;
+      item.position_x = (uint32_t)(x - absolute_x_min) * absolute_scale_x >> 16;
+      item.position_y = (uint32_t)(absolute_y_max - y) * absolute_scale_y >> 16;
+      pen_state = item.pen;
+      pen_x = item.position_x;
+      pen_y = item.position_y;
+      send_report(item);
+    }
+
+    void parse_primary_packet(uint64_t packet, int w)
+    {
+      global_tick++;
+      // Reference: Section 3.2.1, Figure 3-4
+      int x = (packet >> 32) & 0x00FF | (packet >> 0) & 0x0F00 |
+              (packet >> 16) & 0x1000;
+      int y = (packet >> 40) & 0x00FF | (packet >> 4) & 0x0F00 |
+              (packet >> 17) & 0x1000;
+      short z = (packet >> 16) & 0xFF; // z 是宽度，手掌压上去z就大，手指轻轻触摸z就小
+      // w is width only if it >= 4. otherwise it encodes finger count
+      short width = max(w, 4);
+
+      // A clickpad reprots its button as a middle/up button. This logic needs to
+      // change completely if the touchpad is not a clickpad (i.e. it has physical
+      // buttons).
+      bool button = (packet >> 24) & 0x01;
+      int new_finger_count = 0;
+      if (z == 0)
+      {
+        new_finger_count = 0;
+      }
+      else if (w >= 4)
+      {
+        new_finger_count = 1;
+      }
+      else if (w == 0)
+      {
+        new_finger_count = 2;
+      }
+      else if (w == 1)
+      {
+        new_finger_count = 3;
+      }
+
+      if (finger_count == 0 && new_finger_count > 0)
+      {
+        session_started_tick = global_tick;
+      }
+
+      /* Mechanisms to smooth the movements. */
+
+      // When a button is pressed, we retrospectively freeze the previous frames,
+      // since the movements tend to be jerky when releasing a button.
+      if (button && !button_down)
+      {
+        freeze_reports();
+      }
+
+      // Clickpad press and release. The report carries the held button, so that
+      // the cursor can keep moving while the pad is held down.
+      if (button && clickpad_buttons == 0 && new_finger_count > 0)
+      {
+        clickpad_buttons = attribute_press(x, y, new_finger_count);
+        debug_printf("Clickpad press: %d, finger: %d\n", clickpad_buttons, pressing_finger);
+        queue_report(0, 0, 0, 0);
+      }
+      else if (!button && clickpad_buttons != 0)
+      {
+        clickpad_buttons = 0;
+        pressing_finger = 0;
+        queue_report(0, 0, 0, 0);
+      }
+      // A deep press clicks on top of the held button, like a force click.
+      if (detect_deep_press(button, z))
+      {
+        queue_report(settings.deep_press_button, 0, 0, 0);
+      }
+
+      // When a button is released, we freeze the next few frames, since the
+      // movements tend to be jerky when pressing a button.
+      if (!button && button_down)
+      {
+        button_released_tick = global_tick;
+      }
+      button_down = button;
+
+      // When a finger is lifted, we restrospectively freeze the previous
+      // frames, since the movements tend to be jerky when lifting a finger.
+      if (new_finger_count < finger_count)
+      {
+        freeze_reports();
+      }
+
+      /* Update state variables. */
+      if (new_finger_count > finger_count)
+      {
+        // A finger has been added. Reset state for that finger.
+        reset_finger(finger_states[1]);
+        if (finger_count == 0)
+        {
+          reset_finger(finger_states[0]);
+        }
+      }
+
+      if (new_finger_count < finger_count)
+      {
+        // A finger has been released.
+        // Whichever finger is left is the one holding the pad down.
+        pressing_finger = 0;
+        if (new_finger_count > 0)
+        {
+          // The primary packet now reports one of the fingers that are left,
+          // which is not necessarily the previous primary one. Find out which
+          // finger it is, so that we carry on with its state instead of
+          // restarting it.
+          int match = match_finger(x, y);
+          if (match == 1)
+          {
+            finger_states[0] = finger_states[1];
+          }
+          else if (match < 0)
+          {
+            reset_finger(finger_states[0]);
+          }
+          // The secondary finger will show up in the next extended packet, if
+          // there is one. Its identity is unknown.
+          reset_finger(finger_states[1]);
+        }
+        else
+        {
+          // All fingers have been lifted.
+          reset_finger(finger_states[0]);
+          reset_finger(finger_states[1]);
+        }
+      }
+
+      int delta_x = 0, delta_y = 0;
+
+      if (new_finger_count > 0)
+      {
+        finger_states[0].z = z;
+
+        int prev_x = finger_states[0].x.average();
+        int new_x = finger_states[0].x.filter(x);
+        if (prev_x > 0 && new_finger_count == finger_count)
+        {
+          delta_x = new_x - prev_x;
+        }
+
+        int prev_y = finger_states[0].y.average();
+        int new_y = finger_states[0].y.filter(y);
+        if (prev_y > 0 && new_finger_count == finger_count)
+        {
+          delta_y = new_y - prev_y;
+        }
+
+        finger_states[0].velocity_x = delta_x;
+        finger_states[0].velocity_y = delta_y;
+        classify_palm(finger_states[0], z, width, delta_x, delta_y);
+      }
+      calibrate_noise(x, y, new_finger_count);
+
+      // if (finger_count == 1 && new_finger_count == 1 &&
+      //     (abs(delta_x) >= max_delta_x || abs(delta_y) >= max_delta_y))
+      // {
+      //   // In rare occasions where a finger is released and another is pressed in
+      //   // the same frame, we don't see a finger count change but a big jump in
+      //   // finger position. In this case, reset the position and start over.
+      //   // This solution isn't ideal. A rather big jump could happen when the
+      //   // fingers are moving very fast. A more reliable approach would be based
+      //   // on the recent velocity of the finger movements. But it's complicated
+      //   // and expensive. Both scenarios just described are edge cases and the user
+      //   // is probably just fooling around.
+      //   finger_states[0].x.reset();
+      //   finger_states[0].y.reset();
+      //   delta_x = 0;
+      //   delta_y = 0;
+      // }
+      // "=== tick: %d, Fingers: %d, X: %d, Y: %d, Z: %d, Width: %d, Button: %d, DeltaX: %d, DeltaY: %d, Per_Finger: %d ===\n"
+      debug_printf("=== t: %d, F: %d, X: %d, Y: %d, Z: %d, W: %d, B: %d, DX: %d, DY: %d, PF: %d ===\n", global_tick, new_finger_count, x, y, z, width, button, delta_x, delta_y, finger_count);
+
+      // 轻触作为点击，包括单击、双击和三击；轻触后拖动
+      gesture::Frame frame = {.tick = global_tick,
+                              .fingers = (uint8_t)new_finger_count,
+                              .movement = (uint16_t)min(abs(delta_x) + abs(delta_y), 0xFFFF),
+                              .z = z,
+                              .button = button,
+                              .palm = finger_states[0].history.palm ||
+                                      (new_finger_count >= 2 && finger_states[1].history.palm)};
+      gesture::Output outputs[gesture::Engine::max_outputs];
+      int output_count = gestures.consume(frame, outputs);
+      for (int i = 0; i < output_count; i++)
+      {
+        switch (outputs[i].type)
+        {
+        case gesture::OutputType::Click:
+          // It goes out once it has been through the delay.
+          count_tap_click(global_tick - session_started_tick + settings.frames_delay);
+          queue_report(outputs[i].buttons, 0, 0, 0);
+          break;
+        case gesture::OutputType::SpeculativeDown:
+          if (speculative_handover > 0)
+          {
+            speculation_deferred = true;
+            break;
+          }
+          // This skips the report queue, so whatever is still in there must not
+          // move the cursor with the button down.
+          freeze_reports();
+          speculative_down_ticks = global_tick - session_started_tick;
+          send_speculative(tap_button_mask(outputs[i].buttons));
+          break;
+        case gesture::OutputType::SpeculativeUp:
+          if (speculation_deferred)
+          {
+            speculation_deferred = false;
+            count_tap_click(global_tick - session_started_tick + settings.frames_delay);
+            queue_report(outputs[i].buttons, 0, 0, 0);
+            break;
+          }
+          send_speculative(0);
+          stats_.speculative_clicks++;
+          count_tap_click(speculative_down_ticks);
+          break;
+        case gesture::OutputType::SpeculativeCancel:
+          if (speculation_deferred)
+          {
+            speculation_deferred = false;
+            break;
+          }
+          send_speculative(0);
+          stats_.speculative_cancels++;
+          debug_printf("Speculative clicks: %lu, cancelled: %lu\n", stats_.speculative_clicks, stats_.speculative_cancels);
+          break;
+        case gesture::OutputType::SpeculativeHold:
+          // The drag holds the left button from this report on. The press
+          // ends once the report is out of the delay, so that the host holds
+          // the button throughout.
+          queue_report(0, 0, 0, 0);
+          if (speculation_deferred)
+          {
+            speculation_deferred = false;
+            break;
+          }
+          speculative_handover = reports.size();
+          stats_.speculative_drags++;
+          break;
+        default:
+          // The held buttons have changed.
+          queue_report(0, 0, 0, 0);
+          break;
+        }
+      }
+
+      finger_count = new_finger_count;
+
+      /* State machine logic */
+      if (finger_count == 0 || finger_count >= 3 || finger_states[0].history.palm)
+      {
+        // Nothing moves when idle, with 3 fingers, or under a palm. Taps are
+        // handled by the gesture engine above.
+      }
+      else if (finger_count == 2 && clickpad_buttons == 0 && !finger_states[1].history.palm)
+      {
+        // scrolling
+        // if (button)
+        // {
+        //   // It's OK to change between left and right while scrolling.
+        //   button_state = new_finger_count > 1 ? RIGHT_BUTTON : LEFT_BUTTON;
+        // }
+        // else
+        // {
+        //   button_state = 0;
+        // }
+
+        // Since we're scrolling, we are here every other frame. So we should double
+        // the noise threshold.
+        bool LR_scroll = abs(delta_x) > abs(delta_y);
+        float scroll_amount = 0;
+        if (LR_scroll)
+        {
+          scroll_amount = to_hid_value(delta_x, noise_threshold_scrolling_x, scale_scroll_x);
+        }
+        else
+        {
+          scroll_amount = to_hid_value(delta_y, noise_threshold_scrolling_y, scale_scroll_y);
+        }
+
+        if (abs(LR_scroll ? delta_x : delta_y) <= slow_scroll_threshold)
+        {
+          scroll_amount = sign(scroll_amount) * settings.slow_scroll_amount;
+        }
+        if (scroll_amount != 0)
+        {
+          debug_printf("Scroll amount: %f\n", scroll_amount);
+          // Serial.printf("Scroll amount: %f\n", scroll_amount);
+          queue_report(0, 0, 0, scroll_amount, LR_scroll);
+        }
+      }
+      else if (finger_count == 1 || pressing_finger == 1 || finger_states[1].history.palm)
+      {
+        // 1-finger tracking, or the primary finger moving while the secondary one
+        // holds the pad down in a button zone or is a palm.
+        // If there are multiple fingers pressed, normal packets and secondary
+        // packets are alternated. So we should double the threshold.
+        float threshold_multiplier = finger_count == 1 ? 1.0 : 2.0;
+        // Serial.print("Width: ");
+        // Serial.print(width);
+        // Serial.print(" Pressure: ");
+        // Serial.println(z);
+
+        if (width > 4)
+        {
+          // Fat finger
+          threshold_multiplier *= 1.0F + (width - 4.0F) / 4.0F;
+        }
+        if (z >= 60)
+        {
+          // Heavy finger
+          threshold_multiplier *= 1.0F + (z - 60.0F) / 40.0F;
+        }
+
+        float delta_x_mm = ((float)delta_x) / ((float)synaptics::units_per_mm_x);
+        float delta_y_mm = ((float)delta_y) / ((float)synaptics::units_per_mm_y);
+        // Precision for low speed and range for high speed. If there are more than
+        // one finger the speed needs to be doubled.
+        float velocity = sqrt(delta_x_mm * delta_x_mm + delta_y_mm * delta_y_mm);
+        if (finger_count > 1)
+        {
+          velocity *= 2;
+        }
+        float scale_multiplier = 1.0F + velocity * 0.5F; // Emperical constant
+
+        int8_t delta_x_hid =
+            to_hid_value(delta_x, noise_threshold_tracking_x * threshold_multiplier,
+                         scale_tracking_x * scale_multiplier);
+        int8_t delta_y_hid = -to_hid_value(
+            delta_y, noise_threshold_tracking_y * threshold_multiplier,
+            scale_tracking_y * scale_multiplier);
+        if (abs(delta_x_hid) > 0 || abs(delta_y_hid) > 0)
+        {
+          debug_printf("DeltaX: %d, DeltaY: %d\n", delta_x_hid, delta_y_hid);
+          queue_report(0, delta_x_hid, delta_y_hid, 0);
+        }
+      }
+    }
+
+    void parse_extended_packet(uint64_t packet)
+    {
+      uint8_t packet_code = (packet >> 44) & 0x0F;
+      if (packet_code == 1)
+      {
+        // Reference: Section 3.2.9.2. Figure 3-14
+        int x = (packet >> 7) & 0x01FE | (packet >> 23) & 0x1E00;
+        int y = (packet >> 15) & 0x01FE | (packet >> 27) & 0x1E00;
+        short z = (packet >> 39) & 0x1D | (packet >> 23) & 0x60;
+
+        if (x == 0 || y == 0 || z == 0)
+        {
+          reset_finger(finger_states[1]);
+          return;
+        }
+
+        int prev_x = finger_states[1].x.average();
+        int new_x = finger_states[1].x.filter(x);
+        int delta_x = prev_x == 0 ? 0 : new_x - prev_x;
+
+        int prev_y = finger_states[1].y.average();
+        int new_y = finger_states[1].y.filter(y);
+        int delta_y = prev_y == 0 ? 0 : new_y - prev_y;
+
+        if (abs(delta_x) >= max_delta_x || abs(delta_y) >= max_delta_y)
+        {
+          // Sometimes when a 2nd or 3rd finger is released, we receive a secondary
+          // finger position before the finger count change. In this case, the new
+          // secondary finger is not necessarily the same physical finger as
+          // previous one. Not sure if this is by design or due to a packet loss.
+          // In either case, we should not report this position change to avoid
+          // jerky movements. Instead, reset the secondary finger state and start
+          // over.
+          reset_finger(finger_states[1]);
+          delta_x = 0;
+          delta_y = 0;
+        }
+
+        finger_states[1].x.filter(x);
+        finger_states[1].y.filter(y);
+        finger_states[1].z = z;
+        finger_states[1].velocity_x = delta_x;
+        finger_states[1].velocity_y = delta_y;
+
+        // Extended packets carry no width.
+        if (classify_palm(finger_states[1], z, 0, delta_x, delta_y))
+        {
+          // The gesture engine hears about it with the next primary packet.
+          return;
+        }
+
+        if (clickpad_buttons != 0 && pressing_finger == 1)
+        {
+          // The secondary finger is resting on a button zone.
+          return;
+        }
+
+        // TODO: use velocity and z value to adjst the multiplier here too, just
+        // like the primary frames. We don't have width info though.
+        if (finger_count >= 2 && !gestures.dragging() && clickpad_buttons == 0 &&
+            !finger_states[0].history.palm)
+        {
+          // Since we are parsing secondary packets, we are here every other frame,
+          // so we should double the noise threshold.
+          bool LR_scroll = abs(delta_x) > abs(delta_y);
+
+          float scroll_amount = 0;
+          if (LR_scroll)
+          {
+            scroll_amount = to_hid_value(delta_x, noise_threshold_scrolling_x, scale_scroll_x);
+          }
+          else
+          {
+            scroll_amount = to_hid_value(delta_y, noise_threshold_scrolling_y, scale_scroll_y);
+          }
+          if (abs(LR_scroll ? delta_x : delta_y) <= slow_scroll_threshold)
+          {
+            scroll_amount = sign(scroll_amount) * settings.slow_scroll_amount;
+          }
+          debug_printf("Wmode Scroll amount: %f\n", scroll_amount);
+          queue_report(0, 0, 0, scroll_amount, LR_scroll);
+        }
+        else
+        {
+          int8_t delta_x_hid = to_hid_value(
+              delta_x, noise_threshold_tracking_x * 2.0F, scale_tracking_x);
+          int8_t delta_y_hid = -to_hid_value(
+              delta_y, noise_threshold_tracking_y * 2.0F, scale_tracking_y);
+          debug_printf("Wmode DeltaX: %d, DeltaY: %d\n", delta_x_hid, delta_y_hid);
+          // queue_report(button_state, delta_x_hid, delta_y_hid, 0);
+          queue_report(0, delta_x_hid, delta_y_hid, 0);
+        }
+      }
+    }
+
+    // Sends the oldest delayed report, once it has been held for frames_delay.
+    void send_delayed_report()
+    {
+      if (global_tick - session_started_tick >= settings.frames_delay)
+      {
+        report item;
+        if (reports.try_pop(item))
+        {
+          delayed_held_buttons = item.held_buttons;
+          item.held_buttons |= guest_buttons;
+          send_report(item);
+          if (speculative_handover > 0 && --speculative_handover == 0)
+          {
+            send_speculative(0);
+          }
+        }
+      }
+    }
+
+    // How many packets sent every `every` report periods are missing between
+    // two captured at from and to. Gaps longer than max_lost_frames are the
+    // pad pausing its stream, e.g. after the fingers lifted.
+    int missing_packets(uint32_t from, uint32_t to, int every)
+    {
+      uint32_t period = (synaptics::high_rate() ? 1000000 / 80 : 1000000 / 40) * every;
+      int packets = (to - from + period / 2) / period;
+      return packets <= 1 || packets > max_lost_frames ? 0 : packets - 1;
+    }
+
+    // Returns how many report periods went by without a packet just before
+    // this one, judging by when it was captured. Every finger packet takes a
+    // period of its own: with two fingers, the extended and the primary ones
+    // take turns (Section 3.2.9.2). A change of rate starts over.
+    int count_lost_frames(uint32_t captured)
+    {
+      stats_.frames_received++;
+      if (counted_high_rate != synaptics::high_rate())
+      {
+        counted_high_rate = synaptics::high_rate();
+        packet_timed = false;
+        primary_timed = false;
+        extended_timed = false;
+      }
+      int lost = packet_timed ? missing_packets(last_packet_us, captured, 1) : 0;
+      packet_timed = true;
+      last_packet_us = captured;
+      stats_.frames_lost += lost;
+      return lost;
+    }
+
+    // A packet between two others, with x and y a step of the way from one to the
+    // other. Everything else, z included, is taken from the later one.
+    uint64_t interpolate_primary(uint64_t from, uint64_t to, int step, int steps)
+    {
+      // Reference: Section 3.2.1, Figure 3-4
+      int from_x = (from >> 32) & 0x00FF | (from >> 0) & 0x0F00 | (from >> 16) & 0x1000;
+      int from_y = (from >> 40) & 0x00FF | (from >> 4) & 0x0F00 | (from >> 17) & 0x1000;
+      int to_x = (to >> 32) & 0x00FF | (to >> 0) & 0x0F00 | (to >> 16) & 0x1000;
+      int to_y = (to >> 40) & 0x00FF | (to >> 4) & 0x0F00 | (to >> 17) & 0x1000;
+      uint64_t x = from_x + (to_x - from_x) * step / steps;
+      uint64_t y = from_y + (to_y - from_y) * step / steps;
+      const uint64_t position = 0xFFFF0000FF00ULL | 0x30000000ULL;
+      return to & ~position | (x & 0xFF) << 32 | (y & 0xFF) << 40 | (x >> 8 & 0x0F) << 8 |
+             (y >> 8 & 0x0F) << 12 | (x >> 12 & 0x01) << 28 | (y >> 12 & 0x01) << 29;
+    }
+
+    uint64_t interpolate_extended(uint64_t from, uint64_t to, int step, int steps)
+    {
+      // Reference: Section 3.2.9.2. Figure 3-14
+      int from_x = (from >> 7) & 0x01FE | (from >> 23) & 0x1E00;
+      int from_y = (from >> 15) & 0x01FE | (from >> 27) & 0x1E00;
+      int to_x = (to >> 7) & 0x01FE | (to >> 23) & 0x1E00;
+      int to_y = (to >> 15) & 0x01FE | (to >> 27) & 0x1E00;
+      uint64_t x = from_x + (to_x - from_x) * step / steps;
+      uint64_t y = from_y + (to_y - from_y) * step / steps;
+      const uint64_t position = 0xFF00FFFF00ULL;
+      return to & ~position | (x >> 1 & 0xFF) << 8 | (y >> 1 & 0xFF) << 16 |
+             (x >> 9 & 0x0F) << 32 | (y >> 9 & 0x0F) << 36;
+    }
+
+    // Whether an extended packet has the second finger down.
+    bool extended_touching(uint64_t packet)
+    {
+      // Reference: Section 3.2.9.2. Figure 3-14
+      int x = (packet >> 7) & 0x01FE | (packet >> 23) & 0x1E00;
+      int y = (packet >> 15) & 0x01FE | (packet >> 27) & 0x1E00;
+      int z = (packet >> 39) & 0x1D | (packet >> 23) & 0x60;
+      return x != 0 && y != 0 && z != 0;
+    }
+
+    // Decodes the finger packets of the pad, and fills in packets lost on the
+    // way when only a few are missing. Without that, the next delta would span
+    // the gap: the cursor jerks, and the second finger may look like a new one.
+    // With two fingers or more, the extended and the primary packets take
+    // turns, so each kind is filled in between packets of its own kind.
+    void parse_finger_packet(uint64_t packet, int w, uint32_t captured)
+    {
+      if (w == 2)
+      {
+        int lost = extended_timed ? missing_packets(last_extended_us, captured, 2) : 0;
+        extended_timed = true;
+        last_extended_us = captured;
+        if (lost > 0 && lost <= max_interpolated_frames && last_extended != 0 &&
+            extended_touching(last_extended) && extended_touching(packet))
+        {
+          for (int i = 1; i <= lost; i++)
+          {
+            parse_extended_packet(interpolate_extended(last_extended, packet, i, lost + 1));
+            stats_.frames_interpolated++;
+          }
+        }
+        parse_extended_packet(packet);
+        last_extended = packet;
+        return;
+      }
+
+      // Only a finger that stayed down in between moved in a straight line.
+      // While there is more than one, every other packet is a primary one.
+      uint8_t last_w = (last_primary >> 26) & 0x01 | (last_primary >> 1) & 0x2 | (last_primary >> 2) & 0x0C;
+      bool several = w < 2 || last_w < 2;
+      int lost = primary_timed ? missing_packets(last_primary_us, captured, several ? 2 : 1) : 0;
+      primary_timed = true;
+      last_primary_us = captured;
+      bool touching = (last_primary >> 16 & 0xFF) != 0 && (packet >> 16 & 0xFF) != 0;
+      bool same_fingers = w == last_w || (w >= 4 && last_w >= 4);
+      bool same_button = ((last_primary ^ packet) >> 24 & 0x01) == 0;
+      if (lost > 0 && lost <= max_interpolated_frames && touching && same_fingers && same_button)
+      {
+        for (int i = 1; i <= lost; i++)
+        {
+          parse_primary_packet(interpolate_primary(last_primary, packet, i, lost + 1), w);
+          send_delayed_report();
+          stats_.frames_interpolated++;
+        }
+      }
+      if (w >= 4 || (packet >> 16 & 0xFF) == 0)
+      {
+        last_extended = 0;
+      }
+      parse_primary_packet(packet, w);
+      last_primary = packet;
+    }
+
+    #ifdef TRACE_GESTURES
+    void trace_gesture(gesture::State from, gesture::Event event, gesture::State to)
+    {
+      log_printf("[gesture] t: %lu %s --%s--> %s\n", global_tick, gesture::state_name(from),
+                    gesture::event_name(event), gesture::state_name(to));
+    }
+    #endif
+  } // namespace
+
+  void begin(const tuning::Settings &values, const Hooks &new_hooks)
+  {
+    hooks = new_hooks;
+    stats_ = Stats();
+    frame_buffer = 0;
+    frame_index = 0;
+    frame_started = 0;
+    resync_requested = false;
+    global_tick = 0;
+    session_started_tick = 0;
+    button_released_tick = 0;
+    gestures.reset();
+  #ifdef TRACE_GESTURES
+    gestures.set_trace(trace_gesture);
+  #endif
+    clickpad_buttons = 0;
+    guest_buttons = 0;
+    pressing_finger = 0;
+    reports = RingBuffer<report, 32>();
+    report item;
+    while (output_channel.pop(item))
+    {
+    }
+    sent_held_buttons = 0;
+    sent_pen = 0;
+    delayed_held_buttons = 0;
+    speculative_handover = 0;
+    speculation_deferred = false;
+    scroll_amount_rollover = 0;
+    next_finger_id = 0;
+    for (finger_state &finger : finger_states)
+    {
+      finger = finger_state();
+      reset_finger(finger);
+    }
+    finger_count = 0;
+    button_down = false;
+    calibration = noise_calibration();
+    last_packet_us = 0;
+    last_primary_us = 0;
+    last_extended_us = 0;
+    packet_timed = false;
+    primary_timed = false;
+    extended_timed = false;
+    counted_high_rate = false;
+    last_primary = 0;
+    last_extended = 0;
+    pen_state = 0;
+    pen_x = 0;
+    pen_y = 0;
+    press_z = 0;
+    deep_pressed = false;
+    apply_settings(values);
+  }
+
+  void apply_settings(const tuning::Settings &values)
+  {
+    settings = values;
+    scale_tracking_x = values.scale_tracking_mm / synaptics::units_per_mm_x;
+    scale_tracking_y = values.scale_tracking_mm / synaptics::units_per_mm_y;
+    scale_scroll_x = values.scale_scroll_mm / synaptics::units_per_mm_x;
+    scale_scroll_y = values.scale_scroll_mm / synaptics::units_per_mm_y;
+    // A calibrated noise floor replaces the configured tracking threshold of
+    // its axis. The scrolling threshold keeps its ratio to it.
+    float tracking_x_mm = values.noise_threshold_tracking_mm;
+    float tracking_y_mm = values.noise_threshold_tracking_mm;
+    float scrolling_x_mm = values.noise_threshold_scrolling_mm;
+    float scrolling_y_mm = values.noise_threshold_scrolling_mm;
+    if (values.noise_threshold_tracking_mm > 0)
+    {
+      if (values.noise_floor_x_mm > 0)
+      {
+        scrolling_x_mm *= values.noise_floor_x_mm / values.noise_threshold_tracking_mm;
+        tracking_x_mm = values.noise_floor_x_mm;
+      }
+      if (values.noise_floor_y_mm > 0)
+      {
+        scrolling_y_mm *= values.noise_floor_y_mm / values.noise_threshold_tracking_mm;
+        tracking_y_mm = values.noise_floor_y_mm;
+      }
+    }
+    noise_threshold_tracking_x = tracking_x_mm * synaptics::units_per_mm_x;
+    noise_threshold_tracking_y = tracking_y_mm * synaptics::units_per_mm_y;
+    noise_threshold_scrolling_x = scrolling_x_mm * synaptics::units_per_mm_x;
+    noise_threshold_scrolling_y = scrolling_y_mm * synaptics::units_per_mm_y;
+    calibration_rest_gate_x = calibration_rest_gate_mm * synaptics::units_per_mm_x;
+    calibration_rest_gate_y = calibration_rest_gate_mm * synaptics::units_per_mm_y;
+    max_delta_x = values.max_delta_mm * synaptics::units_per_mm_x;
+    max_delta_y = values.max_delta_mm * synaptics::units_per_mm_y;
+    slow_scroll_threshold = values.slow_scroll_threshold_mm * synaptics::units_per_mm_y;
+    proximity_threshold_x = values.proximity_threshold_mm * synaptics::units_per_mm_x;
+    proximity_threshold_y = values.proximity_threshold_mm * synaptics::units_per_mm_y;
+    palm_max_speed = values.palm_max_speed_mm * (synaptics::units_per_mm_x + synaptics::units_per_mm_y);
+    int button_zone_top = synaptics::min_y + values.button_zone_height_mm * synaptics::units_per_mm_y;
+    int button_zone_split = (synaptics::min_x + synaptics::max_x) / 2;
+    // The outer edges are left open, since fingers can report positions beyond
+    // the nominal limits.
+    button_zones[0] = {0, button_zone_split, 0, button_zone_top, MOUSE_LEFT};
+    button_zones[1] = {button_zone_split, 0x2000, 0, button_zone_top, MOUSE_RIGHT};
+    gestures.set_config(gesture_config(values));
+    int width = synaptics::max_x - synaptics::min_x;
+    int height = synaptics::max_y - synaptics::min_y;
+    absolute_x_min = synaptics::min_x + width * values.absolute_left / 1000;
+    absolute_x_max = synaptics::min_x + width * values.absolute_right / 1000;
+    absolute_y_min = synaptics::min_y + height * values.absolute_bottom / 1000;
+    absolute_y_max = synaptics::min_y + height * values.absolute_top / 1000;
+    // Region and scale are set once here, so that a packet only takes a
+    // multiplication and a shift per axis. The scale is rounded up, so that
+    // the far edge reaches PEN_MAX; it can't go past it, since the region is
+    // far narrower than 1 << 16.
+    int absolute_width = max(absolute_x_max - absolute_x_min, 1);
+    int absolute_height = max(absolute_y_max - absolute_y_min, 1);
+    absolute_scale_x = (((uint32_t)PEN_MAX << 16) + absolute_width - 1) / absolute_width;
+    absolute_scale_y = (((uint32_t)PEN_MAX << 16) + absolute_height - 1) / absolute_height;
+    // Rounded up the same way, so that pressure_z_max reaches PEN_PRESSURE_MAX.
+    int pressure_range = values.pressure_z_max - values.pressure_z_min;
+    pressure_scale = ((PEN_PRESSURE_MAX << 8) + pressure_range - 1) / pressure_range;
+  }
+
+  bool IRAM_ATTR frame_byte(uint8_t data, uint32_t now, captured_packet &packet)
+  {
+    // init() sets the protocol before the device starts streaming.
+    bool touchpad = synaptics::protocol == synaptics::Protocol::Synaptics;
+    int packet_bits = touchpad ? 48 : synaptics::protocol == synaptics::Protocol::IntelliMouse ? 32 : 24;
+
+    if (resync_requested)
+    {
+      resync_requested = false;
+      frame_index = 0;
+      frame_buffer = 0;
+    }
+
+    // Ignore all bytes until we see the start of a packet, otherwise the
+    // packets may get out of sequence and things will get very confusing.
+    // Byte 0 of a mouse packet only has bit 3 always set.
+    if (frame_index == 0 && (touchpad ? (data & 0xc8) != 0x80 : (data & 0x08) == 0))
+    {
+      trace::event(trace::TRACE_BAD_BYTE0, data);
+      stats_.packet_errors++;
+      return false;
+    }
+
+    if (frame_index == 0)
+    {
+      frame_started = now;
+    }
+
+    if (touchpad && frame_index == 24 && (data & 0xc8) != 0xc0)
+    {
+      trace::event(trace::TRACE_BAD_BYTE3, data);
+      stats_.packet_errors++;
+
+      frame_index = 0;
+      frame_buffer = 0;
+      return false;
+    }
+
+    frame_buffer |= ((uint64_t)data) << frame_index;
+    frame_index += 8;
+    if (frame_index < packet_bits)
+    {
+      return false;
+    }
+    packet = {.packet = frame_buffer, .micros = frame_started};
+    frame_index = 0;
+    frame_buffer = 0;
+    return true;
+  }
+
+  void resync() { resync_requested = true; }
+
+  void decode(const captured_packet &captured)
+  {
+    uint64_t packet = captured.packet;
+    if (synaptics::protocol != synaptics::Protocol::Synaptics)
+    {
+      parse_mouse_packet(packet);
+      return;
+    }
+
+    // 处理packet数据
+    uint8_t w = (packet >> 26) & 0x01 | (packet >> 1) & 0x2 | (packet >> 2) & 0x0C;
+    switch (w) // 文档 3.2.6 节，Figure 3-9
+    {
+    case 3: // 当w=3时，表示是Pass-Through encapsulation packet（直通式封装数据包）
+      // The guest keeps its own time, so these don't count towards frames.
+      parse_guest_packet(packet);
+      break;
+    case 2: // 当w=2时，表示是Extended W mode packet（扩展W模式数据包）
+      count_lost_frames(captured.micros);
+      if (!settings.absolute_mode)
+      {
+        parse_finger_packet(packet, w, captured.micros);
+      }
+      break;
+    default: // 当w=0或w=1时，表示是capMultiFinger，0是两根手指，1是三根及以上手指
+      count_lost_frames(captured.micros);
+      if (settings.absolute_mode)
+      {
+        parse_absolute_packet(packet, w);
+      }
+      else
+      {
+        parse_finger_packet(packet, w, captured.micros);
+      }
+      break;
+    }
+  }
+
+  void tick()
+  {
+    global_tick++;
+    send_delayed_report();
+  }
+
+  void release_buttons()
+  {
+    bool held = sent_held_buttons != 0 || clickpad_buttons != 0 || guest_buttons != 0 ||
+                gestures.state() != gesture::State::Idle;
+    clickpad_buttons = 0;
+    guest_buttons = 0;
+    delayed_held_buttons = 0;
+    speculative_handover = 0;
+    speculation_deferred = false;
+    pressing_finger = 0;
+    press_z = 0;
+    deep_pressed = false;
+    button_down = false;
+    gestures.reset();
+    if (held)
+    {
+      send_speculative(0);
+      send_report(report{.buttons = 0});
+    }
+  }
+
+  // Sends the pen up, out of range, where it was last seen.
+  void lift_pen()
+  {
+    if (pen_state == 0)
+    {
+      return;
+    }
+    pen_state = 0;
+    report item = {.buttons = 0};
+    item.absolute = true;
+    item.position_x = pen_x;
+    item.position_y = pen_y;
+    send_report(item);
+  }
+
+  bool next_report(report &item)
+  {
+    return output_channel.pop(item);
+  }
+
+  int delayed_reports()
+  {
+    return reports.size();
+  }
+
+  uint32_t folded_reports()
+  {
+    return reports.overflows();
+  }
+
+  bool guest_buttons_held()
+  {
+    return guest_buttons != 0;
+  }
+
+  const Stats &stats()
+  {
+    return stats_;
+  }
+
+  uint8_t Buttons::update(const report &item)
+  {
+    if (item.absolute)
+    {
+      return held();
+    }
+    if (item.speculative)
+    {
+      m_speculative = item.held_buttons;
+    }
+    else
+    {
+      m_held = item.held_buttons;
+    }
+    return held();
+  }
+
+  int8_t host_scroll(const report &item, const tuning::Settings &values)
+  {
+    if (item.mouse)
+    {
+      return item.scroll;
+    }
+    bool reverse = item.LR_scroll ? values.reverse_LR_scroll : values.reverse_UD_scroll;
+    return reverse ? -item.scroll : item.scroll;
+  }
+
+} // namespace decoder
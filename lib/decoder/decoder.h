@@ -0,0 +1,166 @@
+// decoder.h
+#ifndef DECODER_H
+#define DECODER_H
+
+#include <cstdint>
+#include <gesture.h>
+#include <synaptics.h>
+#include <tuning.h>
+
+// The button and pen bits of the HID reports, the same as in BleMouse.h,
+// which needs the BLE stack and so can't be included on the host.
+#ifndef MOUSE_LEFT
+#define MOUSE_LEFT 1
+#define MOUSE_RIGHT 2
+#define MOUSE_MIDDLE 4
+#define MOUSE_BACK 8
+#define MOUSE_FORWARD 16
+#define PEN_TIP 1
+#define PEN_BARREL 2
+#define PEN_IN_RANGE 4
+#define PEN_MAX 32767
+#define PEN_PRESSURE_MAX 255
+#endif
+
+// Turns the packets of the pad, or of a mouse found instead of it, into
+// reports for the host: finger tracking, palms, button zones, gestures, the
+// report delay and the absolute mode. It knows nothing about FreeRTOS or BLE,
+// so that the touchpad task and the tests on the host run the same code. The
+// reports come out of a channel read by a single consumer, on any core.
+//
+// Everything but frame_byte() and next_report() runs in one task, the one
+// that called begin().
+namespace decoder
+{
+
+  const int position_average_frames = 5; // 手指坐标的滑动平均帧数
+
+  // A packet as it came off the line, with the time its first byte arrived.
+  struct captured_packet
+  {
+    uint64_t packet;
+    uint32_t micros;
+  };
+
+  struct report
+  {
+    uint8_t buttons;
+    int8_t x;
+    int8_t y;
+    int8_t scroll;
+    bool LR_scroll;
+    uint8_t held_buttons; // 按住的按键（物理按键和拖动），和 buttons 的轻触点击分开
+    bool speculative;     // 预先点击：held_buttons 是预先按下的按键，不经过延迟直接发送
+    bool absolute;        // 绝对模式：只有 pen 和 position_x/y 有意义，不经过延迟直接发送
+    uint8_t pen;          // PEN_TIP 等
+    uint16_t position_x;  // 0 到 PEN_MAX，y 从屏幕上边算起
+    uint16_t position_y;
+    uint8_t pressure;     // 笔尖压力，0 到 PEN_PRESSURE_MAX
+    bool mouse;           // 来自鼠标或直通设备：滚轮已经是主机的方向，不按 reverse_*_scroll 反转
+  };
+
+  // Counters since begin(), for the stats printed by the firmware.
+  struct Stats
+  {
+    uint32_t packet_errors;       // packets dropped on a byte 0 or 3 out of place
+    uint32_t finger_matches;      // 手指数量减少时成功识别剩下手指的次数
+    uint32_t finger_resets;       // 无法识别而重置状态的次数，会导致光标跳动
+    uint32_t palms;               // 判定为手掌的接触，每次放上最多算一次
+    uint32_t speculative_clicks;  // 预先按下后成功完成的点击
+    uint32_t speculative_cancels; // 预先按下后被纠正的误点击
+    uint32_t speculative_drags;   // 预先按下后交给拖动继续按住
+    uint32_t tap_clicks;          // 轻触点击，预先按下的和抬起后才点击的都算
+    uint32_t tap_click_ticks;     // 这些点击从手指放上到按键发出的 tick 总和，除以 tap_clicks 是平均延迟
+    uint32_t channel_overflows;   // 发送任务跟不上而丢弃的移动
+    uint32_t channel_waits;       // 为了不丢掉按键变化而等待发送任务的次数
+    int channel_max_depth;
+    uint32_t frames_received;     // 收到的手指数据包，每个占一个报告周期
+    uint32_t frames_lost;         // 按时间间隔推算丢失的数据包
+    uint32_t frames_interpolated; // 补上的丢失数据包
+  };
+
+  typedef void (*NotifyFunction)();
+  typedef void (*SaveFunction)(const tuning::Settings &values);
+
+  // How the decoder reaches the rest of the firmware. Any of them may be
+  // nullptr.
+  struct Hooks
+  {
+    // A report has been put in the channel.
+    NotifyFunction report_ready;
+    // The channel is full, and a report that changes buttons or the pen has
+    // to wait. Gives the consumer some time to catch up, e.g. by sleeping
+    // for a tick. Without it, such a report is dropped like a move.
+    NotifyFunction wait_for_output;
+    // The noise calibration has new noise floors in values, which are
+    // already applied, for saving.
+    SaveFunction save_calibration;
+  };
+
+  // The settings in effect. Only apply_settings() changes them.
+  extern tuning::Settings settings;
+
+  // Forgets everything, counters included, and applies values. The channel
+  // must have no consumer yet.
+  void begin(const tuning::Settings &values, const Hooks &hooks);
+  // Makes values the current settings, and recomputes everything derived
+  // from them. Call it between packets.
+  void apply_settings(const tuning::Settings &values);
+
+  // Collects the bytes streamed by the device in the protocol init() found.
+  // Returns true, with the packet and the time now of its first byte, when a
+  // packet is complete. Safe to call from an interrupt.
+  bool frame_byte(uint8_t data, uint32_t now, captured_packet &packet);
+  // Drops the bytes of a packet cut short, e.g. by a command sent to the
+  // device, so that the next byte has to start a packet. Takes effect at the
+  // next frame_byte().
+  void resync();
+
+  // Decodes a packet from frame_byte().
+  void decode(const captured_packet &captured);
+  // Advances the report delay by a frame. Call it at least once per packet
+  // period, packets or not.
+  void tick();
+  // Lets go of every button. A press can be cut short by line noise, so that
+  // the packets that would have ended it never arrive.
+  void release_buttons();
+  // Sends the pen up, out of range, where it was last seen.
+  void lift_pen();
+
+  // Consumer side of the channel. Returns false if there is no report.
+  bool next_report(report &item);
+
+  // Reports held back by the report delay, and how many of them had to be
+  // folded into others because there was no room.
+  int delayed_reports();
+  uint32_t folded_reports();
+  // Whether a mouse or pointing stick holds a button, which keeps the pad
+  // from going idle since they are silent while held still.
+  bool guest_buttons_held();
+  const Stats &stats();
+
+  // What the host holds, worked out by the consumer from the reports in
+  // order. The reports hold buttons (clickpad, drag, guest) and speculative
+  // taps hold them separately, and the host holds both.
+  class Buttons
+  {
+  public:
+    Buttons() : m_held(0), m_speculative(0) {}
+
+    // Takes in a report and returns the buttons the host holds after it.
+    uint8_t update(const report &item);
+    uint8_t held() const { return m_held | m_speculative; }
+
+  private:
+    uint8_t m_held;
+    uint8_t m_speculative;
+  };
+
+  // The scroll of a report as the host gets it, in the direction set by
+  // values. A mouse wheel already turns the way the host expects, and is
+  // left alone.
+  int8_t host_scroll(const report &item, const tuning::Settings &values);
+
+} // namespace decoder
+
+#endif // DECODER_H
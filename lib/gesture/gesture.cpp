@@ -0,0 +1,268 @@
+#include "gesture.h"
+
+namespace gesture
+{
+  namespace
+  {
+    // Every state change the engine can make. Events that have no entry for
+    // the current state are ignored.
+    const Transition transitions[] = {
+        {State::Idle, Event::Touch, State::Touch, Action::StartTap},
+
+        {State::Touch, Event::Tap, State::DragArmed, Action::Click},
+        {State::Touch, Event::MultiTap, State::Idle, Action::Click},
+        {State::Touch, Event::Lift, State::Idle, Action::None},
+        {State::Touch, Event::Press, State::Track, Action::None},
+        {State::Touch, Event::Palm, State::Track, Action::None},
+        {State::Touch, Event::Move, State::Track, Action::None},
+        {State::Touch, Event::MultiMove, State::Scroll, Action::None},
+        {State::Touch, Event::TapTimeout, State::Track, Action::None},
+        {State::Touch, Event::Still, State::Touch, Action::Speculate},
+
+        {State::Track, Event::Lift, State::Idle, Action::None},
+        // A touch cut short by a press or a palm can lift as quickly as a tap.
+        {State::Track, Event::Tap, State::Idle, Action::None},
+        {State::Track, Event::MultiTap, State::Idle, Action::None},
+        {State::Track, Event::MultiMove, State::Scroll, Action::None},
+
+        {State::Scroll, Event::Lift, State::Idle, Action::None},
+        {State::Scroll, Event::Move, State::Track, Action::None},
+
+        {State::DragArmed, Event::DragTimeout, State::Idle, Action::None},
+        {State::DragArmed, Event::Touch, State::DragTouch, Action::StartTap},
+
+        {State::DragTouch, Event::DragTimeout, State::Touch, Action::None},
+        {State::DragTouch, Event::Tap, State::DragArmed, Action::Click},
+        {State::DragTouch, Event::MultiTap, State::Idle, Action::Click},
+        {State::DragTouch, Event::Lift, State::Idle, Action::None},
+        {State::DragTouch, Event::Press, State::Track, Action::None},
+        {State::DragTouch, Event::Palm, State::Track, Action::None},
+        {State::DragTouch, Event::Move, State::Drag, Action::ButtonDown},
+        {State::DragTouch, Event::MultiMove, State::Scroll, Action::None},
+        {State::DragTouch, Event::TapTimeout, State::Track, Action::None},
+        {State::DragTouch, Event::Still, State::DragTouch, Action::Speculate},
+
+        {State::Drag, Event::Lift, State::Idle, Action::ButtonUp},
+    };
+
+    const char *const state_names[] = {
+        "Idle", "Touch", "Track", "Scroll", "DragArmed", "DragTouch", "Drag",
+    };
+
+    const char *const event_names[] = {
+        "DragTimeout", "Touch", "Tap", "MultiTap", "Lift",
+        "Press", "Palm", "Move", "MultiMove", "TapTimeout", "Still",
+    };
+
+    static_assert(sizeof(state_names) / sizeof(state_names[0]) == (int)State::Count,
+                  "state_names out of sync");
+    static_assert(sizeof(event_names) / sizeof(event_names[0]) == (int)Event::Count,
+                  "event_names out of sync");
+  } // namespace
+
+  const char *state_name(State state)
+  {
+    return state < State::Count ? state_names[(int)state] : "?";
+  }
+
+  const char *event_name(Event event)
+  {
+    return event < Event::Count ? event_names[(int)event] : "?";
+  }
+
+  Engine::Engine(const Config &config) : m_config(config), m_trace(nullptr)
+  {
+    reset();
+  }
+
+  void Engine::reset()
+  {
+    m_state = State::Idle;
+    m_fingers = 0;
+    m_tap_start_tick = 0;
+    m_tap_tick = 0;
+    m_movement = 0;
+    m_max_z = 0;
+    m_max_fingers = 0;
+    m_pressed = false;
+    m_speculative = 0;
+  }
+
+  bool Engine::tap_eligible(const Frame &frame) const
+  {
+    return frame.tick - m_tap_start_tick <= m_config.tap_time &&
+           m_movement < m_config.tap_movement && m_max_z < m_config.tap_z;
+  }
+
+  bool Engine::still(const Frame &frame) const
+  {
+    return m_config.speculative && m_speculative == 0 && frame.fingers > 0 &&
+           !frame.button && !frame.palm &&
+           frame.tick - m_tap_start_tick >= m_config.speculative_delay &&
+           m_movement < m_config.tap_movement && m_max_z < m_config.tap_z;
+  }
+
+  // Releases a speculative press once the touch is no longer a tap in the
+  // making. A drag takes it over, since it wants the left button down anyway.
+  void Engine::settle_speculation(Output outputs[], int &count)
+  {
+    if (m_speculative == 0 || m_state == State::Touch || m_state == State::DragTouch)
+    {
+      return;
+    }
+    if (m_state == State::Drag && m_speculative == 1)
+    {
+      outputs[count++] = {OutputType::SpeculativeHold, m_speculative};
+    }
+    else
+    {
+      outputs[count++] = {OutputType::SpeculativeCancel, m_speculative};
+    }
+    m_speculative = 0;
+  }
+
+  bool Engine::apply(Event event, const Frame &frame, Output outputs[], int &count)
+  {
+    const Transition *transition = nullptr;
+    for (const Transition &candidate : transitions)
+    {
+      if (candidate.from == m_state && candidate.event == event)
+      {
+        transition = &candidate;
+        break;
+      }
+    }
+    if (transition == nullptr)
+    {
+      return false;
+    }
+
+    if (m_trace != nullptr)
+    {
+      m_trace(m_state, event, transition->to);
+    }
+    m_state = transition->to;
+
+    switch (transition->action)
+    {
+    case Action::StartTap:
+      m_tap_start_tick = frame.tick;
+      m_movement = 0;
+      m_max_z = 0;
+      m_max_fingers = 0;
+      break;
+    case Action::Click:
+    {
+      m_tap_tick = frame.tick;
+      uint8_t button = m_max_fingers > 3 ? 3 : m_max_fingers;
+      if (m_speculative == button)
+      {
+        // The button went down at touch time. Releasing it completes the
+        // click.
+        outputs[count++] = {OutputType::SpeculativeUp, m_speculative};
+        m_speculative = 0;
+        break;
+      }
+      if (m_speculative != 0)
+      {
+        // More fingers joined in since, so it was the wrong button.
+        outputs[count++] = {OutputType::SpeculativeCancel, m_speculative};
+        m_speculative = 0;
+      }
+      outputs[count++] = {OutputType::Click, button};
+      break;
+    }
+    case Action::ButtonDown:
+      if (m_speculative == 1)
+      {
+        // Already down since the touch.
+        break;
+      }
+      outputs[count++] = {OutputType::ButtonDown, 1};
+      break;
+    case Action::ButtonUp:
+      outputs[count++] = {OutputType::ButtonUp, 1};
+      break;
+    case Action::Speculate:
+      m_speculative = m_max_fingers > 3 ? 3 : m_max_fingers;
+      outputs[count++] = {OutputType::SpeculativeDown, m_speculative};
+      break;
+    default:
+      break;
+    }
+    settle_speculation(outputs, count);
+    return true;
+  }
+
+  int Engine::consume(const Frame &frame, Output outputs[max_outputs])
+  {
+    // Each event is raised at most once per frame, in this order, so a frame
+    // can never produce more than a handful of outputs.
+    int count = 0;
+
+    if ((m_state == State::DragArmed || m_state == State::DragTouch) &&
+        frame.tick - m_tap_tick > m_config.drag_window)
+    {
+      apply(Event::DragTimeout, frame, outputs, count);
+    }
+
+    if (m_fingers == 0 && frame.fingers > 0)
+    {
+      apply(Event::Touch, frame, outputs, count);
+    }
+
+    if (frame.fingers > 0)
+    {
+      uint32_t movement = (uint32_t)m_movement + frame.movement;
+      m_movement = movement > UINT16_MAX ? UINT16_MAX : movement;
+      if (frame.z > m_max_z)
+      {
+        m_max_z = frame.z;
+      }
+      if (frame.fingers > m_max_fingers)
+      {
+        m_max_fingers = frame.fingers;
+      }
+    }
+
+    if (m_fingers > 0 && frame.fingers == 0)
+    {
+      Event lift = Event::Lift;
+      if (tap_eligible(frame))
+      {
+        lift = m_max_fingers == 1 ? Event::Tap : Event::MultiTap;
+      }
+      apply(lift, frame, outputs, count);
+    }
+
+    if (frame.button && !m_pressed)
+    {
+      apply(Event::Press, frame, outputs, count);
+    }
+
+    if (frame.palm)
+    {
+      apply(Event::Palm, frame, outputs, count);
+    }
+
+    if (frame.fingers > 0 && m_movement >= m_config.tap_movement)
+    {
+      apply(frame.fingers >= 2 ? Event::MultiMove : Event::Move, frame, outputs, count);
+    }
+
+    if (frame.fingers > 0 && frame.tick - m_tap_start_tick > m_config.tap_time)
+    {
+      apply(Event::TapTimeout, frame, outputs, count);
+    }
+
+    if (still(frame))
+    {
+      apply(Event::Still, frame, outputs, count);
+    }
+
+    m_fingers = frame.fingers;
+    m_pressed = frame.button;
+    return count;
+  }
+
+} // namespace gesture
@@ -0,0 +1,149 @@
+// gesture.h
+#ifndef GESTURE_H
+#define GESTURE_H
+
+#include <cstdint>
+
+// Tap, tap-and-drag and scroll recognition. The engine knows nothing about
+// PS/2 or BLE: it consumes one frame per primary packet and produces button
+// events, so that it can be driven from recorded frames on the host.
+namespace gesture
+{
+
+  enum class State : uint8_t
+  {
+    Idle,      // No finger on the pad.
+    Touch,     // Fingers down, could still be a tap.
+    Track,     // Fingers down and moving the cursor, not a tap anymore.
+    Scroll,    // Two or more fingers down and moving.
+    DragArmed, // A 1-finger tap just happened. Touching again soon drags.
+    DragTouch, // Finger down after a tap. Moving drags, lifting taps again.
+    Drag,      // Left button held while the finger moves.
+    Count
+  };
+
+  enum class Event : uint8_t
+  {
+    DragTimeout, // The drag window after a tap has passed.
+    Touch,       // Fingers went down on an empty pad.
+    Tap,         // All fingers lifted, and it was a 1-finger tap.
+    MultiTap,    // All fingers lifted, and it was a 2- or 3-finger tap.
+    Lift,        // All fingers lifted, and it was not a tap.
+    Press,       // The clickpad has been pressed.
+    Palm,        // A contact has been classified as a palm.
+    Move,        // One finger moved further than a tap allows.
+    MultiMove,   // Two or more fingers moved further than a tap allows.
+    TapTimeout,  // Fingers stayed down longer than a tap.
+    Still,       // Fingers are still and light enough to click speculatively.
+    Count
+  };
+
+  enum class Action : uint8_t
+  {
+    None,
+    StartTap,   // Start measuring a new tap.
+    Click,      // Click the button of the tap.
+    ButtonDown, // Hold the left button.
+    ButtonUp,   // Release the left button.
+    Speculate,  // Press the button of the tap right away, before the lift.
+  };
+
+  // What the engine needs to know about one primary packet.
+  struct Frame
+  {
+    unsigned long tick;
+    uint8_t fingers;
+    uint16_t movement; // |dx| + |dy| of the primary finger, in touchpad units
+    int16_t z;
+    bool button; // clickpad button
+    bool palm;   // any contact is a palm
+  };
+
+  enum class OutputType : uint8_t
+  {
+    Click,
+    ButtonDown,
+    ButtonUp,
+    // Speculative presses bypass the report delay. Every SpeculativeDown is
+    // followed by exactly one SpeculativeUp, on lift when it was a tap, or
+    // one SpeculativeCancel, as soon as the touch turns out to be something
+    // else. Both release the button. Or by one SpeculativeHold, when a drag
+    // starts with the left button already down: the drag holds it from then
+    // on, and releases it with its ButtonUp.
+    SpeculativeDown,
+    SpeculativeUp,
+    SpeculativeCancel,
+    SpeculativeHold,
+  };
+
+  struct Output
+  {
+    OutputType type;
+    uint8_t buttons; // 1 = left, 2 = right, 3 = middle, as in a tap report
+  };
+
+  struct Config
+  {
+    unsigned long tap_time;          // longest tap, in ticks
+    uint16_t tap_movement;           // most a tap may move, in touchpad units
+    int16_t tap_z;                   // heaviest a tap may be
+    unsigned long drag_window;       // how soon after a tap a drag may start, in ticks
+    bool speculative;                // press on touch instead of clicking on lift
+    unsigned long speculative_delay; // how long a touch stays still before the press
+  };
+
+  struct Transition
+  {
+    State from;
+    Event event;
+    State to;
+    Action action;
+  };
+
+  typedef void (*TraceFunction)(State from, Event event, State to);
+
+  const char *state_name(State state);
+  const char *event_name(Event event);
+
+  class Engine
+  {
+  public:
+    static const int max_outputs = 4;
+
+    explicit Engine(const Config &config);
+
+    // Feeds a frame and returns the number of outputs written.
+    int consume(const Frame &frame, Output outputs[max_outputs]);
+    void reset();
+
+    State state() const { return m_state; }
+    bool dragging() const { return m_state == State::Drag; }
+    // Buttons held by a gesture, as a HID button mask.
+    uint8_t held_buttons() const { return dragging() ? 0x01 : 0; }
+
+    void set_config(const Config &config) { m_config = config; }
+    // Called on every transition, or never if nullptr.
+    void set_trace(TraceFunction trace) { m_trace = trace; }
+
+  private:
+    Config m_config;
+    TraceFunction m_trace;
+    State m_state;
+    uint8_t m_fingers;
+    unsigned long m_tap_start_tick;
+    unsigned long m_tap_tick;
+    uint16_t m_movement;
+    int16_t m_max_z;
+    uint8_t m_max_fingers;
+    bool m_pressed;
+    uint8_t m_speculative;
+
+    bool tap_eligible(const Frame &frame) const;
+    bool still(const Frame &frame) const;
+    void settle_speculation(Output outputs[], int &count);
+    bool apply(Event event, const Frame &frame, Output outputs[], int &count);
+  };
+
+} // namespace gesture
+
+#endif // GESTURE_H
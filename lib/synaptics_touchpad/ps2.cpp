@@ -20,269 +20,56 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
-#include <Arduino.h>
 #include "ps2.h"
 
 namespace ps2
 {
-  // Sample code for interacting with a PS2 mouse from an ESP32.
-  // Writing is synchronous. Async write is hard for the client to handle.
+  // The protocol side of the bus: commands and their answers, whatever the
+  // transport. The transport on the pins is in ps2_pins.cpp.
   namespace
   { // anonymous namespace to hide code from the client.
 
-    int clock_pin_;
-    int data_pin_;
-    void (*byte_received_)(uint8_t);
-
-    void pull_low(uint8_t pin)
-    {
-      pinMode(pin, OUTPUT);
-      digitalWrite(pin, LOW);
-    }
-
-    void pull_high(uint8_t pin) { pinMode(pin, INPUT_PULLUP); }
-
-    uint8_t read_bit()
-    {
-      pinMode(data_pin_, INPUT);
-      return digitalRead(data_pin_);
-    }
-
-    void write_bit(uint8_t data)
-    {
-      pinMode(data_pin_, OUTPUT);
-      digitalWrite(data_pin_, data);
-    }
-
-    void wait_clock(uint8_t value)
-    {
-      if (value == LOW)
-      {
-        pinMode(clock_pin_, INPUT_PULLUP);
-      }
-      else
-      {
-        pinMode(clock_pin_, INPUT);
-      }
-
-      unsigned long millis_start = millis();
-      while (digitalRead(clock_pin_) != value)
-      {
-        if (millis() - millis_start > 25)
-        {
-          Serial.println("wait_clock timed out.");
-          return;
-        }
-      }
-    }
-
-    volatile int receive_index = 0;
-    volatile uint8_t receive_buffer = 0;
-    volatile uint8_t parity = 0;
-
-    void disable_interrupt()
-    {
-      noInterrupts(); // Disable interrupts on ESP32
-      receive_index = 0;
-      receive_buffer = 0;
-      parity = 0;
-    }
-
-    void enable_interrupt() { interrupts(); } // Enable interrupts on ESP32
-
-    void bit_received()
-    {
-      int clock = digitalRead(clock_pin_);
-      if (clock != LOW)
-      {
-        return;
-      }
-
-      int bit = read_bit();
-      if (receive_index == 0)
-      {
-        // Start bit
-        if (bit != LOW)
-        {
-          Serial.println("Start bit error. 1");
-        }
-      }
-      else if (receive_index >= 1 && receive_index <= 8)
-      {
-        // Payload bit
-        receive_buffer |= bit << (receive_index - 1);
-        parity ^= bit;
-      }
-      else if (receive_index == 9)
-      {
-        // Parity bit
-        parity ^= bit;
-        if (parity != 1)
-        {
-          Serial.println("Parity bit error. 1");
-        }
-      }
-      else if (receive_index == 10)
-      {
-        // Stop bit
-        if (bit != HIGH)
-        {
-          Serial.println("Stop bit error. 1");
-        }
-        byte_received_(receive_buffer);
-        receive_buffer = 0;
-        receive_index = 0;
-        parity = 0;
-        return;
-      }
-
-      receive_index++;
-    }
-
-    // Reads a byte synchronously. This should only be called from write_byte() to
-    // read the response and shouldn't be called by the client.
-    uint8_t read_byte()
-    {
-      // Start bit
-      wait_clock(LOW);
-      uint8_t start_bit = read_bit();
-      if (start_bit != LOW)
-      {
-        Serial.println("Start bit error. 2");
-      }
-      wait_clock(HIGH);
-
-      uint8_t data = 00;
-      uint8_t parity = 0;
-      for (int i = 0; i < 8; i++)
-      {
-        wait_clock(LOW);
-        uint8_t bit = read_bit();
-        wait_clock(HIGH);
-
-        data |= bit << i;
-        parity ^= bit;
-      }
-
-      wait_clock(LOW);
-      parity ^= read_bit();
-      wait_clock(HIGH);
-      if (parity != 1)
-      {
-        Serial.println("Parity error. 2");
-      }
-
-      wait_clock(LOW);
-      uint8_t stop = read_bit();
-      if (stop != 1)
-      {
-        Serial.println("Stop bit error. 2");
-      }
-      pull_low(clock_pin_);
-      delayMicroseconds(50);
-      pull_high(clock_pin_);
-
-      return data;
-    }
+    Transport *transport_ = nullptr;
   } // namespace
 
-  bool write_byte(uint8_t data)
-  {
-    // Bring CLK low for 100 us.
-    pull_low(clock_pin_);
-    delayMicroseconds(100);
-    // Bring DATA low.
-    pull_low(data_pin_);
-    // Release CLK
-    pull_high(clock_pin_);
-    // Now we are in the request-to-send state.
-
-    uint8_t const stop = 1;
-    uint8_t parity = 1;
-
-    // bits 0 - 7: payload
-    for (int i = 0; i < 8; i++)
-    {
-      // Get the LSB
-      uint8_t bit = data & 0x01;
-      // Update parity
-      parity ^= bit;
-      // Shift data for next iteration
-      data >>= 1;
-
-      // Device samples when CLK is low.
-      wait_clock(LOW);
-      write_bit(bit);
-      wait_clock(HIGH);
-    }
-
-    // bit 8: parity
-    wait_clock(LOW);
-    write_bit(parity);
-    wait_clock(HIGH);
-
-    // bit 9: stop
-    wait_clock(LOW);
-    write_bit(stop);
-    wait_clock(HIGH);
-
-    // bit 10: line control
-    wait_clock(LOW);
-    uint8_t line_control = read_bit();
-    wait_clock(HIGH);
-    if (line_control != LOW)
-    {
-      Serial.println("Line control error.");
-    }
+  bool write_byte(uint8_t data) { return transport_->write_byte(data); }
 
-    uint8_t ack = read_byte();
-    if (ack != 0xFA)
-    {
-      Serial.println("Error: did not receive ACK");
-      // 输出实际收到的数据
-      Serial.printf("Received: 0x%02X\n", ack);
-      return false;
-    }
-    return true;
-  }
+  uint8_t read_byte(uint32_t timeout_ms) { return transport_->read_byte(timeout_ms); }
 
-  void begin(uint8_t clock_pin, uint8_t data_pin,
-             void (*byte_received)(uint8_t))
+  void begin(Transport &transport, void (*byte_received)(uint8_t))
   {
-    clock_pin_ = clock_pin;
-    data_pin_ = data_pin;
-    byte_received_ = byte_received;
-
-    pull_high(clock_pin);
-    pull_high(data_pin);
-
-    attachInterrupt(digitalPinToInterrupt(clock_pin_), bit_received, FALLING);
+    transport_ = &transport;
+    transport.begin(byte_received);
   }
 
+  Transport *transport() { return transport_; }
+
   bool ps2_command(uint16_t command, uint8_t *args, uint8_t *result)
   {
-    disable_interrupt();
+    transport_->pause();
 
     unsigned int send = (command >> 12) & 0x0F;
     unsigned int receive = (command >> 8) & 0x0F;
-    write_byte(command & 0xFF);
+    bool acked = transport_->write_byte(command & 0xFF);
 
-    for (int i = 0; i < send; i++)
+    for (int i = 0; i < send && acked; i++)
     {
-      write_byte(args[i]);
+      acked = transport_->write_byte(args[i]);
     }
 
+    // The reset answer only comes after the self test.
+    uint32_t timeout_ms = command == PSMOUSE_CMD_RESET_BAT ? reset_timeout_ms : response_timeout_ms;
     for (int i = 0; i < receive; i++)
     {
-      uint8_t response = read_byte();
+      uint8_t response = acked ? transport_->read_byte(timeout_ms) : 0;
       if (result != nullptr)
       {
         result[i] = response;
       }
     }
 
-    enable_interrupt();
-    return true;
+    transport_->resume();
+    return acked;
   }
 
   void reset() { ps2_command(PSMOUSE_CMD_RESET_BAT, nullptr, nullptr); }
@@ -291,4 +78,21 @@ namespace ps2
 
   void disable() { ps2_command(PSMOUSE_CMD_DISABLE, nullptr, nullptr); }
 
+  uint8_t device_id()
+  {
+    uint8_t id = 0;
+    ps2_command(PSMOUSE_CMD_GETID, nullptr, &id);
+    return id;
+  }
+
+  bool enable_intellimouse()
+  {
+    const uint8_t rates[] = {200, 100, 80};
+    for (uint8_t rate : rates)
+    {
+      ps2_command(PSMOUSE_CMD_SETRATE, &rate, nullptr);
+    }
+    return device_id() == PS2_DEVICE_ID_INTELLIMOUSE;
+  }
+
 }; // namespace ps2
@@ -1,7 +1,15 @@
 #ifndef PS2_H
 #define PS2_H
 
-#include <Arduino.h>
+#include <cstdint>
+
+// Code that runs in an interrupt must sit in IRAM on the chip. Elsewhere, e.g.
+// in the native tests, it is ordinary code.
+#ifdef ESP_PLATFORM
+#include <esp_attr.h>
+#else
+#define IRAM_ATTR
+#endif
 
 namespace ps2
 {
@@ -12,13 +20,82 @@ namespace ps2
 #define PSMOUSE_CMD_RESET_BAT 0x02ff
 #define PSMOUSE_CMD_SETRES 0x10e8
 #define PSMOUSE_CMD_GETINFO 0x03e9
+#define PSMOUSE_CMD_GETID 0x01f2
+
+    // How long a command response may take, and the reset one, which waits
+    // for the self test.
+    const uint32_t response_timeout_ms = 25;
+    const uint32_t reset_timeout_ms = 750;
+
+    // The device at the other end of the bus. Commands and the packet stream
+    // go through it, so something other than the clock and data pins can
+    // stand in for the touchpad, e.g. a SimulatedSynaptics.
+    class Transport
+    {
+    public:
+        virtual ~Transport() {}
+        // Starts handing the bytes streamed by the device to byte_received.
+        // Without byte_received they are kept for read_byte() instead.
+        virtual void begin(void (*byte_received)(uint8_t)) = 0;
+        // Sends a byte and returns whether the device acknowledged it.
+        virtual bool write_byte(uint8_t data) = 0;
+        // Reads the next byte from the device, or returns 0 after timeout_ms.
+        virtual uint8_t read_byte(uint32_t timeout_ms) = 0;
+        // Holds the packet stream back while a command is in progress.
+        virtual void pause() = 0;
+        virtual void resume() = 0;
+    };
+
+    // Line errors seen on the pins since start-up.
+    struct Stats
+    {
+        uint32_t parity_errors;  // bytes dropped on a bad parity bit
+        uint32_t framing_errors; // bytes dropped on a bad start or stop bit
+        uint32_t timeouts;       // bytes cut short, or answers that never came
+        uint32_t resends;        // bytes sent again because the device asked
+        uint32_t nacks;          // bytes the device refused
+        uint32_t overruns;       // bytes lost because nobody read them
+    };
 
+    // Everything below goes through the transport given to begin(). Each
+    // protocol (the Synaptics one in synaptics.h, plain and IntelliMouse
+    // mice in the bundled handlers) is built on these, so the bus is only
+    // driven in one place.
     bool write_byte(uint8_t data);
+    uint8_t read_byte(uint32_t timeout_ms = response_timeout_ms);
+    // The clock and data pins are only there on the chip, see ps2_pins.cpp.
     void begin(uint8_t clock_pin, uint8_t data_pin, void (*byte_received)(uint8_t));
+    void begin(Transport &transport, void (*byte_received)(uint8_t));
+    Transport *transport();
     bool ps2_command(uint16_t command, uint8_t *args, uint8_t *result);
     void reset();
     void enable();
     void disable();
+    const Stats &stats();
+
+    // Plain PS/2 mice, which answer PSMOUSE_CMD_GETID with their device ID.
+    // Reference: the IntelliMouse extensions to the PS/2 mouse protocol.
+#define PS2_DEVICE_ID_MOUSE 0x00
+#define PS2_DEVICE_ID_INTELLIMOUSE 0x03
+
+    uint8_t device_id();
+    // Sends the magic sample rate sequence 200, 100, 80 that turns a wheel
+    // mouse into an IntelliMouse, and returns whether it did. The packets
+    // are 4 bytes long from then on.
+    bool enable_intellimouse();
+
+    // Movement in a mouse packet: X and Y are 9 bit numbers whose sign is in
+    // byte 0, the wheel a 4 bit one whose upper bits may carry more buttons.
+    inline int16_t movement(uint8_t data, bool negative) { return negative ? data | -256 : data; }
+    inline int8_t wheel_movement(uint8_t data) { return (int8_t)(data << 4) >> 4; }
+
+    // Makes the next clock edge from the device wake the chip up from light
+    // sleep. on_wakeup is called from the esp_timer task when that happens,
+    // before the device may send the packet again. Does nothing unless the
+    // device is on the pins.
+    void arm_wakeup(void (*on_wakeup)());
+    extern volatile unsigned long wakeup_micros;
+    extern volatile uint32_t wakeups;
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,431 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2024 Deling Ren
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// The PS/2 bus on two GPIO pins, driven by the clock interrupt. Only the
+// chip has pins, so the native build leaves them out.
+#include "ps2.h"
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+#include <driver/gpio.h>
+#include <esp_timer.h>
+#include <hal/gpio_ll.h>
+
+namespace ps2
+{
+  // Both directions are driven by the clock interrupt. Received bytes go to
+  // the client, or to a small queue while a command waits for its answer.
+  // A byte to send is set up by the caller and then clocked out bit by bit by
+  // the same interrupt, so the caller only waits for it to finish.
+  namespace
+  { // anonymous namespace to hide code from the client.
+
+    int clock_pin_;
+    int data_pin_;
+    void (*byte_received_)(uint8_t);
+    Stats stats_;
+
+    // Both lines are open drain with a pull-up: writing LOW pulls the line
+    // down, writing HIGH lets it go, and the level can be read either way.
+    // Nothing in the interrupt has to change the pin mode.
+    const uint8_t open_drain = OUTPUT_OPEN_DRAIN | INPUT_PULLUP;
+
+    // A bit lasts 60 to 100 us. A longer gap means the rest of the byte was
+    // lost, and the next edge is the start of a new one.
+    const unsigned long bit_timeout_us = 500;
+    // The device has 15 ms to start clocking a byte in, and 2 ms to finish.
+    const unsigned long send_timeout_us = 17000;
+    const int send_attempts = 3;
+
+    void IRAM_ATTR pull_low(uint8_t pin) { digitalWrite(pin, LOW); }
+
+    void IRAM_ATTR pull_high(uint8_t pin) { digitalWrite(pin, HIGH); }
+
+    int IRAM_ATTR read_bit() { return digitalRead(data_pin_); }
+
+    volatile int receive_index = 0;
+    volatile uint8_t receive_buffer = 0;
+    volatile uint8_t parity = 0;
+    volatile unsigned long last_bit_micros = 0;
+
+    volatile bool sending = false;
+    volatile int send_index = 0;
+    volatile uint16_t send_frame_bits = 0;
+    volatile bool line_control_ok = false;
+
+    // Command responses, and the whole stream when there is no client.
+    const uint8_t response_size = 16;
+    volatile uint8_t responses[response_size];
+    volatile uint8_t response_front = 0;
+    volatile uint8_t response_back = 0;
+    volatile bool command_active = false;
+
+    void IRAM_ATTR reset_receive()
+    {
+      receive_index = 0;
+      receive_buffer = 0;
+      parity = 0;
+    }
+
+    void flush_responses() { response_front = response_back; }
+
+    void IRAM_ATTR deliver(uint8_t data)
+    {
+      if (!command_active && byte_received_ != nullptr)
+      {
+        byte_received_(data);
+        return;
+      }
+      uint8_t next = (response_back + 1) % response_size;
+      if (next == response_front)
+      {
+        stats_.overruns++;
+        return;
+      }
+      responses[response_back] = data;
+      response_back = next;
+    }
+
+    // Holding the clock low for 100 us inhibits the bus: the device aborts
+    // what it was sending and waits. Both sending a byte and waking up go
+    // through here. While it lasts, the edges of the clock are ours and not
+    // the device's, and the ISR ignores them.
+    volatile bool inhibited = false;
+    const uint32_t inhibit_us = 100;
+    // Ends an inhibit started by the ISR, which can't wait it out itself.
+    esp_timer_handle_t inhibit_timer = nullptr;
+
+    void IRAM_ATTR inhibit()
+    {
+      inhibited = true;
+      pull_low(clock_pin_);
+    }
+
+    void IRAM_ATTR release_inhibit()
+    {
+      reset_receive();
+      inhibited = false;
+      pull_high(clock_pin_);
+    }
+
+    volatile bool wakeup_armed = false;
+    void (*on_wakeup_)();
+
+    // The chip has just woken up on the first clock edge of a packet, too late
+    // to catch its first bits. Inhibiting the bus before the 11th clock makes
+    // the device abort and send the whole packet again once it is released,
+    // which inhibit_timer does. The gpio driver isn't in IRAM, so the pin goes
+    // back to an edge interrupt through the HAL.
+    void IRAM_ATTR wake_up()
+    {
+      wakeup_armed = false;
+      gpio_ll_wakeup_disable(&GPIO, clock_pin_);
+      gpio_ll_set_intr_type(&GPIO, clock_pin_, GPIO_INTR_NEGEDGE);
+      inhibit();
+      esp_timer_start_once(inhibit_timer, inhibit_us);
+
+      wakeup_micros = micros();
+      wakeups++;
+    }
+
+    // Runs in the esp_timer task once the device has seen the inhibit.
+    // on_wakeup_ gets to keep the chip awake before the packet comes again.
+    void wakeup_inhibit_done(void *)
+    {
+      if (on_wakeup_ != nullptr)
+      {
+        on_wakeup_();
+      }
+      release_inhibit();
+    }
+
+    // Host to device: the device reads each bit while the clock is high, so
+    // the next one is put on the line at every falling edge. The 11th edge
+    // comes with the device pulling data low to acknowledge the frame.
+    void IRAM_ATTR send_bit()
+    {
+      if (send_index < 10)
+      {
+        digitalWrite(data_pin_, (send_frame_bits >> send_index) & 1);
+        send_index++;
+        return;
+      }
+      line_control_ok = read_bit() == LOW;
+      sending = false;
+    }
+
+    // Device to host: start bit, 8 data bits, odd parity and stop bit, each
+    // read at a falling edge.
+    void IRAM_ATTR receive_bit()
+    {
+      unsigned long now = micros();
+      if (receive_index != 0 && now - last_bit_micros > bit_timeout_us)
+      {
+        stats_.timeouts++;
+        reset_receive();
+      }
+      last_bit_micros = now;
+
+      int bit = read_bit();
+      if (receive_index == 0)
+      {
+        // Start bit. Without it this edge can't be the start of a byte, so
+        // wait for the next one.
+        if (bit != LOW)
+        {
+          stats_.framing_errors++;
+          return;
+        }
+      }
+      else if (receive_index >= 1 && receive_index <= 8)
+      {
+        // Payload bit
+        receive_buffer |= bit << (receive_index - 1);
+        parity ^= bit;
+      }
+      else if (receive_index == 9)
+      {
+        // Parity bit
+        parity ^= bit;
+      }
+      else if (receive_index == 10)
+      {
+        // Stop bit
+        if (parity != 1)
+        {
+          stats_.parity_errors++;
+        }
+        else if (bit != HIGH)
+        {
+          stats_.framing_errors++;
+        }
+        else
+        {
+          deliver(receive_buffer);
+        }
+        reset_receive();
+        return;
+      }
+
+      receive_index++;
+    }
+
+    void IRAM_ATTR clock_falling()
+    {
+      if (wakeup_armed)
+      {
+        wake_up();
+        return;
+      }
+      if (inhibited)
+      {
+        return;
+      }
+
+      if (digitalRead(clock_pin_) != LOW)
+      {
+        return;
+      }
+
+      if (sending)
+      {
+        send_bit();
+      }
+      else
+      {
+        receive_bit();
+      }
+    }
+
+    // Waits for the next byte received while a command is active.
+    uint8_t pin_read_byte(uint32_t timeout_ms)
+    {
+      unsigned long start = millis();
+      while (response_front == response_back)
+      {
+        if (millis() - start > timeout_ms)
+        {
+          stats_.timeouts++;
+          return 0;
+        }
+      }
+      uint8_t data = responses[response_front];
+      response_front = (response_front + 1) % response_size;
+      return data;
+    }
+
+    // Clocks one frame out to the device and returns whether it was taken.
+    bool send_frame(uint8_t data)
+    {
+      uint8_t odd = 1;
+      for (uint8_t bits = data; bits != 0; bits >>= 1)
+      {
+        odd ^= bits & 1;
+      }
+      send_index = 0;
+      send_frame_bits = data | odd << 8 | 1 << 9;
+      line_control_ok = false;
+
+      // Inhibit the bus for 100 us, which also aborts anything the device was
+      // sending, then request to send by holding data low and releasing the
+      // clock. The ISR ignores the edges of the inhibit, so interrupts stay
+      // on, and a longer inhibit because of them does no harm.
+      inhibit();
+      delayMicroseconds(inhibit_us);
+      pull_low(data_pin_);
+      sending = true;
+      release_inhibit();
+
+      unsigned long start = micros();
+      while (sending)
+      {
+        if (micros() - start > send_timeout_us)
+        {
+          sending = false;
+          pull_high(data_pin_);
+          stats_.timeouts++;
+          return false;
+        }
+      }
+      if (!line_control_ok)
+      {
+        stats_.framing_errors++;
+      }
+      return true;
+    }
+
+    bool pin_write_byte(uint8_t data)
+    {
+      bool was_active = command_active;
+      command_active = true;
+
+      uint8_t ack = 0;
+      for (int attempt = 0; attempt < send_attempts; attempt++)
+      {
+        flush_responses();
+        if (!send_frame(data))
+        {
+          continue;
+        }
+        ack = pin_read_byte(response_timeout_ms);
+        if (ack != 0xFE)
+        {
+          break;
+        }
+        // Resend: the device didn't get the byte right.
+        stats_.resends++;
+      }
+
+      command_active = was_active;
+      if (ack != 0xFA)
+      {
+        stats_.nacks++;
+        Serial.printf("Error: did not receive ACK for 0x%02X, received 0x%02X\n", data, ack);
+        return false;
+      }
+      return true;
+    }
+
+    // The touchpad on the clock and data pins.
+    class PinTransport : public Transport
+    {
+    public:
+      void begin(void (*byte_received)(uint8_t))
+      {
+        byte_received_ = byte_received;
+
+        pinMode(clock_pin_, open_drain);
+        pinMode(data_pin_, open_drain);
+        pull_high(clock_pin_);
+        pull_high(data_pin_);
+
+        if (inhibit_timer == nullptr)
+        {
+          const esp_timer_create_args_t args = {.callback = wakeup_inhibit_done, .name = "ps2 wakeup"};
+          esp_timer_create(&args, &inhibit_timer);
+        }
+        attachInterrupt(digitalPinToInterrupt(clock_pin_), clock_falling, FALLING);
+      }
+
+      bool write_byte(uint8_t data) { return pin_write_byte(data); }
+      uint8_t read_byte(uint32_t timeout_ms) { return pin_read_byte(timeout_ms); }
+
+      // Bytes from now on are the answer to the command, not packets.
+      void pause()
+      {
+        command_active = true;
+        flush_responses();
+      }
+
+      void resume() { command_active = false; }
+    };
+
+    PinTransport pin_transport;
+  } // namespace
+
+  volatile unsigned long wakeup_micros = 0;
+  volatile uint32_t wakeups = 0;
+
+  void begin(uint8_t clock_pin, uint8_t data_pin,
+             void (*byte_received)(uint8_t))
+  {
+    clock_pin_ = clock_pin;
+    data_pin_ = data_pin;
+    begin(pin_transport, byte_received);
+  }
+
+  const Stats &stats() { return stats_; }
+
+  void arm_wakeup(void (*on_wakeup)())
+  {
+    if (transport() != &pin_transport)
+    {
+      return;
+    }
+    on_wakeup_ = on_wakeup;
+    // Light sleep can only be woken up by a level, not by an edge. This also
+    // turns the clock interrupt into a level one until wake_up() restores it.
+    wakeup_armed = true;
+    gpio_wakeup_enable((gpio_num_t)clock_pin_, GPIO_INTR_LOW_LEVEL);
+  }
+
+}; // namespace ps2
+
+#else
+
+namespace ps2
+{
+  // Without pins there is no line to go wrong, and nothing to wake up from.
+  volatile unsigned long wakeup_micros = 0;
+  volatile uint32_t wakeups = 0;
+
+  const Stats &stats()
+  {
+    static const Stats none = {};
+    return none;
+  }
+
+  void arm_wakeup(void (*on_wakeup)()) {}
+}; // namespace ps2
+
+#endif
@@ -0,0 +1,329 @@
+#include "simulated_synaptics.h"
+#include "synaptics.h"
+
+namespace ps2
+{
+  namespace
+  {
+    int16_t IRAM_ATTR interpolate(int16_t from, int16_t to, uint16_t frame, uint16_t frames)
+    {
+      return from + (int32_t)(to - from) * frame / frames;
+    }
+
+    SimulatedSynaptics::Contact IRAM_ATTR interpolate(const SimulatedSynaptics::Contact &from,
+                                                      const SimulatedSynaptics::Contact &to,
+                                                      uint16_t frame, uint16_t frames)
+    {
+      SimulatedSynaptics::Contact contact;
+      contact.x = interpolate(from.x, to.x, frame, frames);
+      contact.y = interpolate(from.y, to.y, frame, frames);
+      contact.z = interpolate(from.z, to.z, frame, frames);
+      contact.w = interpolate(from.w, to.w, frame, frames);
+      return contact;
+    }
+  } // namespace
+
+  SimulatedSynaptics::SimulatedSynaptics(const Step *script, size_t length, Device device)
+      : device_(device), script_(script), length_(length)
+  {
+  }
+
+  void SimulatedSynaptics::begin(void (*byte_received)(uint8_t))
+  {
+    byte_received_ = byte_received;
+  }
+
+  bool SimulatedSynaptics::write_byte(uint8_t data)
+  {
+    if (pending_command_ != 0)
+    {
+      uint8_t command = pending_command_;
+      pending_command_ = 0;
+      argument(command, data);
+    }
+    else
+    {
+      command(data);
+    }
+    return true;
+  }
+
+  uint8_t SimulatedSynaptics::read_byte(uint32_t)
+  {
+    if (response_index_ >= response_length_)
+    {
+      return 0;
+    }
+    return response_[response_index_++];
+  }
+
+  void SimulatedSynaptics::respond(uint8_t length, uint8_t byte0, uint8_t byte1, uint8_t byte2)
+  {
+    response_[0] = byte0;
+    response_[1] = byte1;
+    response_[2] = byte2;
+    response_length_ = length;
+    response_index_ = 0;
+  }
+
+  void SimulatedSynaptics::command(uint8_t data)
+  {
+    response_length_ = 0;
+    // Reference: 4.2. TouchPad special command sequences. Only the
+    // resolution arguments count towards a sequence, and a mouse knows none.
+    bool sequence = device_ == Synaptics && special_count_ == 4 && (data == 0xE9 || data == 0xF3);
+    if (data != 0xE8 && !sequence)
+    {
+      special_count_ = 0;
+    }
+
+    switch (data)
+    {
+    case 0xE8: // set resolution
+    case 0xF3: // set sample rate
+      pending_command_ = data;
+      break;
+    case 0xE9: // status request
+      if (sequence)
+      {
+        query(special_);
+        special_count_ = 0;
+      }
+      else
+      {
+        respond(3, streaming_ ? 0x20 : 0x00, 0x02, rate_);
+      }
+      break;
+    case 0xF2: // get device ID
+      respond(1, id_);
+      break;
+    case 0xF4:
+      streaming_ = true;
+      break;
+    case 0xF5:
+      streaming_ = false;
+      break;
+    case 0xFF: // reset and self test
+      streaming_ = false;
+      mode_ = 0;
+      advanced_gestures_ = false;
+      rate_ = 100;
+      id_ = 0;
+      respond(2, 0xAA, 0x00);
+      break;
+    default:
+      break;
+    }
+  }
+
+  void SimulatedSynaptics::argument(uint8_t command, uint8_t value)
+  {
+    if (command == 0xE8)
+    {
+      if (special_count_ == 4)
+      {
+        special_count_ = 0;
+      }
+      special_ = special_ << 2 | (value & 0x03);
+      special_count_++;
+      return;
+    }
+
+    // Reference: 4.3. Mode byte. Rate 0x14 after a sequence sets the mode
+    // byte, and 0xC8 after the sequence 0x03 enables advanced gestures.
+    if (special_count_ == 4 && value == 0x14)
+    {
+      mode_ = special_;
+    }
+    else if (special_count_ == 4 && value == 0xC8 && special_ == 0x03)
+    {
+      advanced_gestures_ = true;
+    }
+    else
+    {
+      rate_ = value;
+      rates_[0] = rates_[1];
+      rates_[1] = rates_[2];
+      rates_[2] = value;
+      if (device_ == IntelliMouse && rates_[0] == 200 && rates_[1] == 100 && rates_[2] == 80)
+      {
+        id_ = 3;
+      }
+    }
+    special_count_ = 0;
+  }
+
+  void SimulatedSynaptics::query(uint8_t request)
+  {
+    // Reference: 4.4. Information queries
+    switch (request)
+    {
+    case 0x00: // identify: version 8.1
+      respond(3, 0x01, 0x47, 0x18);
+      break;
+    case 0x02: // capabilities: extended, 7 extended queries, multi-finger, palm detection
+      respond(3, 0xF0, 0x47, 0x03);
+      break;
+    case 0x08: // resolution
+      respond(3, units_per_mm_x, 0x80, units_per_mm_y);
+      break;
+    case 0x0C: // 1-button clickpad with advanced gestures, min and max coordinates
+      respond(3, 0x1A, 0x20, 0x00);
+      break;
+    case 0x0D: // max coordinates, bits 1 to 4 of y in the upper half of byte 1
+      respond(3, max_x >> 5, (max_y << 3 & 0xF0) | (max_x >> 1 & 0x0F), max_y >> 5);
+      break;
+    case 0x0F: // min coordinates
+      respond(3, min_x >> 5, (min_y << 3 & 0xF0) | (min_x >> 1 & 0x0F), min_y >> 5);
+      break;
+    default:
+      respond(3, 0x00, 0x00, 0x00);
+      break;
+    }
+  }
+
+  void IRAM_ATTR SimulatedSynaptics::send(const uint8_t *packet, uint8_t length)
+  {
+    for (uint8_t i = 0; i < length; i++)
+    {
+      byte_received_(packet[i]);
+    }
+  }
+
+  void IRAM_ATTR SimulatedSynaptics::send_primary(const Contact &contact, uint8_t w, bool button)
+  {
+    // Reference: Section 3.2.1, Figure 3-4. A clickpad reports its button
+    // as the middle/up button.
+    uint8_t packet[6];
+    packet[0] = 0x80 | (w & 0x0C) << 2 | (w & 0x02) << 1;
+    packet[1] = (contact.y >> 4 & 0xF0) | (contact.x >> 8 & 0x0F);
+    packet[2] = contact.z;
+    packet[3] = 0xC0 | (contact.y >> 7 & 0x20) | (contact.x >> 8 & 0x10) | (w & 0x01) << 2 | button;
+    packet[4] = contact.x;
+    packet[5] = contact.y;
+    send(packet, sizeof(packet));
+  }
+
+  void IRAM_ATTR SimulatedSynaptics::send_extended(const Contact &contact)
+  {
+    // Reference: Section 3.2.9.2. Figure 3-14, packet code 1 with half the
+    // resolution of a primary packet.
+    uint8_t packet[6];
+    packet[0] = 0x80 | 0x04; // w = 2
+    packet[1] = contact.x >> 1;
+    packet[2] = contact.y >> 1;
+    packet[3] = 0xC0 | (contact.z >> 1 & 0x30);
+    packet[4] = (contact.y >> 5 & 0xF0) | (contact.x >> 9 & 0x0F);
+    packet[5] = 0x10 | (contact.z >> 1 & 0x0F);
+    send(packet, sizeof(packet));
+  }
+
+  void IRAM_ATTR SimulatedSynaptics::send_relative(const Contact &contact, bool button, int wheel)
+  {
+    // A plain PS/2 mouse packet, clamped like a real pad would be. The wheel
+    // byte is only there once the IntelliMouse sequence was seen.
+    int dx = last_.z == 0 || contact.z == 0 ? 0 : contact.x - last_.x;
+    int dy = last_.z == 0 || contact.z == 0 ? 0 : contact.y - last_.y;
+    dx = dx < -255 ? -255 : dx > 255 ? 255 : dx;
+    dy = dy < -255 ? -255 : dy > 255 ? 255 : dy;
+    uint8_t packet[4];
+    packet[0] = 0x08 | (dy < 0) << 5 | (dx < 0) << 4 | button;
+    packet[1] = dx;
+    packet[2] = dy;
+    packet[3] = (wheel < -8 ? -8 : wheel > 7 ? 7 : wheel) & 0x0F;
+    send(packet, id_ == 3 ? 4 : 3);
+  }
+
+  void IRAM_ATTR SimulatedSynaptics::frame()
+  {
+    bool high_rate = mode_ & SYNAPTICS_MODE_HIGH_RATE;
+    if ((ticks_++ & 1) && !high_rate)
+    {
+      return;
+    }
+    if (!streaming_ || paused_ || byte_received_ == nullptr || length_ == 0)
+    {
+      return;
+    }
+
+    const Step &step = script_[step_];
+    Contact contacts[2] = {};
+    for (int i = 0; i < step.fingers && i < 2; i++)
+    {
+      contacts[i] = interpolate(step.from[i], step.to[i], step_frame_, step.frames);
+    }
+    if (++step_frame_ >= step.frames)
+    {
+      step_frame_ = 0;
+      step_ = (step_ + 1) % length_;
+    }
+
+    if (device_ != Synaptics)
+    {
+      // Two fingers turn the wheel, a notch per millimetre. Moving them down
+      // is a positive step, like rolling the wheel towards the user.
+      int wheel = 0;
+      if (step.fingers >= 2 && last_.z != 0)
+      {
+        wheel_travel_ += last_.y - contacts[0].y;
+        wheel = wheel_travel_ / units_per_mm_y;
+        wheel_travel_ -= wheel * units_per_mm_y;
+      }
+      send_relative(step.fingers >= 2 ? last_ : contacts[0], step.button, wheel);
+    }
+    else if (!(mode_ & SYNAPTICS_MODE_ABSOLUTE))
+    {
+      send_relative(contacts[0], step.button, 0);
+    }
+    else if (!(mode_ & SYNAPTICS_MODE_W))
+    {
+      // Without W there is no finger count, only a plain finger width.
+      send_primary(contacts[0], 4, step.button);
+    }
+    else
+    {
+      // With more than one finger, extended packets with the second one
+      // alternate with the primary ones, a packet per frame, starting with
+      // an extended one (Section 3.2.9.2).
+      uint8_t w = step.fingers >= 3 ? 1 : step.fingers == 2 ? 0 : contacts[0].w;
+      if (step.fingers >= 2 && advanced_gestures_ && extended_turn_)
+      {
+        send_extended(contacts[1]);
+      }
+      else
+      {
+        send_primary(contacts[0], w, step.button);
+      }
+      extended_turn_ = step.fingers >= 2 && advanced_gestures_ ? !extended_turn_ : true;
+    }
+    last_ = contacts[0];
+  }
+
+#define CONTACT(x, y) {(x), (y), 60, 6}
+#define LIFTED {0, 0, 0, 0}
+  SimulatedSynaptics::Step demo_script[] = {
+      // Nothing on the pad for a second.
+      {80, 0, false, {LIFTED, LIFTED}, {LIFTED, LIFTED}},
+      // A square in the middle of the pad, two seconds a side.
+      {160, 1, false, {CONTACT(2500, 2500), LIFTED}, {CONTACT(4500, 2500), LIFTED}},
+      {160, 1, false, {CONTACT(4500, 2500), LIFTED}, {CONTACT(4500, 3500), LIFTED}},
+      {160, 1, false, {CONTACT(4500, 3500), LIFTED}, {CONTACT(2500, 3500), LIFTED}},
+      {160, 1, false, {CONTACT(2500, 3500), LIFTED}, {CONTACT(2500, 2500), LIFTED}},
+      {40, 0, false, {LIFTED, LIFTED}, {LIFTED, LIFTED}},
+      // A tap.
+      {8, 1, false, {CONTACT(3500, 3000), LIFTED}, {CONTACT(3500, 3000), LIFTED}},
+      {80, 0, false, {LIFTED, LIFTED}, {LIFTED, LIFTED}},
+      // A click in the lower-left button zone.
+      {10, 1, false, {CONTACT(2000, 1600), LIFTED}, {CONTACT(2000, 1600), LIFTED}},
+      {12, 1, true, {CONTACT(2000, 1600), LIFTED}, {CONTACT(2000, 1600), LIFTED}},
+      {10, 1, false, {CONTACT(2000, 1600), LIFTED}, {CONTACT(2000, 1600), LIFTED}},
+      {80, 0, false, {LIFTED, LIFTED}, {LIFTED, LIFTED}},
+      // Two fingers scrolling down.
+      {120, 2, false, {CONTACT(3300, 3800), CONTACT(3900, 3800)}, {CONTACT(3300, 2200), CONTACT(3900, 2200)}},
+      {80, 0, false, {LIFTED, LIFTED}, {LIFTED, LIFTED}},
+  };
+#undef CONTACT
+#undef LIFTED
+  const size_t demo_script_length = sizeof(demo_script) / sizeof(demo_script[0]);
+
+} // namespace ps2
@@ -0,0 +1,129 @@
+// simulated_synaptics.h
+#ifndef SIMULATED_SYNAPTICS_H
+#define SIMULATED_SYNAPTICS_H
+
+#include <cstddef>
+#include <cstdint>
+#include "ps2.h"
+
+namespace ps2
+{
+
+  // A Synaptics clickpad that exists only in software, for running
+  // synaptics::init() and the packet stream without a pad on the pins:
+  //
+  //   ps2::SimulatedSynaptics pad(script, script_length);
+  //   ps2::begin(pad, byte_received);
+  //
+  // It answers the identify (0x00), capabilities (0x02), resolution (0x08),
+  // clickpad (0x0C) and coordinate range (0x0D, 0x0F) queries like a single
+  // button clickpad, keeps the mode byte set through the special command
+  // sequence, and streams the fingers of a script once enabled. Whoever
+  // drives the simulation calls frame() 80 times a second; every other call
+  // is skipped at the low rate.
+  //
+  // It can also pretend to be a plain or wheel mouse instead, for trying the
+  // fallback of synaptics::init(). The mouse ignores the special command
+  // sequences and sends the first finger as relative movement, and two
+  // fingers as the wheel.
+  class SimulatedSynaptics : public Transport
+  {
+  public:
+    enum Device
+    {
+      Synaptics,
+      IntelliMouse,
+      Mouse,
+    };
+
+    struct Contact
+    {
+      int16_t x; // touchpad units, same edges as synaptics::min_x etc.
+      int16_t y;
+      uint8_t z;
+      uint8_t w; // finger width, 4 to 15
+    };
+
+    // The fingers move in a straight line from `from` to `to` over `frames`
+    // packets. Only the first two fingers have a position; a third one only
+    // shows up in the finger count.
+    struct Step
+    {
+      uint16_t frames;
+      uint8_t fingers;
+      bool button;
+      Contact from[2];
+      Contact to[2];
+    };
+
+    // The script is played in a loop. frame() may run in an ISR, so it has
+    // to be in RAM rather than flash.
+    SimulatedSynaptics(const Step *script, size_t length, Device device = Synaptics);
+
+    void begin(void (*byte_received)(uint8_t));
+    bool write_byte(uint8_t data);
+    uint8_t read_byte(uint32_t timeout_ms);
+    void pause() { paused_ = true; }
+    void resume() { paused_ = false; }
+
+    // Sends the packets of the next frame if streaming is enabled.
+    void frame();
+
+    uint8_t mode_byte() const { return mode_; }
+    bool streaming() const { return streaming_; }
+
+    // Identity of the simulated pad.
+    static const uint8_t units_per_mm_x = 40;
+    static const uint8_t units_per_mm_y = 54;
+    static const int16_t min_x = 1280;
+    static const int16_t max_x = 5632;
+    static const int16_t min_y = 1216;
+    static const int16_t max_y = 4608;
+
+  private:
+    void command(uint8_t data);
+    void argument(uint8_t command, uint8_t value);
+    void query(uint8_t request);
+    void respond(uint8_t length, uint8_t byte0, uint8_t byte1 = 0, uint8_t byte2 = 0);
+    void send(const uint8_t *packet, uint8_t length);
+    void send_primary(const Contact &contact, uint8_t w, bool button);
+    void send_extended(const Contact &contact);
+    void send_relative(const Contact &contact, bool button, int wheel);
+
+    Device device_;
+    const Step *script_;
+    size_t length_;
+    size_t step_ = 0;
+    uint16_t step_frame_ = 0;
+    uint32_t ticks_ = 0;
+    Contact last_ = {};
+    int wheel_travel_ = 0; // finger travel not turned into wheel notches yet
+    bool extended_turn_ = true; // with two fingers, whether the next packet is an extended one
+
+    void (*byte_received_)(uint8_t) = nullptr;
+    volatile bool paused_ = false;
+    volatile bool streaming_ = false;
+    uint8_t mode_ = 0;
+    bool advanced_gestures_ = false;
+    uint8_t rate_ = 100;
+    uint8_t rates_[3] = {}; // the last ones set, for the IntelliMouse magic sequence
+    uint8_t id_ = 0;
+
+    // Special command sequence: four resolution arguments, two bits each.
+    uint8_t special_ = 0;
+    uint8_t special_count_ = 0;
+    uint8_t pending_command_ = 0; // a command still waiting for its argument
+
+    uint8_t response_[3];
+    uint8_t response_length_ = 0;
+    uint8_t response_index_ = 0;
+  };
+
+  // Traces a square with one finger, taps, clicks, and scrolls with two
+  // fingers.
+  extern SimulatedSynaptics::Step demo_script[];
+  extern const size_t demo_script_length;
+
+} // namespace ps2
+
+#endif // SIMULATED_SYNAPTICS_H
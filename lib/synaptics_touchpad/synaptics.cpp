@@ -1,13 +1,33 @@
-#include <Arduino.h>
+#include <cstdio>
 #include "ps2.h" // 确认 ps2.h 文件已经适配 ESP32
 #include "synaptics.h"
 
+// The serial port on the chip, stdout in the native tests.
+#ifdef ARDUINO
+#include <Arduino.h>
+#define print_line(line) Serial.println(line)
+#else
+#define print_line(line) puts(line)
+#endif
+
 namespace synaptics
 {
 
-  int units_per_mm_x;
-  int units_per_mm_y;
+  // Typical resolution from the interfacing guide, kept if the pad gives
+  // no usable answer.
+  int units_per_mm_x = 85;
+  int units_per_mm_y = 94;
   uint8_t clickpad_type;
+  // Typical bezel limits from the interfacing guide, used until the pad
+  // tells us otherwise.
+  int min_x = 1472;
+  int max_x = 5472;
+  int min_y = 1408;
+  int max_y = 4448;
+  Protocol protocol = Protocol::Synaptics;
+  bool pass_through = false;
+  uint8_t mode_byte = SYNAPTICS_MODE_ABSOLUTE | SYNAPTICS_MODE_HIGH_RATE |
+                      SYNAPTICS_MODE_DISABLE_GESTURE | SYNAPTICS_MODE_W;
 
   void special_command(uint8_t command)
   {
@@ -27,24 +47,60 @@ namespace synaptics
     ps2::ps2_command(PSMOUSE_CMD_GETINFO, nullptr, result);
   }
 
+  Protocol detect()
+  {
+    // Reference: 4.4. Information queries. Byte 2 of the identify answer is
+    // 0x47 on every Synaptics pad; a plain mouse answers with its status.
+    uint8_t result[3];
+    char buffer[64];
+    synaptics::status_request(0x00, result);
+    if (result[1] == 0x47)
+    {
+      return Protocol::Synaptics;
+    }
+
+    uint8_t id = ps2::device_id();
+    if (id != PS2_DEVICE_ID_MOUSE)
+    {
+      sprintf(buffer, "  Unknown device ID 0x%02X, trying it as a mouse.", id);
+      print_line(buffer);
+    }
+    return ps2::enable_intellimouse() ? Protocol::IntelliMouse : Protocol::Mouse;
+  }
+
   void init()
   {
     uint8_t result[3];
     char buffer[256];
 
-    Serial.println("TouchPad info:");
+    // Found again below, if there still is a guest. A mouse found instead of
+    // the pad has none.
+    pass_through = false;
+    protocol = detect();
+    if (protocol != Protocol::Synaptics)
+    {
+      // Nothing to set up, the mouse streams its packets once enabled.
+      print_line(protocol == Protocol::IntelliMouse ? "Wheel mouse, not a TouchPad."
+                                                    : "Mouse, not a TouchPad.");
+      ps2::enable();
+      return;
+    }
+
+    print_line("TouchPad info:");
 
     synaptics::status_request(0x00, result);
     uint8_t infoMajor = result[2] & 0x0F;
     uint8_t infoMinor = result[0];
     sprintf(buffer, "  Version: %u.%u", infoMajor, infoMinor);
-    Serial.println(buffer);
+    print_line(buffer);
 
     synaptics::status_request(0x02, result);
     bool capExtended = result[0] & 0x80;
+    // The highest extended query the pad answers, 0 if none.
+    int nExtendedQueries = 0;
     if (capExtended)
     {
-      int nExtendedQueries = (result[0] >> 4) & 0x07;
+      nExtendedQueries = (result[0] >> 4) & 0x07;
       if (nExtendedQueries >= 1)
       {
         nExtendedQueries += 8;
@@ -53,21 +109,31 @@ namespace synaptics
       bool fourButtons = result[2] & 0x08;
       bool multiFinger = result[2] & 0x02;
       bool palmDetect = result[2] & 0x01;
+      pass_through = result[2] & 0x80;
 
       sprintf(buffer,
               "  Ext Queries: %d\n  Middle Button: %u\n  Four Buttons: %u\n"
-              "  Multi-Finger: %u\n  Palm Detection: %u",
+              "  Multi-Finger: %u\n  Palm Detection: %u\n  Pass-Through: %u",
               nExtendedQueries, middleButton, fourButtons, multiFinger,
-              palmDetect);
-      Serial.println(buffer);
+              palmDetect, pass_through);
+      print_line(buffer);
     }
 
     synaptics::status_request(0x08, result);
-    units_per_mm_x = result[0];
-    units_per_mm_y = result[2];
+    // Byte 2 bit 7 is always set in a valid answer. A garbled one would make
+    // every distance divide by zero.
+    if ((result[1] & 0x80) && result[0] != 0 && result[2] != 0)
+    {
+      units_per_mm_x = result[0];
+      units_per_mm_y = result[2];
+    }
+    else
+    {
+      print_line("  Bad resolution, using the typical one.");
+    }
     sprintf(buffer, "  X units per mm: %d\n  Y units per mm: %d", units_per_mm_x,
             units_per_mm_y);
-    Serial.println(buffer);
+    print_line(buffer);
 
     synaptics::status_request(0x0C, result);
     bool coveredPadGest = result[0] & 0x80;
@@ -79,8 +145,59 @@ namespace synaptics
     sprintf(buffer,
             "  Covered Pad Gesture: %u\n  ClickPad type: %s\n  Adv Gesture: %u",
             coveredPadGest, clickPadInfo[clickpad_type], advGest);
-    Serial.println(buffer);
+    print_line(buffer);
 
+    // Reference: 4.4. Information queries 0x0D and 0x0F. Both answer with
+    // the coordinate in units of 2, x in bytes 1 and 2, y in bytes 2 and 3.
+    bool maxDimensions = result[0] & 0x02;
+    bool minDimensions = result[1] & 0x20;
+    if (maxDimensions && nExtendedQueries >= 0x0D)
+    {
+      synaptics::status_request(0x0D, result);
+      int x = result[0] << 5 | (result[1] & 0x0F) << 1;
+      int y = result[2] << 5 | (result[1] & 0xF0) >> 3;
+      if (x > min_x && y > min_y)
+      {
+        max_x = x;
+        max_y = y;
+      }
+    }
+    if (minDimensions && nExtendedQueries >= 0x0F)
+    {
+      synaptics::status_request(0x0F, result);
+      int x = result[0] << 5 | (result[1] & 0x0F) << 1;
+      int y = result[2] << 5 | (result[1] & 0xF0) >> 3;
+      if (x < max_x && y < max_y)
+      {
+        min_x = x;
+        min_y = y;
+      }
+    }
+    sprintf(buffer, "  X range: %d to %d\n  Y range: %d to %d", min_x, max_x, min_y, max_y);
+    print_line(buffer);
+
+    set_mode(mode_byte);
+
+    // The guest only streams once enabled. Its packets are passed through in
+    // W mode, which mode_byte always has.
+    if (pass_through)
+    {
+      pass_through_command(PSMOUSE_CMD_ENABLE & 0xFF);
+    }
+  }
+
+  void pass_through_command(uint8_t command)
+  {
+    // Reference: pass-through commands. The byte for the guest is sent as a
+    // special command sequence, followed by set sample rate 0x28 instead of
+    // the status request.
+    uint8_t sample_rate = 0x28;
+    synaptics::special_command(command);
+    ps2::ps2_command(PSMOUSE_CMD_SETRATE, &sample_rate, nullptr);
+  }
+
+  void set_mode(uint8_t mode)
+  {
     // Reference: 4.3. Mode byte
     uint8_t sample_rate = 0x14;
 
@@ -88,10 +205,12 @@ namespace synaptics
 
     ps2::ps2_command(PSMOUSE_CMD_SETSCALE11, nullptr, nullptr);
     ps2::ps2_command(PSMOUSE_CMD_SETSCALE11, nullptr, nullptr);
-    synaptics::special_command(0xC5);
+    synaptics::special_command(mode);
     sample_rate = 0x14;
     ps2::ps2_command(PSMOUSE_CMD_SETRATE, &sample_rate, nullptr);
 
+    // Re-enable the advanced gesture mode after every mode change, just like
+    // the Linux driver does.
     ps2::ps2_command(PSMOUSE_CMD_SETSCALE11, nullptr, nullptr);
     ps2::ps2_command(PSMOUSE_CMD_SETSCALE11, nullptr, nullptr);
     synaptics::special_command(0x03);
@@ -99,6 +218,26 @@ namespace synaptics
     ps2::ps2_command(PSMOUSE_CMD_SETRATE, &sample_rate, nullptr);
 
     ps2::enable();
+    mode_byte = mode;
+  }
+
+  void set_high_rate(bool high_rate)
+  {
+    if (protocol != Protocol::Synaptics)
+    {
+      return;
+    }
+    uint8_t mode = high_rate ? mode_byte | SYNAPTICS_MODE_HIGH_RATE
+                             : mode_byte & ~SYNAPTICS_MODE_HIGH_RATE;
+    if (mode != mode_byte)
+    {
+      set_mode(mode);
+    }
+  }
+
+  bool high_rate()
+  {
+    return mode_byte & SYNAPTICS_MODE_HIGH_RATE;
   }
 
 } // namespace synaptics
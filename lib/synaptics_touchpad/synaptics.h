@@ -3,10 +3,18 @@
 #define SYNAPTICS_H
 
 #include "ps2.h"
+#include <atomic>
 #include <cstdint>
+#include <limits>
+#include <type_traits>
 
 namespace synaptics
 {
+// Reference: 4.3. Mode byte
+#define SYNAPTICS_MODE_ABSOLUTE 0x80
+#define SYNAPTICS_MODE_HIGH_RATE 0x40 // 80 packets per second, otherwise 40
+#define SYNAPTICS_MODE_DISABLE_GESTURE 0x04
+#define SYNAPTICS_MODE_W 0x01
 
   struct TouchpadState
   {
@@ -18,90 +26,251 @@ namespace synaptics
     bool middleButton;
   };
 
+  // What init() found on the bus, and so how its packets look.
+  enum class Protocol : uint8_t
+  {
+    Synaptics,    // 6 byte absolute packets, reference: 3.2.1
+    IntelliMouse, // 4 byte relative packets with a wheel
+    Mouse,        // 3 byte relative packets
+  };
+  extern Protocol protocol;
+
+  // Whether a guest device, e.g. a pointing stick, sits behind the pad. Its
+  // packets then come encapsulated in packets with w = 3.
+  extern bool pass_through;
+
   extern int units_per_mm_x;
   extern int units_per_mm_y;
   extern uint8_t clickpad_type;
+  // Edges of the sensing area in touchpad units. Y grows upwards, so min_y is
+  // the bottom edge where the clickpad buttons live.
+  extern int min_x;
+  extern int max_x;
+  extern int min_y;
+  extern int max_y;
 
-  void specialCommand(uint8_t command);
-  void statusRequest(uint8_t arg, uint8_t *result);
+  void special_command(uint8_t command);
+  void status_request(uint8_t arg, uint8_t *result);
+  Protocol detect();
   void init();
+  void set_mode(uint8_t mode);
+  void pass_through_command(uint8_t command);
+  void set_high_rate(bool high_rate);
+  // Whether the pad sends 80 packets per second rather than 40.
+  bool high_rate();
   bool readState(TouchpadState &state);
 
 } // namespace synaptics
 
+// A FIFO of up to N items, N a power of two. The indices run freely and are
+// masked on access, so there is no division anywhere. The items sit in at
+// most two contiguous segments of the storage, which lets whole runs of them
+// be edited in place.
 template <class T, int N>
 class RingBuffer
 {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "N must be a power of two");
+
 private:
+  static const unsigned mask = N - 1;
+
   T m_buffer[N];
-  int m_size;
-  int m_front;
-  int m_back;
+  unsigned m_front; // index of the oldest item, not masked
+  unsigned m_back;  // index of the next free slot, not masked
+  uint32_t m_overflows;
 
 public:
-  inline RingBuffer()
+  // A contiguous run of items, usable in a range-based for.
+  struct Span
   {
-    m_size = 0;
-    m_front = 0;
-    m_back = 0;
-  }
+    T *data;
+    int size;
+
+    T *begin() const { return data; }
+    T *end() const { return data + size; }
+  };
+
+  inline RingBuffer() : m_front(0), m_back(0), m_overflows(0) {}
 
-  bool empty() const { return m_size == 0; }
-  int size() const { return m_size; }
+  bool empty() const { return m_back == m_front; }
+  bool full() const { return m_back - m_front == N; }
+  int size() const { return m_back - m_front; }
+  // Number of items refused by push_back() because the buffer was full.
+  uint32_t overflows() const { return m_overflows; }
 
+  void clear() { m_front = m_back; }
+
+  // Removes the oldest item and returns it, or returns T() if there is none.
   T pop_front()
   {
-    T item = m_buffer[m_front];
-    m_front = (m_front + 1) % N;
-    if (m_size == 0)
+    if (empty())
     {
       return T();
     }
-    else
+    return m_buffer[m_front++ & mask];
+  }
+
+  bool try_pop(T &item)
+  {
+    if (empty())
     {
-      m_size--;
-      return item;
+      return false;
     }
+    item = m_buffer[m_front++ & mask];
+    return true;
   }
 
-  bool push_back(T item)
+  // The oldest and the newest item, or nullptr if there is none. They stay
+  // in place and can be changed.
+  T *peek() { return empty() ? nullptr : &m_buffer[m_front & mask]; }
+  T *peek_back() { return empty() ? nullptr : &m_buffer[(m_back - 1) & mask]; }
+
+  bool push_back(const T &item)
   {
-    if (m_size == N)
+    if (full())
     {
+      m_overflows++;
       return false;
     }
-
-    m_buffer[m_back] = item;
-    m_back = (m_back + 1) % N;
-    m_size++;
+    m_buffer[m_back++ & mask] = item;
     return true;
   }
 
-  T &operator[](int i)
+  // The i-th oldest item.
+  T &operator[](int i) { return m_buffer[(m_front + i) & mask]; }
+
+  // The items in order are segment(0) followed by segment(1). The second one
+  // is empty unless the items wrap around the end of the storage.
+  Span segment(int part)
   {
-    int index = (m_front + i) % N;
-    return m_buffer[index];
+    unsigned front = m_front & mask;
+    int first = N - front;
+    if (first > size())
+    {
+      first = size();
+    }
+    if (part == 0)
+    {
+      return Span{&m_buffer[front], first};
+    }
+    return Span{&m_buffer[0], size() - first};
   }
 };
 
+// A queue between exactly one producer and one consumer, which may run on
+// different cores. Neither side takes a lock: each one only writes its own
+// index, and publishes it after the slot it covers. Holds up to N - 1 items.
 template <class T, int N>
+class SpscQueue
+{
+private:
+  T m_buffer[N];
+  std::atomic<int> m_head; // next slot to read, written by the consumer
+  std::atomic<int> m_tail; // next slot to write, written by the producer
+
+public:
+  inline SpscQueue() : m_head(0), m_tail(0) {}
+
+  // Producer side. Returns false if the queue is full.
+  bool push(const T &item)
+  {
+    int tail = m_tail.load(std::memory_order_relaxed);
+    int next = (tail + 1) % N;
+    if (next == m_head.load(std::memory_order_acquire))
+    {
+      return false;
+    }
+    m_buffer[tail] = item;
+    m_tail.store(next, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Returns false if the queue is empty.
+  bool pop(T &item)
+  {
+    int head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire))
+    {
+      return false;
+    }
+    item = m_buffer[head];
+    m_head.store((head + 1) % N, std::memory_order_release);
+    return true;
+  }
+
+  // Either side, as a snapshot.
+  int size() const
+  {
+    int size = m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+    return size < 0 ? size + N : size;
+  }
+};
+
+// What SimpleAverage adds samples up in: floats in themselves, integers of
+// up to 16 bits in 32 bits, and wider integers in 64 bits.
+template <class T>
+struct average_sum
+{
+  typedef typename std::conditional<
+      std::is_floating_point<T>::value, T,
+      typename std::conditional<(sizeof(T) < sizeof(int32_t)), int32_t, int64_t>::type>::type type;
+};
+
+// How SimpleAverage starts out, before it has seen N samples.
+enum class AverageWarmUp
+{
+  // The average of the samples seen so far. Successive averages move at
+  // half the speed of a steady motion until the window is full.
+  Grow,
+  // The first sample fills the whole window, so the window is always full
+  // and successive averages ramp up smoothly to the speed of the motion.
+  Seed,
+};
+
+// Moving average of the last N samples. The average is kept up to date by
+// filter(), so reading it costs nothing. Until the window is full, it is the
+// average of the samples seen so far, or with AverageWarmUp::Seed the first
+// sample stands in for the ones missing. Once it is, the sum is divided by
+// the constant N, which is a shift when N is a power of two.
+template <class T, int N, AverageWarmUp W = AverageWarmUp::Grow>
 class SimpleAverage
 {
+public:
+  typedef typename average_sum<T>::type sum_type;
+
 private:
+  static_assert(N > 0, "N must be positive");
+  // The sum never holds more than N samples, all of which may be extreme.
+  static_assert(std::is_floating_point<T>::value ||
+                    ((double)N * std::numeric_limits<T>::max() <= (double)std::numeric_limits<sum_type>::max() &&
+                     (double)N * std::numeric_limits<T>::lowest() >= (double)std::numeric_limits<sum_type>::lowest()),
+                "the sum could overflow");
+
   T m_buffer[N];
+  sum_type m_sum;
+  T m_average;
   int m_count;
-  int m_sum;
   int m_index;
 
 public:
   inline SimpleAverage() { reset(); }
   T filter(T data)
   {
-    // add new entry to sum
-    m_sum += data;
+    if (W == AverageWarmUp::Seed && m_count == 0)
+    {
+      for (int i = 0; i < N; i++)
+      {
+        m_buffer[i] = data;
+      }
+      m_sum = (sum_type)data * N;
+      m_count = N;
+    }
     // if full buffer, then we are overwriting, so subtract old from sum
+    // before adding the new entry, which keeps the sum within N samples
     if (m_count == N)
       m_sum -= m_buffer[m_index];
+    // add new entry to sum
+    m_sum += data;
     // new entry into buffer
     m_buffer[m_index] = data;
     // move index to next position with wrap around
@@ -110,17 +279,21 @@ public:
     // keep count moving until buffer is full
     if (m_count < N)
       ++m_count;
-    // return average of current items
-    return m_sum / m_count;
+    // the compiler turns the constant division into a shift for a power of
+    // two, rounding towards zero like the division by the count does
+    m_average = m_count == N ? (T)(m_sum / N) : (T)(m_sum / m_count);
+    return m_average;
   }
   inline void reset()
   {
     m_count = 0;
     m_sum = 0;
+    m_average = 0;
     m_index = 0;
   }
+  // With AverageWarmUp::Seed this is N as soon as there is a sample.
   inline int count() const { return m_count; }
-  inline int sum() const { return m_sum; }
+  inline sum_type sum() const { return m_sum; }
   T oldest() const
   {
     // undefined if nothing in here, return zero
@@ -144,11 +317,41 @@ public:
       index = m_count - 1;
     return m_buffer[index];
   }
-  T average() const
+  // Zero if nothing in here.
+  T average() const { return m_average; }
+};
+
+// Mean and variance of a stream of samples, without keeping the samples
+// (Welford's algorithm).
+class RunningVariance
+{
+private:
+  unsigned long m_count;
+  float m_mean;
+  float m_m2;
+
+public:
+  inline RunningVariance() { reset(); }
+  void add(float data)
   {
-    if (m_count == 0)
+    m_count++;
+    float delta = data - m_mean;
+    m_mean += delta / m_count;
+    m_m2 += delta * (data - m_mean);
+  }
+  inline void reset()
+  {
+    m_count = 0;
+    m_mean = 0;
+    m_m2 = 0;
+  }
+  inline unsigned long count() const { return m_count; }
+  inline float mean() const { return m_mean; }
+  float variance() const
+  {
+    if (m_count < 2)
       return 0;
-    return m_sum / m_count;
+    return m_m2 / (m_count - 1);
   }
 };
 #endif // SYNAPTICS_H
\ No newline at end of file
@@ -0,0 +1,127 @@
+#include "trace.h"
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
+
+namespace trace
+{
+#ifdef ARDUINO
+  namespace
+  {
+    // 128 records are about a second and a half of reports.
+    const int ring_size = 128;
+    const int ring_mask = ring_size - 1;
+    static_assert((ring_size & ring_mask) == 0, "ring_size must be a power of two");
+
+    Record ring[ring_size];
+    uint32_t head = 0; // next record to print
+    uint32_t tail = 0; // next record to write
+    uint32_t dropped_ = 0;
+    uint32_t dropped_reported = 0;
+    portMUX_TYPE ring_mux = portMUX_INITIALIZER_UNLOCKED;
+
+    const uint32_t drain_stack_size = 2048;
+    StackType_t drain_stack[drain_stack_size];
+    StaticTask_t drain_task_buffer;
+    const TickType_t drain_period = pdMS_TO_TICKS(20);
+
+    bool pop(Record &item)
+    {
+      bool popped = false;
+      portENTER_CRITICAL(&ring_mux);
+      if (head != tail)
+      {
+        item = ring[head & ring_mask];
+        head++;
+        popped = true;
+      }
+      portEXIT_CRITICAL(&ring_mux);
+      return popped;
+    }
+
+    void print(const Record &item)
+    {
+      char line[2 + sizeof(Record) * 2 + 1];
+      static const char digits[] = "0123456789abcdef";
+      const uint8_t *bytes = (const uint8_t *)&item;
+      size_t length = sizeof(Record) - sizeof(int32_t) * (max_args - item.count);
+      char *out = line;
+      *out++ = '#';
+      for (size_t i = 0; i < length; i++)
+      {
+        *out++ = digits[bytes[i] >> 4];
+        *out++ = digits[bytes[i] & 0x0F];
+      }
+      *out = '\0';
+      Serial.println(line);
+    }
+
+    void drain_task(void *pvParameters)
+    {
+      Record item;
+      while (1)
+      {
+        while (pop(item))
+        {
+          print(item);
+        }
+        uint32_t lost = dropped_;
+        if (lost != dropped_reported)
+        {
+          event(TRACE_DROPPED, lost - dropped_reported);
+          dropped_reported = lost;
+        }
+        vTaskDelay(drain_period);
+      }
+    }
+  } // namespace
+
+  void begin()
+  {
+    xTaskCreateStatic(drain_task, "TraceDrain", drain_stack_size, NULL, 1, drain_stack,
+                      &drain_task_buffer);
+  }
+
+  void IRAM_ATTR record(Event event, uint8_t count, const int32_t *args)
+  {
+    uint32_t now = micros();
+    portENTER_CRITICAL_SAFE(&ring_mux);
+    if (tail - head == ring_size)
+    {
+      dropped_++;
+    }
+    else
+    {
+      Record &item = ring[tail & ring_mask];
+      item.micros = now;
+      item.event = event;
+      item.count = count;
+      item.core = xPortGetCoreID();
+      for (int i = 0; i < count; i++)
+      {
+        item.args[i] = args[i];
+      }
+      tail++;
+    }
+    portEXIT_CRITICAL_SAFE(&ring_mux);
+  }
+
+  uint32_t dropped()
+  {
+    return dropped_;
+  }
+#else
+  // On the host, e.g. in the tests, there is nobody to print the records.
+  void begin() {}
+
+  void record(Event event, uint8_t count, const int32_t *args) {}
+
+  uint32_t dropped()
+  {
+    return 0;
+  }
+#endif
+
+} // namespace trace
@@ -0,0 +1,67 @@
+// trace.h
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+
+// Binary event log for the hot paths. Recording an event only copies a few
+// integers into a ring, and a low priority task prints the records later, one
+// per line as '#' followed by the record in hex. tools/trace_decode.py turns
+// those lines back into text, with the formats below, so they are the only
+// place where the text lives.
+//
+// The formats take integer arguments only. Keep the names and formats on one
+// line each, since the decoder reads them straight from this file.
+#define TRACE_EVENTS(X)                                                                    \
+  X(TRACE_DROPPED, "Trace dropped %d records")                                             \
+  X(TRACE_BAD_BYTE0, "Unexpected byte0 data %02X")                                         \
+  X(TRACE_BAD_BYTE3, "Unexpected byte3 data %02X")                                         \
+  X(TRACE_REPORT, "Buttons: %d, X: %d, Y: %d, Scroll: %d, LR_Scroll: %d")                   \
+  X(TRACE_WAKE_TO_REPORT, "Wake to first report: %d us")                                   \
+  X(TRACE_AWAKE, "Awake, wake-up took %d us, first packet losses: %d")                     \
+  X(TRACE_DEEP_PRESS, "Deep press, z: %d, rise: %d")                                       \
+  X(TRACE_PACKET, "Packet %02x %02x %02x %02x %02x %02x")
+
+namespace trace
+{
+
+  enum Event : uint16_t
+  {
+#define TRACE_ENUM(name, format) name,
+    TRACE_EVENTS(TRACE_ENUM)
+#undef TRACE_ENUM
+        TRACE_EVENT_COUNT
+  };
+
+  const int max_args = 6;
+
+  // Little-endian on the wire, and only the first count arguments are sent.
+  struct Record
+  {
+    uint32_t micros;
+    uint16_t event;
+    uint8_t count;
+    uint8_t core;
+    int32_t args[max_args];
+  };
+
+  static_assert(sizeof(Record) == 32, "Record must have no padding");
+
+  // Starts the task that prints the records.
+  void begin();
+  // Safe from tasks on either core and from interrupts.
+  void record(Event event, uint8_t count, const int32_t *args);
+  // Records lost because the ring was full.
+  uint32_t dropped();
+
+  template <class... Args>
+  inline void event(Event event, Args... args)
+  {
+    static_assert(sizeof...(Args) <= max_args, "too many trace arguments");
+    const int32_t values[] = {(int32_t)args..., 0};
+    record(event, sizeof...(Args), values);
+  }
+
+} // namespace trace
+
+#endif // TRACE_H
@@ -0,0 +1,297 @@
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <Preferences.h>
+#endif
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include "tuning.h"
+
+namespace tuning
+{
+
+  const Settings defaults = {
+      .noise_threshold_tracking_mm = 0.08,
+      .noise_threshold_scrolling_mm = 0.09,
+      .scale_tracking_mm = 12.0,
+      .scale_scroll_mm = 1.6,
+      .slow_scroll_threshold_mm = 2.0,
+      .slow_scroll_amount = 0.20F,
+      .max_delta_mm = 3,
+      .proximity_threshold_mm = 15,
+      .palm_max_speed_mm = 1.0,
+      .button_zone_height_mm = 12.0,
+      .idle_timeout_ms = 5000,
+      .frames_delay = 20,
+      .frames_stablization = 15,
+      .tap_time_threshold = 35,
+      .tap_tracking_threshold = 15,
+      .tap_z_threshold = 100,
+      .tap_and_pan_as_drag_threshold = 70,
+      .speculative_tap_delay = 4,
+      .palm_z_threshold = 100,
+      .palm_width_threshold = 10,
+      .palm_min_frames = 3,
+      .speculative_tap = false,
+      .reverse_LR_scroll = true,
+      .reverse_UD_scroll = true,
+      .button_zones_enabled = true,
+      .reserved = 0,
+      .noise_floor_x_mm = 0,
+      .noise_floor_y_mm = 0,
+      .noise_calibration = true,
+      .reserved2 = {0, 0, 0},
+      .absolute_left = 0,
+      .absolute_right = 1000,
+      .absolute_bottom = 0,
+      .absolute_top = 1000,
+      .absolute_mode = false,
+      .reserved3 = {0, 0, 0},
+      .pressure_z_min = 30,
+      .pressure_z_max = 120,
+      .deep_press_z = 120,
+      .deep_press_rise = 40,
+      .deep_press_button = 0,
+      .reserved4 = {0, 0, 0},
+  };
+
+  namespace
+  {
+    template <class T>
+    constexpr Kind kind_of()
+    {
+      return std::is_same<T, bool>::value            ? Kind::Flag
+             : std::is_floating_point<T>::value ? Kind::Real
+                                                : Kind::Integer;
+    }
+  } // namespace
+
+#define FIELD(name) {#name, offsetof(Settings, name), sizeof(Settings::name), kind_of<decltype(Settings::name)>()}
+  const Field fields[] = {
+      FIELD(noise_threshold_tracking_mm),
+      FIELD(noise_threshold_scrolling_mm),
+      FIELD(scale_tracking_mm),
+      FIELD(scale_scroll_mm),
+      FIELD(slow_scroll_threshold_mm),
+      FIELD(slow_scroll_amount),
+      FIELD(max_delta_mm),
+      FIELD(proximity_threshold_mm),
+      FIELD(palm_max_speed_mm),
+      FIELD(button_zone_height_mm),
+      FIELD(idle_timeout_ms),
+      FIELD(frames_delay),
+      FIELD(frames_stablization),
+      FIELD(tap_time_threshold),
+      FIELD(tap_tracking_threshold),
+      FIELD(tap_z_threshold),
+      FIELD(tap_and_pan_as_drag_threshold),
+      FIELD(speculative_tap_delay),
+      FIELD(palm_z_threshold),
+      FIELD(palm_width_threshold),
+      FIELD(palm_min_frames),
+      FIELD(speculative_tap),
+      FIELD(reverse_LR_scroll),
+      FIELD(reverse_UD_scroll),
+      FIELD(button_zones_enabled),
+      FIELD(noise_floor_x_mm),
+      FIELD(noise_floor_y_mm),
+      FIELD(noise_calibration),
+      FIELD(absolute_left),
+      FIELD(absolute_right),
+      FIELD(absolute_bottom),
+      FIELD(absolute_top),
+      FIELD(absolute_mode),
+      FIELD(pressure_z_min),
+      FIELD(pressure_z_max),
+      FIELD(deep_press_z),
+      FIELD(deep_press_rise),
+      FIELD(deep_press_button),
+  };
+#undef FIELD
+  const size_t field_count = sizeof(fields) / sizeof(fields[0]);
+
+  namespace
+  {
+    const char *const nvs_namespace = "touchpad";
+    const char *const nvs_key = "tuning";
+
+    // A bool that isn't 0 or 1 can't even be read, so flags are checked in
+    // the raw bytes, before they are copied into a Settings. Only the fields
+    // within the first size bytes are there.
+    bool flags_valid(const uint8_t *payload, size_t size)
+    {
+      for (size_t i = 0; i < field_count; i++)
+      {
+        if (fields[i].kind == Kind::Flag && fields[i].offset < size && payload[fields[i].offset] > 1)
+        {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    bool reals_finite(const Settings &settings)
+    {
+      for (size_t i = 0; i < field_count; i++)
+      {
+        if (fields[i].kind == Kind::Real)
+        {
+          float value;
+          memcpy(&value, (const uint8_t *)&settings + fields[i].offset, sizeof(value));
+          if (!std::isfinite(value))
+          {
+            return false;
+          }
+        }
+      }
+      return true;
+    }
+  } // namespace
+
+  uint32_t crc32(const uint8_t *data, size_t length)
+  {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < length; i++)
+    {
+      crc ^= data[i];
+      for (int bit = 0; bit < 8; bit++)
+      {
+        crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+      }
+    }
+    return ~crc;
+  }
+
+  size_t encode(const Settings &settings, uint8_t *block, size_t capacity)
+  {
+    if (capacity < block_size)
+    {
+      return 0;
+    }
+    Header header = {.magic = magic, .version = version, .size = sizeof(Settings)};
+    memcpy(block, &header, sizeof(header));
+    memcpy(block + sizeof(header), &settings, sizeof(settings));
+    uint32_t crc = crc32(block, sizeof(header) + sizeof(settings));
+    memcpy(block + sizeof(header) + sizeof(settings), &crc, sizeof(crc));
+    return block_size;
+  }
+
+  bool decode(const uint8_t *block, size_t length, Settings &settings)
+  {
+    Header header;
+    if (length < sizeof(header) + sizeof(uint32_t))
+    {
+      return false;
+    }
+    memcpy(&header, block, sizeof(header));
+    if (header.magic != magic || header.version > version ||
+        header.size > sizeof(Settings) ||
+        length != sizeof(header) + header.size + sizeof(uint32_t))
+    {
+      return false;
+    }
+
+    uint32_t crc;
+    memcpy(&crc, block + sizeof(header) + header.size, sizeof(crc));
+    if (crc != crc32(block, sizeof(header) + header.size))
+    {
+      return false;
+    }
+
+    if (!flags_valid(block + sizeof(header), header.size))
+    {
+      return false;
+    }
+    // Older blocks are shorter. Whatever they lack keeps its default.
+    Settings decoded = defaults;
+    memcpy(&decoded, block + sizeof(header), header.size);
+    if (!valid(decoded))
+    {
+      return false;
+    }
+    settings = decoded;
+    return true;
+  }
+
+  bool valid(const Settings &settings)
+  {
+    // Every float has to be finite first. Some, like slow_scroll_amount,
+    // have no range below, and infinity passes the ones that do.
+    // Reports are delayed by frames_delay in a 32 entry ring buffer.
+    return reals_finite(settings) && settings.frames_delay < 32 &&
+           settings.palm_min_frames >= 1 && settings.palm_min_frames <= 8 &&
+           settings.scale_tracking_mm > 0 && settings.scale_scroll_mm > 0 &&
+           settings.noise_threshold_tracking_mm >= 0 &&
+           settings.noise_threshold_scrolling_mm >= 0 &&
+           settings.max_delta_mm > 0 && settings.proximity_threshold_mm > 0 &&
+           settings.button_zone_height_mm >= 0 && settings.idle_timeout_ms > 0 &&
+           settings.noise_floor_x_mm >= 0 && settings.noise_floor_y_mm >= 0 &&
+           settings.absolute_left < settings.absolute_right && settings.absolute_right <= 1000 &&
+           settings.absolute_bottom < settings.absolute_top && settings.absolute_top <= 1000 &&
+           settings.pressure_z_min < settings.pressure_z_max && settings.deep_press_button <= 5;
+  }
+
+  bool set_field(Settings &settings, const Field &field, const uint8_t *value, size_t length)
+  {
+    if (length != field.size || (field.kind == Kind::Flag && value[0] > 1))
+    {
+      return false;
+    }
+    memcpy((uint8_t *)&settings + field.offset, value, field.size);
+    return true;
+  }
+
+#ifdef ARDUINO
+  bool load(Settings &settings)
+  {
+    settings = defaults;
+    Preferences preferences;
+    if (!preferences.begin(nvs_namespace, true))
+    {
+      // Nothing has been saved yet.
+      return false;
+    }
+    uint8_t block[block_size];
+    size_t length = preferences.getBytes(nvs_key, block, sizeof(block));
+    preferences.end();
+    if (length == 0)
+    {
+      return false;
+    }
+    if (!decode(block, length, settings))
+    {
+      Serial.println("Stored tuning is invalid, using defaults.");
+      return false;
+    }
+    return true;
+  }
+
+  bool save(const Settings &settings)
+  {
+    uint8_t block[block_size];
+    size_t length = encode(settings, block, sizeof(block));
+    Preferences preferences;
+    if (length == 0 || !preferences.begin(nvs_namespace, false))
+    {
+      return false;
+    }
+    bool saved = preferences.putBytes(nvs_key, block, length) == length;
+    preferences.end();
+    return saved;
+  }
+#else
+  // There is no NVS on the host, nothing is ever stored.
+  bool load(Settings &settings)
+  {
+    settings = defaults;
+    return false;
+  }
+
+  bool save(const Settings &settings)
+  {
+    return false;
+  }
+#endif
+
+} // namespace tuning
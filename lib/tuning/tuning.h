@@ -0,0 +1,129 @@
+// tuning.h
+#ifndef TUNING_H
+#define TUNING_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Everything that sets the feel of the pad, kept in NVS so that it can be
+// changed without reflashing. The block stored in NVS is
+//
+//   header (magic, version, payload size) | Settings | CRC-32
+//
+// all little-endian. The CRC is the usual zlib one, computed over the header
+// and the payload. Fields are only ever appended to Settings, so a block
+// written by an older firmware still loads: the fields it doesn't have keep
+// their defaults. tools/tuning_block.py encodes and decodes the block on the
+// host, and must be kept in sync with Settings.
+namespace tuning
+{
+
+  const uint32_t magic = 0x44415054; // "TPAD"
+  const uint16_t version = 4;
+
+  struct Header
+  {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size; // of the payload
+  };
+
+  struct Settings
+  {
+    // Version 1
+    float noise_threshold_tracking_mm;
+    float noise_threshold_scrolling_mm;
+    float scale_tracking_mm;
+    float scale_scroll_mm;
+    float slow_scroll_threshold_mm;
+    float slow_scroll_amount;
+    float max_delta_mm;
+    float proximity_threshold_mm; // 手指识别时，离预测位置超过这个距离就不算同一根手指
+    float palm_max_speed_mm;      // 手掌几乎不会快速滑动，单位是毫米每帧
+    float button_zone_height_mm;  // 按键区域从底边算起的高度
+    uint32_t idle_timeout_ms;
+    uint16_t frames_delay;
+    uint16_t frames_stablization;
+    uint16_t tap_time_threshold;            // 轻触时间tick
+    uint16_t tap_tracking_threshold;        // 防止手抖
+    int16_t tap_z_threshold;                // 防止手掌误触，z是触摸宽度，当手掌压上去时，z值会很大
+    uint16_t tap_and_pan_as_drag_threshold; // 轻触后滑动作为拖动的阈值
+    uint16_t speculative_tap_delay;         // 手指静止多少 tick 后按下
+    int16_t palm_z_threshold;               // 平均 z 超过这个值像手掌
+    int16_t palm_width_threshold;           // 平均 w 超过这个值像手掌
+    uint8_t palm_min_frames;                // 至少观察这么多帧才做判断
+    bool speculative_tap;
+    bool reverse_LR_scroll; // 左右滚动反转
+    bool reverse_UD_scroll; // 上下滚动反转
+    bool button_zones_enabled;
+    uint8_t reserved;
+    // Version 2
+    float noise_floor_x_mm; // 自动校准得出的防抖阈值，0 表示还没有校准
+    float noise_floor_y_mm;
+    bool noise_calibration; // 手指静止时在后台自动校准防抖阈值
+    uint8_t reserved2[3];
+    // Version 3
+    uint16_t absolute_left; // 绝对模式下映射到整个屏幕的区域，单位是触摸板的千分之一
+    uint16_t absolute_right;
+    uint16_t absolute_bottom;
+    uint16_t absolute_top;
+    bool absolute_mode; // 像数位板一样，把触摸板的一块区域对应到整个屏幕
+    uint8_t reserved3[3];
+    // Version 4
+    uint8_t pressure_z_min;    // 压力为 0 时的 z，轻轻触摸
+    uint8_t pressure_z_max;    // 压力最大时的 z，用力按下
+    uint8_t deep_press_z;      // 按下后 z 达到这个值算深按
+    uint8_t deep_press_rise;   // 并且比按下时至少高出这么多
+    uint8_t deep_press_button; // 深按时点击的按键，和报告的 buttons 一样，0 表示关闭
+    uint8_t reserved4[3];
+  };
+
+  static_assert(sizeof(Header) == 8, "Header must have no padding");
+  static_assert(sizeof(Settings) == 100, "Settings must have no padding");
+
+  const size_t block_size = sizeof(Header) + sizeof(Settings) + sizeof(uint32_t);
+
+  // What a setting holds, so that a value written into it can be checked
+  // before it becomes one.
+  enum class Kind : uint8_t
+  {
+    Integer,
+    Flag, // a bool, stored as a single 0 or 1 byte
+    Real, // a float
+  };
+
+  // Where each setting lives in Settings, so that they can be read and
+  // written one at a time.
+  struct Field
+  {
+    const char *name;
+    uint8_t offset;
+    uint8_t size;
+    Kind kind;
+  };
+
+  extern const Settings defaults;
+  extern const Field fields[];
+  extern const size_t field_count;
+
+  uint32_t crc32(const uint8_t *data, size_t length);
+
+  // Writes the block and returns its size, or 0 if it doesn't fit.
+  size_t encode(const Settings &settings, uint8_t *block, size_t capacity);
+  // Returns false if the block is corrupt, from a newer firmware, or holds
+  // settings that don't make sense. settings is left untouched then.
+  bool decode(const uint8_t *block, size_t length, Settings &settings);
+  bool valid(const Settings &settings);
+  // Writes a single setting from raw bytes. Returns false, and leaves
+  // settings untouched, if the size is wrong or the bytes aren't a value of
+  // the field, like a flag other than 0 or 1. Whether the result makes sense
+  // is still up to valid().
+  bool set_field(Settings &settings, const Field &field, const uint8_t *value, size_t length);
+
+  // Reads the settings from NVS, falling back to the defaults.
+  bool load(Settings &settings);
+  bool save(const Settings &settings);
+
+} // namespace tuning
+
+#endif // TUNING_H
@@ -0,0 +1,207 @@
+#include <Arduino.h>
+#include <BLE2902.h>
+#include <cstring>
+#include <new>
+#include "tuning_service.h"
+
+namespace tuning
+{
+  namespace
+  {
+    const char *const uuid_format = "4f1e%04x-8b3a-4c55-9d29-6a0f2e7b5c10";
+    const uint16_t service_id = 0x0001;
+    const uint16_t block_id = 0x0002;
+    const uint16_t command_id = 0x0003;
+    const uint16_t stats_id = 0x0004;
+    const uint16_t field_id = 0x0100;
+
+    const uint8_t command_save = 1;
+    const uint8_t command_defaults = 2;
+
+    const size_t max_fields = 40;
+
+    // What has been handed to apply last. Written from the BLE task and from
+    // update_service(), so it is only touched under the lock.
+    Settings staged;
+    portMUX_TYPE staged_mux = portMUX_INITIALIZER_UNLOCKED;
+    ApplyFunction apply_ = nullptr;
+
+    BLECharacteristic *block_characteristic = nullptr;
+    BLECharacteristic *stats_characteristic = nullptr;
+    BLECharacteristic *field_characteristics[max_fields];
+    size_t fields_exposed = 0;
+
+    // Descriptors live as long as the service, so they get static storage
+    // rather than the heap.
+    BLE2902 stats_notifications;
+    alignas(BLEDescriptor) uint8_t description_storage[max_fields][sizeof(BLEDescriptor)];
+
+    BLEUUID make_uuid(uint16_t id)
+    {
+      char buffer[37];
+      snprintf(buffer, sizeof(buffer), uuid_format, id);
+      return BLEUUID(buffer);
+    }
+
+    Settings snapshot()
+    {
+      portENTER_CRITICAL(&staged_mux);
+      Settings settings = staged;
+      portEXIT_CRITICAL(&staged_mux);
+      return settings;
+    }
+
+    // Brings every characteristic in line with the staged settings.
+    void refresh()
+    {
+      Settings settings = snapshot();
+      uint8_t block[block_size];
+      size_t length = encode(settings, block, sizeof(block));
+      block_characteristic->setValue(block, length);
+      for (size_t i = 0; i < fields_exposed; i++)
+      {
+        field_characteristics[i]->setValue((uint8_t *)&settings + fields[i].offset, fields[i].size);
+      }
+    }
+
+    bool stage(const Settings &changed)
+    {
+      if (!valid(changed))
+      {
+        return false;
+      }
+      portENTER_CRITICAL(&staged_mux);
+      staged = changed;
+      portEXIT_CRITICAL(&staged_mux);
+      apply_(changed);
+      return true;
+    }
+
+    class BlockCallbacks : public BLECharacteristicCallbacks
+    {
+      void onWrite(BLECharacteristic *characteristic)
+      {
+        std::string value = characteristic->getValue();
+        Settings changed;
+        if (decode((const uint8_t *)value.data(), value.size(), changed))
+        {
+          stage(changed);
+        }
+        // A rejected block is replaced by the one in effect.
+        refresh();
+      }
+    };
+
+    class CommandCallbacks : public BLECharacteristicCallbacks
+    {
+      void onWrite(BLECharacteristic *characteristic)
+      {
+        std::string value = characteristic->getValue();
+        if (value.size() != 1)
+        {
+          return;
+        }
+        if (value[0] == command_save)
+        {
+          if (!save(snapshot()))
+          {
+            Serial.println("Tuning could not be saved.");
+          }
+        }
+        else if (value[0] == command_defaults)
+        {
+          stage(defaults);
+          refresh();
+        }
+      }
+    };
+
+    class FieldCallbacks : public BLECharacteristicCallbacks
+    {
+    public:
+      size_t index;
+
+      void onWrite(BLECharacteristic *characteristic)
+      {
+        std::string value = characteristic->getValue();
+        Settings changed = snapshot();
+        if (set_field(changed, fields[index], (const uint8_t *)value.data(), value.size()))
+        {
+          stage(changed);
+        }
+        refresh();
+      }
+    };
+
+    BlockCallbacks block_callbacks;
+    CommandCallbacks command_callbacks;
+    FieldCallbacks field_callbacks[max_fields];
+  } // namespace
+
+  void begin_service(BLEServer *server, const Settings &current, ApplyFunction apply)
+  {
+    staged = current;
+    apply_ = apply;
+    fields_exposed = field_count < max_fields ? field_count : max_fields;
+
+    // One handle for the service, two per characteristic and one per
+    // descriptor.
+    uint32_t handles = 1 + 2 + 2 + 3 + fields_exposed * 3;
+    BLEService *service = server->createService(make_uuid(service_id), handles);
+
+    // Only a bonded host may change anything.
+    const esp_gatt_perm_t write_permissions = ESP_GATT_PERM_READ_ENCRYPTED | ESP_GATT_PERM_WRITE_ENCRYPTED;
+
+    block_characteristic = service->createCharacteristic(
+        make_uuid(block_id), BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_WRITE);
+    block_characteristic->setAccessPermissions(write_permissions);
+    block_characteristic->setCallbacks(&block_callbacks);
+
+    BLECharacteristic *command_characteristic = service->createCharacteristic(
+        make_uuid(command_id), BLECharacteristic::PROPERTY_WRITE);
+    command_characteristic->setAccessPermissions(write_permissions);
+    command_characteristic->setCallbacks(&command_callbacks);
+
+    stats_characteristic = service->createCharacteristic(
+        make_uuid(stats_id), BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY);
+    stats_characteristic->addDescriptor(&stats_notifications);
+
+    for (size_t i = 0; i < fields_exposed; i++)
+    {
+      BLECharacteristic *characteristic = service->createCharacteristic(
+          make_uuid(field_id + i), BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_WRITE);
+      characteristic->setAccessPermissions(write_permissions);
+      BLEDescriptor *description = new (description_storage[i]) BLEDescriptor(BLEUUID((uint16_t)0x2901));
+      description->setValue(fields[i].name);
+      characteristic->addDescriptor(description);
+      field_callbacks[i].index = i;
+      characteristic->setCallbacks(&field_callbacks[i]);
+      field_characteristics[i] = characteristic;
+    }
+
+    refresh();
+    service->start();
+  }
+
+  void update_service(const Settings &current)
+  {
+    portENTER_CRITICAL(&staged_mux);
+    staged = current;
+    portEXIT_CRITICAL(&staged_mux);
+    if (block_characteristic != nullptr)
+    {
+      refresh();
+    }
+  }
+
+  void notify_stats(const Stats &stats)
+  {
+    if (stats_characteristic == nullptr)
+    {
+      return;
+    }
+    stats_characteristic->setValue((uint8_t *)&stats, sizeof(stats));
+    stats_characteristic->notify();
+  }
+
+} // namespace tuning
@@ -0,0 +1,58 @@
+// tuning_service.h
+#ifndef TUNING_SERVICE_H
+#define TUNING_SERVICE_H
+
+#include <BLEServer.h>
+#include <freertos/FreeRTOS.h>
+#include <tuning.h>
+
+// A vendor GATT service for tuning the pad live over BLE, next to the HID
+// service. All UUIDs are 4f1eXXXX-8b3a-4c55-9d29-6a0f2e7b5c10, where XXXX is
+//
+//   0001  the service
+//   0002  block    read/write  the whole settings block, as stored in NVS
+//   0003  command  write       1 = save to NVS, 2 = restore the defaults
+//   0004  stats    read/notify a tuning::Stats
+//   01NN  setting  read/write  tuning::fields[NN], little-endian
+//
+// Every setting also has a user description with its name, so generic BLE
+// apps show what it is. Writes are validated and handed to the apply
+// function, which must not block. Nothing is saved until the save command.
+namespace tuning
+{
+
+  // Live pipeline counters, notified about once a second.
+  struct Stats
+  {
+    uint32_t packets;             // PS/2 packets decoded
+    uint32_t reports;             // HID reports sent
+    uint32_t packet_errors;       // packets dropped on a bad header
+    uint32_t finger_matches;      // fingers recognised after a finger count drop
+    uint32_t finger_resets;       // fingers that could not be recognised
+    uint32_t speculative_clicks;  // speculative presses that became clicks
+    uint32_t speculative_cancels; // speculative presses taken back
+    uint16_t report_depth;        // reports waiting to be sent
+    uint8_t cpu_level;            // 0 = idle, 1 = active, 2 = burst
+    uint8_t idle;
+    uint8_t output_load;          // percent of core 0 spent sending reports
+    uint8_t decode_load;          // percent of core 1 spent decoding packets
+    uint8_t packet_queue_depth;   // packets waiting to be decoded
+    uint8_t channel_max_depth;    // most reports ever waiting to be sent
+    uint32_t channel_overflows;   // reports dropped because sending fell behind
+    uint32_t frames_received;     // touchpad frames that arrived
+    uint32_t frames_lost;         // frames missing from the stream, by their timing
+  };
+
+  static_assert(sizeof(Stats) == 48, "Stats must have no padding");
+
+  typedef void (*ApplyFunction)(const Settings &settings);
+
+  // Creates and starts the service. current is what is in effect now.
+  void begin_service(BLEServer *server, const Settings &current, ApplyFunction apply);
+  // Tells the service about settings changed by other means.
+  void update_service(const Settings &current);
+  void notify_stats(const Stats &stats);
+
+} // namespace tuning
+
+#endif // TUNING_SERVICE_H
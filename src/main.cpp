@@ -7,6 +7,17 @@
 #include <esp_task_wdt.h>
 #include <BleMouse.h>
 #include <freertos/queue.h>
+#include <gesture.h>
+#include <esp_sleep.h>
+#include <esp_pm.h>
+#include <esp_heap_caps.h>
+#include <tuning.h>
+#include <tuning_service.h>
+#include <trace.h>
+#include <decoder.h>
+#ifdef SIMULATED_TOUCHPAD
+#include <simulated_synaptics.h>
+#endif
 
 // 在文件顶部定义或注释掉 DEBUG 宏
 // #define DEBUG
@@ -18,19 +29,21 @@
 #define debug_println(x) Serial.println(x)
 #define info_printf(fmt, ...) Serial.printf((fmt), ##__VA_ARGS__)
 #define info_println(x) Serial.println(x)
+#define info_trace(id, ...) trace::event((id), ##__VA_ARGS__)
 #elif defined(INFO)
 #define debug_printf(fmt, ...)
 #define debug_println(x)
 #define info_printf(fmt, ...) Serial.printf((fmt), ##__VA_ARGS__)
 #define info_println(x) Serial.println(x)
+#define info_trace(id, ...) trace::event((id), ##__VA_ARGS__)
 #else
 #define debug_printf(fmt, ...)
 #define debug_println(x)
 #define info_printf(fmt, ...)
 #define info_println(x)
+#define info_trace(id, ...)
 #endif
-
-BleMouse bleMouse;
+// info_trace 用于热路径：只把事件记录到二进制日志，由低优先级任务输出，格式见 lib/trace/trace.h
 
 #ifndef min
 #define min(a, b) ((a) < (b) ? (a) : (b))
@@ -40,653 +53,386 @@ BleMouse bleMouse;
 #define max(a, b) ((a) > (b) ? (a) : (b))
 #endif
 
-#ifndef sign
-#define sign(x) ((x) > 0 ? (1) : ((x) < 0 ? (-1) : (0)))
-#endif
-
 // 定义GPIO引脚
 const int CLOCK_PIN = 23; // ESP32的GPIO23
 const int DATA_PIN = 5;   // ESP32的GPIO5
 
-// 防抖和优化相关常量
-const float noise_threshold_tracking_mm = 0.08;
-const float noise_threshold_scrolling_mm = 0.09;
-const int frames_delay = 20;
-const int frames_stablization = 15;
-const float scale_tracking_mm = 12.0;
-const float scale_scroll_mm = 1.6;
-const float slow_scroll_threshold_mm = 2.0;
-const float max_delta_mm = 3;
-const int proximity_threshold_mm = 15;
-const float slow_scroll_amount = 0.20F;
-const TickType_t xDelay = pdMS_TO_TICKS(10);
-
-// 全局变量
-volatile uint64_t g_received_packet = 0;
-volatile bool g_packet_ready = false;
-static unsigned long global_tick = 0;
-static unsigned long session_started_tick = 0;
-static unsigned long button_released_tick = 0;
-int last_y = 0;
-unsigned long three_finger_start = 0;
-bool middle_button_pressed = false;
-unsigned long finger_down_time = 0;
-
-// Tap as click 轻触作为点击
-bool tap_detected = false;
-unsigned long tap_start_tick = 0;
-const unsigned long tap_time_threshold = 35; // 轻触时间tick
-float total_movement = 0;
-const float tap_tracking_threshold = 15;          // 防止手抖
-const short tap_z_threshold = 100;                // 防止手掌误触，z是触摸宽度，当手掌压上去时，z值会很大
-short max_tap_z = 0;                              // 记录最大的z值
-uint16_t button_state_count = 0;                  // 记录超过一定次数的按钮状态
-const uint16_t button_state_threshold = 5;        // 按钮状态超过一定次数，才认为是点击
-short tap_button = 0;                             // 记录轻触时的按钮状态
-const short tap_and_pan_as_drag_threshold = 70;   // 轻触后滑动作为拖动的阈值
-bool tap_and_pan_as_drag_detected = false;        // 轻触后滑动作为拖动是否已经检测到
-unsigned long tap_and_pan_as_drag_start_tick = 0; // 轻触后滑动作为拖动开始的tick
-
-// 滚动相关
-bool reverse_LR_scroll = true; // 左右滚动反转
-bool reverse_UD_scroll = true; // 上下滚动反转
+#ifdef SIMULATED_TOUCHPAD
+// 没有接触控板时用软件模拟的触控板代替，按 demo_script 产生数据包，见 platformio.ini 的 esp32dev-simulated
+// SIMULATED_DEVICE 选择模拟的设备，见 esp32dev-simulated-mouse
+#ifndef SIMULATED_DEVICE
+#define SIMULATED_DEVICE Synaptics
+#endif
+ps2::SimulatedSynaptics simulated_touchpad(ps2::demo_script, ps2::demo_script_length,
+                                           ps2::SimulatedSynaptics::SIMULATED_DEVICE);
+hw_timer_t *simulated_timer = NULL;
+void IRAM_ATTR simulated_frame() { simulated_touchpad.frame(); }
+#endif
 
-// 定义消息队列句柄
-static QueueHandle_t mouseEventQueue = NULL;
+// 可调参数 decoder::settings 开机时从 NVS 读取，见 lib/tuning/tuning.h。只能在 touchpadTask 里修改，
+// 其他地方要改的话把新的参数放进 settingsQueue，在两个数据包之间生效。
+static QueueHandle_t settingsQueue = NULL;
 
-struct TouchInfo
+// Hands new settings to the touchpad task without waiting. A newer set
+// replaces one that hasn't been applied yet.
+void queue_settings(const tuning::Settings &changed)
 {
-  int x;
-  int y;
-  int z;
-  int fingers;
-  bool button;
-};
+  xQueueOverwrite(settingsQueue, &changed);
+}
 
-struct finger_state
+// The HID mouse, plus the tuning service next to it.
+class TouchpadMouse : public BleMouse
 {
-  SimpleAverage<int, 5> x;
-  SimpleAverage<int, 5> y;
-  short z;
+protected:
+  void onStarted(BLEServer *pServer) override
+  {
+    tuning::begin_service(pServer, decoder::settings, queue_settings);
+  }
 };
 
-struct report
+TouchpadMouse bleMouse;
+
+// 空闲省电：一段时间没有数据包后降低触控板采样率、放宽蓝牙连接，并让任务一直等待下一个数据包。
+// 第一个数据包到来时恢复全速。
+static bool idle = false;
+static bool rate_change_pending = false; // 离开空闲后，等第一个数据包解析完再提高采样率
+static unsigned long last_packet_ms = 0;
+// 空闲时进入自动 light sleep，由 PS/2 时钟线唤醒。需要在 sdkconfig 中启用 CONFIG_PM_ENABLE 和 tickless idle。
+#ifdef SIMULATED_TOUCHPAD
+const bool light_sleep = false; // 模拟的触控板没有时钟线可以唤醒
+#else
+const bool light_sleep = true;
+#endif
+#if CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t no_sleep_lock = NULL;
+#endif
+static uint32_t packets_decoded = 0;       // 解析过的数据包
+static uint32_t reports_sent = 0;          // 发出的报告
+static uint32_t packet_errors_at_idle = 0; // 进入空闲时的 packet_errors
+static unsigned long first_packet_losses = 0; // 唤醒后第一个数据包丢失的次数
+static volatile bool awaiting_first_report = false;     // 唤醒后还没有发出报告
+static volatile bool capture_packets = false; // 把收到的每个数据包记入 trace，见 handle_capture_command
+
+// CPU 调频：数据包密集或报告堆积时锁定最高频率，其余时间降到最低频率，空闲时允许 light sleep。
+enum cpu_level
 {
-  uint8_t buttons;
-  int8_t x;
-  int8_t y;
-  int8_t scroll;
-  bool LR_scroll;
+  CPU_IDLE,   // 空闲，可以 light sleep
+  CPU_ACTIVE, // 最低频率
+  CPU_BURST,  // 最高频率
+  CPU_LEVELS
 };
+const char *const cpu_level_names[CPU_LEVELS] = {"idle", "active", "burst"};
+const unsigned long cpu_window_ms = 100; // 统计数据包速率的窗口
+const int burst_packets = 6;             // 窗口内有这么多数据包就算突发，全速时是 8 个
+const int burst_report_depth = 8;        // 待发送的报告有这么多也算突发
+const unsigned long burst_hold_ms = 250; // 突发结束后继续保持最高频率的时间，避免来回切换
+static cpu_level cpu_current = CPU_ACTIVE;
+static unsigned long cpu_level_since_ms = 0;
+static unsigned long cpu_level_ms[CPU_LEVELS] = {0}; // 每个档位累计的时间
+#if CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t cpu_max_lock = NULL;
+#endif
 
-RingBuffer<report, 32> reports;
-static finger_state finger_states[2]; // 0 is primary, 1 is secondary
-static short finger_count = 0;
-static uint8_t button_state = 0;
-// 变量
-float scale_tracking_x, scale_tracking_y;
-float scale_scroll_x, scale_scroll_y;
-float noise_threshold_tracking_x, noise_threshold_tracking_y;
-float noise_threshold_scrolling_x, noise_threshold_scrolling_y;
-float max_delta_x, max_delta_y;
-float slow_scroll_threshold;
-float proximity_threshold_x, proximity_threshold_y;
+// 定义消息队列句柄
+static QueueHandle_t mouseEventQueue = NULL;
 
-void IRAM_ATTR byte_received(uint8_t data)
+// 任务和队列都是静态分配的，不占用堆。堆栈大小参考开机时打印的内存预算
+const int packet_queue_length = 32;
+static uint8_t packet_queue_storage[packet_queue_length * sizeof(decoder::captured_packet)];
+static StaticQueue_t packet_queue_buffer;
+static uint8_t settings_queue_storage[sizeof(tuning::Settings)];
+static StaticQueue_t settings_queue_buffer;
+const uint32_t touchpad_stack_size = 4096;
+static StackType_t touchpad_stack[touchpad_stack_size];
+static StaticTask_t touchpad_task_buffer;
+static TaskHandle_t touchpadTaskHandle = NULL;
+const uint32_t output_stack_size = 3072;
+static StackType_t output_stack[output_stack_size];
+static StaticTask_t output_task_buffer;
+
+static TaskHandle_t outputTaskHandle = NULL;
+// 每个核心上处理流程占用的时间，由 loop() 换算成负载
+static volatile uint32_t core_busy_us[2] = {0, 0};
+
+// 校准结果由 loop() 保存，不在触摸板任务里写 flash。settings_to_save 是当时
+// 生效的全部参数，只用来更新蓝牙服务，保存时只写入其中的 noise floor
+static tuning::Settings settings_to_save;
+static volatile bool save_pending = false;
+static portMUX_TYPE save_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Asks loop() to save the calibrated noise floors in values to NVS.
+void request_save(const tuning::Settings &values)
 {
-  static uint64_t buffer = 0;
-  static int index = 0;
+  portENTER_CRITICAL(&save_mux);
+  settings_to_save = values;
+  save_pending = true;
+  portEXIT_CRITICAL(&save_mux);
+}
 
-  // Ignore all bytes until we see the start of a packet, otherwise the
-  // packets may get out of sequence and things will get very confusing.
-  if (index == 0 && (data & 0xc8) != 0x80)
-  {
-    Serial.print("Unexpected byte0 data ");
-    Serial.println(data, HEX);
+// A report is waiting for the output task.
+void report_ready()
+{
+  xTaskNotifyGive(outputTaskHandle);
+}
 
-    index = 0;
-    buffer = 0;
-    return;
-  }
+// The output channel is full. The output task has been notified of every
+// report in there and runs on the other core, so a tick is plenty for it to
+// make room.
+void wait_for_output()
+{
+  vTaskDelay(1);
+}
 
-  if (index == 24 && (data & 0xc8) != 0xc0)
+void IRAM_ATTR byte_received(uint8_t data)
+{
+  decoder::captured_packet packet;
+  if (!decoder::frame_byte(data, micros(), packet) || mouseEventQueue == NULL)
   {
-    Serial.print("Unexpected byte3 data ");
-    Serial.println(data, HEX);
-
-    index = 0;
-    buffer = 0;
     return;
   }
-
-  buffer |= ((uint64_t)data) << index;
-  index += 8;
-  if (index == 48)
+  BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+  xQueueSendFromISR(mouseEventQueue, &packet, &xHigherPriorityTaskWoken);
+  if (xHigherPriorityTaskWoken)
   {
-    if (mouseEventQueue != NULL)
-    { // 确保队列存在
-      BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-      uint64_t temp = buffer; // 创建临时变量，因为buffer会被清零
-      xQueueSendFromISR(mouseEventQueue, &temp, &xHigherPriorityTaskWoken);
-      if (xHigherPriorityTaskWoken)
-      {
-        portYIELD_FROM_ISR();
-      }
-    }
-    index = 0;
-    buffer = 0;
+    portYIELD_FROM_ISR();
   }
 }
 
-// 将值转换为HID值
-float to_hid_value(float value, float threshold, float scale_factor)
+// Called by ps2 when the clock line has woken us up, while it still holds the
+// packet back. Light sleep must stay off from here on, or its bits would be
+// lost.
+void touchpad_woke_up()
 {
-  const float hid_max = 127.0F;
-  if (abs(value) < threshold)
+#if CONFIG_PM_ENABLE
+  if (no_sleep_lock != NULL)
   {
-    return 0;
+    esp_pm_lock_acquire(no_sleep_lock);
   }
-  return sign(value) * min(max(abs(value) * scale_factor, 1.0F), hid_max);
-}
-
-void tap_as_click_reset(int flag)
-{
-  tap_detected = false;
-  total_movement = 0;
-  max_tap_z = 0;
-  button_state_count = 0;
-  tap_button = 0;
-  debug_printf("Tap as click reset, flag: %d\n", flag);
+#endif
 }
 
-void queue_report(uint8_t buttons, int8_t x, int8_t y, float scroll, bool LR_scroll = false)
+// Moves the CPU to another level, and accounts the time spent at the old one.
+void set_cpu_level(cpu_level level)
 {
-  static float scroll_amount_rollover = 0;
-  report item = {.buttons = buttons};
-  if (button_released_tick != 0 &&
-      global_tick - button_released_tick < frames_stablization)
+  if (level == cpu_current)
   {
-    if (!tap_and_pan_as_drag_detected)
-    {
-      item.x = 0;
-      item.y = 0;
-      item.scroll = 0;
-    }
-    else
-    {
-      item.x = x;
-      item.y = y;
-      item.scroll = 0;
-    }
+    return;
   }
-  else
+  unsigned long now = millis();
+  cpu_level_ms[cpu_current] += now - cpu_level_since_ms;
+  cpu_level_since_ms = now;
+#if CONFIG_PM_ENABLE
+  if (cpu_max_lock != NULL)
   {
-    if (scroll > -1.0F && scroll < 1.0F)
+    if (level == CPU_BURST)
     {
-      scroll_amount_rollover += scroll;
-      if (scroll_amount_rollover >= 1.0F)
-      {
-        scroll = 1.0F;
-        scroll_amount_rollover -= 1.0F;
-      }
-      else if (scroll_amount_rollover <= -1.0F)
-      {
-        scroll = -1.0F;
-        scroll_amount_rollover += 1.0F;
-      }
-      else
-      {
-        scroll = 0;
-      }
+      esp_pm_lock_acquire(cpu_max_lock);
+    }
+    else if (cpu_current == CPU_BURST)
+    {
+      esp_pm_lock_release(cpu_max_lock);
     }
-    item.x = x;
-    item.y = y;
-    item.scroll = scroll;
-    item.LR_scroll = LR_scroll;
   }
-  reports.push_back(item);
+#endif
+  cpu_current = level;
 }
 
-void parse_primary_packet(uint64_t packet, int w)
+// Picks the CPU level from the packet rate and the number of pending reports.
+// The pad streams 80 packets per second while it is touched, and reports pile
+// up when BLE can't keep up. Either way, we want the maximum frequency until
+// things calm down for a while.
+void update_cpu_level(bool packet_received)
 {
-  global_tick++;
-  // Reference: Section 3.2.1, Figure 3-4
-  int x = (packet >> 32) & 0x00FF | (packet >> 0) & 0x0F00 |
-          (packet >> 16) & 0x1000;
-  int y = (packet >> 40) & 0x00FF | (packet >> 4) & 0x0F00 |
-          (packet >> 17) & 0x1000;
-  short z = (packet >> 16) & 0xFF; // z 是宽度，手掌压上去z就大，手指轻轻触摸z就小
-  // w is width only if it >= 4. otherwise it encodes finger count
-  short width = max(w, 4);
-
-  // A clickpad reprots its button as a middle/up button. This logic needs to
-  // change completely if the touchpad is not a clickpad (i.e. it has physical
-  // buttons).
-  bool button = (packet >> 24) & 0x01;
-  int new_finger_count = 0;
-  if (z == 0)
-  {
-    new_finger_count = 0;
-  }
-  else if (w >= 4)
+  static unsigned long window_started_ms = 0;
+  static int window_packets = 0;
+  static unsigned long last_burst_ms = 0;
+
+  if (idle)
   {
-    new_finger_count = 1;
+    return;
   }
-  else if (w == 0)
+  unsigned long now = millis();
+  if (packet_received)
   {
-    new_finger_count = 2;
+    window_packets++;
   }
-  else if (w == 1)
+  bool burst = decoder::delayed_reports() >= burst_report_depth;
+  if (now - window_started_ms >= cpu_window_ms)
   {
-    new_finger_count = 3;
+    burst = burst || window_packets >= burst_packets;
+    window_started_ms = now;
+    window_packets = 0;
   }
 
-  if (finger_count == 0 && new_finger_count > 0)
+  if (burst)
   {
-    session_started_tick = global_tick;
+    last_burst_ms = now;
+    set_cpu_level(CPU_BURST);
   }
-
-  /* Mechanisms to smooth the movements. */
-
-  // When a button is pressed, we retrospectively freeze the previous frames,
-  // since the movements tend to be jerky when releasing a button.
-  if (button && button_state == 0)
+  else if (cpu_current == CPU_BURST && now - last_burst_ms >= burst_hold_ms)
   {
-    int size = reports.size();
-    for (int i = 0; i < size; i++)
-    {
-      reports[i].x = 0;
-      reports[i].y = 0;
-      reports[i].scroll = 0;
-    }
+    set_cpu_level(CPU_ACTIVE);
   }
+}
 
-  // When a button is released, we freeze the next few frames, since the
-  // movements tend to be jerky when pressing a button.
-  if (!button && button_state != 0)
+void print_cpu_levels()
+{
+  unsigned long current_ms = millis() - cpu_level_since_ms;
+  for (int i = 0; i < CPU_LEVELS; i++)
   {
-    button_released_tick = global_tick;
+    info_printf("CPU %s: %lu ms%s", cpu_level_names[i],
+                cpu_level_ms[i] + (i == cpu_current ? current_ms : 0),
+                i == CPU_LEVELS - 1 ? "\n" : ", ");
   }
+}
 
-  // When a finger is lifted, we restrospectively freeze the previous
-  // frames, since the movements tend to be jerky when lifting a finger.
-  if (new_finger_count < finger_count)
+void enter_idle()
+{
+  decoder::release_buttons();
+  rate_change_pending = false;
+  synaptics::set_high_rate(false);
+  bleMouse.setIdle(true);
+  idle = true;
+  set_cpu_level(CPU_IDLE);
+  packet_errors_at_idle = decoder::stats().packet_errors;
+  if (light_sleep)
   {
-    for (int i = 0; i < reports.size(); i++)
+    ps2::arm_wakeup(touchpad_woke_up);
+#if CONFIG_PM_ENABLE
+    if (no_sleep_lock != NULL)
     {
-      reports[i].x = 0;
-      reports[i].y = 0;
-      reports[i].scroll = 0;
+      esp_pm_lock_release(no_sleep_lock);
     }
+#endif
   }
+  info_println("Idle");
+  print_cpu_levels();
+}
 
-  /* Update state variables. */
-  if (new_finger_count > finger_count)
+void leave_idle()
+{
+  unsigned long started = micros();
+  // The commands for the rate hold the stream back for a while, so they
+  // wait until the packet that woke us up has been decoded.
+  rate_change_pending = true;
+  bleMouse.setIdle(false);
+  idle = false;
+  set_cpu_level(CPU_ACTIVE);
+  awaiting_first_report = light_sleep;
+  if (decoder::stats().packet_errors != packet_errors_at_idle)
   {
-    // A finger has been added. Reset state for that finger.
-    finger_states[1].x.reset();
-    finger_states[1].y.reset();
-    if (finger_count == 0)
-    {
-      finger_states[0].x.reset();
-      finger_states[0].y.reset();
-    }
+    // Whatever arrived before this packet was garbled.
+    first_packet_losses++;
   }
+  info_trace(trace::TRACE_AWAKE, micros() - started, first_packet_losses);
+}
 
-  int delta_x = 0, delta_y = 0;
-
-  if (new_finger_count > 0)
-  {
-    finger_states[0].z = z;
-
-    int prev_x = finger_states[0].x.average();
-    int new_x = finger_states[0].x.filter(x);
-    if (prev_x > 0 && new_finger_count == finger_count)
-    {
-      delta_x = new_x - prev_x;
-    }
-
-    int prev_y = finger_states[0].y.average();
-    int new_y = finger_states[0].y.filter(y);
-    if (prev_y > 0 && new_finger_count == finger_count)
-    {
-      delta_y = new_y - prev_y;
-    }
-  }
+// Sends the reports over BLE, on core 0 next to the Bluetooth stack, at a
+// lower priority so that the stack always gets to run.
+void outputTask(void *pvParameters)
+{
+  decoder::report item;
+  int8_t scroll = 0;
+  decoder::Buttons held;
+  uint8_t pressed = 0; // what the host has been told
 
-  if (new_finger_count < finger_count)
+  while (1)
   {
-    // A finger has been released.
-    if (finger_count == 2)
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    unsigned long busy_since = micros();
+    while (decoder::next_report(item))
     {
-      // 2 fingers -> 1 finger
-      // When a primary finger is released, the secondary becomes the primary.
-      // We determine if that is happening by checking if the finger location is
-      // close to the previous secondary finger. proximity_threshold is an
-      // emperical number and not always reliable. We err on the conservative
-      // side. If we can't be sure, just reset the state. This could result in a
-      // slightly jerky cursor movement.
-      if (abs(x - finger_states[0].x.average()) >= proximity_threshold_x ||
-          abs(y - finger_states[0].y.average()) >= proximity_threshold_y)
+      if (item.absolute)
       {
-        if (abs(x - finger_states[1].x.average()) < proximity_threshold_x &&
-            abs(y - finger_states[1].y.average()) < proximity_threshold_y)
-        {
-          finger_states[0] = finger_states[1];
-        }
-        else
+        if (bleMouse.isConnected())
         {
-          finger_states[0].x.reset();
-          finger_states[0].y.reset();
-          // tap_as_click_reset();
+          reports_sent++;
+          bleMouse.moveTo(item.position_x, item.position_y, item.pen, item.pressure);
         }
+        continue;
       }
-    }
-    else
-    {
-      // 3 fingers -> 2 fingers or 1 finger, or all fingers have been lifted.
-      // Let's not bother. Just reset both fingers.
-      finger_states[0].x.reset();
-      finger_states[0].y.reset();
-      finger_states[1].x.reset();
-      finger_states[1].y.reset();
-      // tap_as_click_reset();
-    }
-  }
-
-  // if (finger_count == 1 && new_finger_count == 1 &&
-  //     (abs(delta_x) >= max_delta_x || abs(delta_y) >= max_delta_y))
-  // {
-  //   // In rare occasions where a finger is released and another is pressed in
-  //   // the same frame, we don't see a finger count change but a big jump in
-  //   // finger position. In this case, reset the position and start over.
-  //   // This solution isn't ideal. A rather big jump could happen when the
-  //   // fingers are moving very fast. A more reliable approach would be based
-  //   // on the recent velocity of the finger movements. But it's complicated
-  //   // and expensive. Both scenarios just described are edge cases and the user
-  //   // is probably just fooling around.
-  //   finger_states[0].x.reset();
-  //   finger_states[0].y.reset();
-  //   delta_x = 0;
-  //   delta_y = 0;
-  // }
-  // "=== tick: %d, Fingers: %d, X: %d, Y: %d, Z: %d, Width: %d, Button: %d, DeltaX: %d, DeltaY: %d, Per_Finger: %d ===\n"
-  debug_printf("=== t: %d, F: %d, X: %d, Y: %d, Z: %d, W: %d, B: %d, DX: %d, DY: %d, PF: %d ===\n", global_tick, new_finger_count, x, y, z, width, button, delta_x, delta_y, finger_count);
-
-  // 轻触作为点击，包括单击、双击和三击
-  if (finger_count == 0 && new_finger_count > 0)
-  {
-    tap_start_tick = global_tick;
-    tap_as_click_reset(1);
-    button_state = new_finger_count;
-    tap_detected = true;
-    tap_button = button_state;
-  }
-  else if (finger_count >= 0 && new_finger_count == 0)
-  {
-    if (tap_detected)
-    {
-      debug_printf("Tap detected: %d, total_movement: %f, max_tap_z: %d\n", global_tick - tap_start_tick, total_movement, max_tap_z);
-      if (global_tick - tap_start_tick <= tap_time_threshold)
+      uint8_t buttons = held.update(item);
+      if (!item.speculative)
       {
-
-        if (total_movement < tap_tracking_threshold && max_tap_z < tap_z_threshold)
+        if (awaiting_first_report)
         {
-          queue_report(tap_button, 0, 0, 0);
-
-          if (tap_button == 1)
-          {
-            debug_println("*** Drag detected ***");
-            tap_and_pan_as_drag_start_tick = global_tick;
-          }
-
-          button_state = 0;
-          tap_button = 0;
-          tap_as_click_reset(2);
+          awaiting_first_report = false;
+          info_trace(trace::TRACE_WAKE_TO_REPORT, micros() - ps2::wakeup_micros);
         }
+        // hid::report(item.buttons, item.x, item.y, item.scroll);
+        info_trace(trace::TRACE_REPORT, item.buttons, item.x, item.y, item.scroll, item.LR_scroll);
       }
-      else
-      {
-        debug_printf("Tap timeout");
-        tap_as_click_reset(3);
-      }
-    }
-  }
-
-  finger_count = new_finger_count;
 
-  /* State machine logic */
-  if (finger_count == 0 && new_finger_count == 0)
-  {
-    // // idle
-    // if (button_state == 0 && !click_is_send)
-    // {
-    //   button_state = new_finger_count < 2 ? LEFT_BUTTON : RIGHT_BUTTON;
-    //   queue_report(button_state, 0, 0, 0);
-    // }
-    if (button_state != 0 && !button)
-    {
-      button_state = 0;
-      queue_report(0, 0, 0, 0);
-    }
-  }
-  else if (finger_count >= 3)
-  {
-    tap_button = finger_count;
-  }
-  else if (finger_count == 2)
-  {
-    // scrolling
-    // if (button)
-    // {
-    //   // It's OK to change between left and right while scrolling.
-    //   button_state = new_finger_count > 1 ? RIGHT_BUTTON : LEFT_BUTTON;
-    // }
-    // else
-    // {
-    //   button_state = 0;
-    // }
-
-    // Since we're scrolling, we are here every other frame. So we should double
-    // the noise threshold.
-    total_movement += abs(delta_x) + abs(delta_y);
-    if (z > max_tap_z)
-    {
-      max_tap_z = z;
-    }
-    bool LR_scroll = abs(delta_x) > abs(delta_y);
-    float scroll_amount = 0;
-    if (LR_scroll)
-    {
-      scroll_amount = to_hid_value(delta_x, noise_threshold_scrolling_x, scale_scroll_x);
-    }
-    else
-    {
-      scroll_amount = to_hid_value(delta_y, noise_threshold_scrolling_y, scale_scroll_y);
-    }
-
-    if (abs(LR_scroll ? delta_x : delta_y) <= slow_scroll_threshold)
-    {
-      scroll_amount = sign(scroll_amount) * slow_scroll_amount;
-    }
-    if (tap_button < 2)
-    {
-      tap_button = 2;
-    }
-    if (scroll_amount != 0)
-    {
-      button_state = 0;
-      debug_printf("Scroll amount: %f\n", scroll_amount);
-      // Serial.printf("Scroll amount: %f\n", scroll_amount);
-      queue_report(button_state, 0, 0, scroll_amount, LR_scroll);
-    }
-  }
-  else if (finger_count == 1)
-  {
-    // 1-finger tracking or 2-finger tracking
-    if (button || (abs(delta_x) < noise_threshold_tracking_x && abs(delta_y) < noise_threshold_tracking_y))
-    {
-      // If the button is already pressed, we don't change between left and
-      // right while dragging.
-      // if (button_state == 0)
-      // {
-      //   button_state = new_finger_count > 1 ? RIGHT_BUTTON : LEFT_BUTTON;
-      // }
-      total_movement += abs(delta_x) + abs(delta_y);
-      if (z > max_tap_z)
+      if (!bleMouse.isConnected())
       {
-        max_tap_z = z;
+        continue;
       }
-    }
-    else
-    {
-      button_state = 0;
-    }
-    // else
-    // {
-    //   button_state = 0;
-    // }
-    // If there are multiple fingers pressed, normal packets and secondary
-    // packets are alternated. So we should double the threshold.
-    float threshold_multiplier = finger_count == 1 ? 1.0 : 2.0;
-    // Serial.print("Width: ");
-    // Serial.print(width);
-    // Serial.print(" Pressure: ");
-    // Serial.println(z);
-
-    if (width > 4)
-    {
-      // Fat finger
-      threshold_multiplier *= 1.0F + (width - 4.0F) / 4.0F;
-    }
-    if (z >= 60)
-    {
-      // Heavy finger
-      threshold_multiplier *= 1.0F + (z - 60.0F) / 40.0F;
-    }
+      reports_sent++;
 
-    float delta_x_mm = ((float)delta_x) / ((float)synaptics::units_per_mm_x);
-    float delta_y_mm = ((float)delta_y) / ((float)synaptics::units_per_mm_y);
-    // Precision for low speed and range for high speed. If there are more than
-    // one finger the speed needs to be doubled.
-    float velocity = sqrt(delta_x_mm * delta_x_mm + delta_y_mm * delta_y_mm);
-    if (finger_count > 1)
-    {
-      velocity *= 2;
-    }
-    float scale_multiplier = 1.0F + velocity * 0.5F; // Emperical constant
-
-    int8_t delta_x_hid =
-        to_hid_value(delta_x, noise_threshold_tracking_x * threshold_multiplier,
-                     scale_tracking_x * scale_multiplier);
-    int8_t delta_y_hid = -to_hid_value(
-        delta_y, noise_threshold_tracking_y * threshold_multiplier,
-        scale_tracking_y * scale_multiplier);
-    if (abs(delta_x_hid) > 0 || abs(delta_y_hid) > 0)
-    {
-      debug_printf("DeltaX: %d, DeltaY: %d\n", delta_x_hid, delta_y_hid);
-      if (tap_and_pan_as_drag_detected || global_tick - tap_and_pan_as_drag_start_tick <= tap_and_pan_as_drag_threshold)
+      // Held buttons (clickpad presses, drags and speculative taps) stay down
+      // across reports, so that the following moves carry them.
+      if (buttons != pressed)
       {
-        tap_and_pan_as_drag_detected = true;
-        button_state = 1;
-        debug_printf("*** Drag Start ***\n");
+        bleMouse.release(pressed & ~buttons);
+        bleMouse.press(buttons & ~pressed);
+        pressed = buttons;
       }
-      else
+      if (item.speculative)
       {
-        button_state = 0;
+        continue;
       }
-      queue_report(button_state, delta_x_hid, delta_y_hid, 0);
-      if (abs(delta_x_hid) > 1 || abs(delta_y_hid) > 1)
-        tap_as_click_reset(4);
-    }
-  }
-}
-
-void parse_extended_packet(uint64_t packet)
-{
-  uint8_t packet_code = (packet >> 44) & 0x0F;
-  if (packet_code == 1)
-  {
-    // Reference: Section 3.2.9.2. Figure 3-14
-    int x = (packet >> 7) & 0x01FE | (packet >> 23) & 0x1E00;
-    int y = (packet >> 15) & 0x01FE | (packet >> 27) & 0x1E00;
-    short z = (packet >> 39) & 0x1D | (packet >> 23) & 0x60;
-
-    if (x == 0 || y == 0 || z == 0)
-    {
-      finger_states[1].x.reset();
-      finger_states[1].y.reset();
-      return;
-    }
-
-    int prev_x = finger_states[1].x.average();
-    int new_x = finger_states[1].x.filter(x);
-    int delta_x = prev_x == 0 ? 0 : new_x - prev_x;
 
-    int prev_y = finger_states[1].y.average();
-    int new_y = finger_states[1].y.filter(y);
-    int delta_y = prev_y == 0 ? 0 : new_y - prev_y;
-
-    if (abs(delta_x) >= max_delta_x || abs(delta_y) >= max_delta_y)
-    {
-      // Sometimes when a 2nd or 3rd finger is released, we receive a secondary
-      // finger position before the finger count change. In this case, the new
-      // secondary finger is not necessarily the same physical finger as
-      // previous one. Not sure if this is by design or due to a packet loss.
-      // In either case, we should not report this position change to avoid
-      // jerky movements. Instead, reset the secondary finger state and start
-      // over.
-      finger_states[1].x.reset();
-      finger_states[1].y.reset();
-      delta_x = 0;
-      delta_y = 0;
-    }
-
-    finger_states[1].x.filter(x);
-    finger_states[1].y.filter(y);
-    finger_states[1].z = z;
-
-    // TODO: use velocity and z value to adjst the multiplier here too, just
-    // like the primary frames. We don't have width info though.
-    if (finger_count >= 2 && button_state == 0)
-    {
-      // Since we are parsing secondary packets, we are here every other frame,
-      // so we should double the noise threshold.
-      bool LR_scroll = abs(delta_x) > abs(delta_y);
-
-      float scroll_amount = 0;
-      if (LR_scroll)
+      if (item.buttons > 0)
       {
-        scroll_amount = to_hid_value(delta_x, noise_threshold_scrolling_x, scale_scroll_x);
+        if (item.buttons == 1)
+        {
+          bleMouse.click(MOUSE_LEFT);
+        }
+        else if (item.buttons == 2)
+        {
+          bleMouse.click(MOUSE_RIGHT);
+        }
+        else if (item.buttons == 3)
+        {
+          bleMouse.click(MOUSE_MIDDLE);
+        }
+        else if (item.buttons == 4)
+        {
+          bleMouse.click(MOUSE_BACK);
+        }
+        else if (item.buttons == 5)
+        {
+          bleMouse.click(MOUSE_FORWARD);
+        }
       }
-      else
+      else if (item.scroll != 0)
       {
-        scroll_amount = to_hid_value(delta_y, noise_threshold_scrolling_y, scale_scroll_y);
+        scroll = decoder::host_scroll(item, decoder::settings);
+        if (item.LR_scroll)
+        {
+          debug_printf("LR Scroll: %d\n", scroll);
+          bleMouse.move(0, 0, 0, scroll);
+        }
+        else
+        {
+          bleMouse.move(0, 0, scroll);
+        }
       }
-      if (abs(LR_scroll ? delta_x : delta_y) <= slow_scroll_threshold)
+      else if (item.x != 0 || item.y != 0)
       {
-        scroll_amount = sign(scroll_amount) * slow_scroll_amount;
+        bleMouse.move(item.x, item.y);
       }
-      debug_printf("Wmode Scroll amount: %f\n", scroll_amount);
-      queue_report(button_state, 0, 0, scroll_amount, LR_scroll);
-    }
-    else
-    {
-      int8_t delta_x_hid = to_hid_value(
-          delta_x, noise_threshold_tracking_x * 2.0F, scale_tracking_x);
-      int8_t delta_y_hid = -to_hid_value(
-          delta_y, noise_threshold_tracking_y * 2.0F, scale_tracking_y);
-      debug_printf("Wmode DeltaX: %d, DeltaY: %d\n", delta_x_hid, delta_y_hid);
-      // queue_report(button_state, delta_x_hid, delta_y_hid, 0);
-      queue_report(0, delta_x_hid, delta_y_hid, 0);
     }
+    core_busy_us[0] += micros() - busy_since;
   }
 }
 
+// Decodes packets and runs the gestures, on core 1 with the PS/2 interrupt.
+// Reports go to outputTask once they can't be frozen anymore.
 void touchpadTask(void *pvParameters)
 {
-  uint64_t packet;
-  int8_t scroll = 0;
+  decoder::captured_packet captured;
+  unsigned long busy_since = micros();
 
   if (mouseEventQueue == NULL)
   {
@@ -703,182 +449,360 @@ void touchpadTask(void *pvParameters)
     // 一旦所有活动停止，触控板会继续发送包含 x、y 和 z 都设置为 0 的数据包，持续一秒钟。
     // 我们只报告第一个数据包。这意味着我们有足够的时间清空报告队列，这是我们需要做的。
     // 否则，队列很快就会堵塞，报告会泄漏到下一次会话中，导致奇怪的行为。
-    global_tick++;
-    if (global_tick - session_started_tick >= frames_delay)
+    tuning::Settings changed;
+    if (xQueueReceive(settingsQueue, &changed, 0))
     {
-      if (!reports.empty())
+      decoder::apply_settings(changed);
+      if (!decoder::settings.absolute_mode)
       {
-        report item = reports.pop_front();
-        // hid::report(item.buttons, item.x, item.y, item.scroll);
-        info_printf("Buttons: %d, X: %d, Y: %d, Scroll: %d, LR_Scroll: %d\n", item.buttons, item.x, item.y, item.scroll, item.LR_scroll);
-
-        // 如果和上次的一样，就不传了
-        // if (item.buttons == previousItem.buttons && item.x == previousItem.x && item.y == previousItem.y && item.scroll == previousItem.scroll)
-        // {
-        //   continue;
-        // }
-
-        if (bleMouse.isConnected())
-        {
-          if (item.buttons > 0)
-          {
-            if (item.buttons == 1)
-            {
-              if (item.x != 0 || item.y != 0)
-              {
-                if (tap_and_pan_as_drag_detected)
-                {
-                  debug_println("*** Drag press ***");
-                  bleMouse.press(MOUSE_LEFT);
-                }
-                bleMouse.move(item.x, item.y);
-              }
-              else
-              {
-                bleMouse.click(MOUSE_LEFT);
-              }
-            }
-            else if (item.buttons == 2)
-            {
-              bleMouse.click(MOUSE_RIGHT);
-            }
-            else if (item.buttons == 3)
-            {
-              bleMouse.click(MOUSE_MIDDLE);
-            }
-            else if (item.buttons == 4)
-            {
-              bleMouse.click(MOUSE_BACK);
-            }
-            else if (item.buttons == 5)
-            {
-              bleMouse.click(MOUSE_FORWARD);
-            }
-          }
-          else
-          {
-
-            if (item.scroll != 0)
-            {
-              if ((reverse_UD_scroll && !item.LR_scroll) || (reverse_LR_scroll && item.LR_scroll))
-                scroll = -item.scroll;
-              else
-                scroll = item.scroll;
-              if (item.LR_scroll)
-              {
-                debug_printf("LR Scroll: %d\n", scroll);
-                bleMouse.move(0, 0, 0, scroll);
-              }
-              else
-              {
-                bleMouse.move(0, 0, scroll);
-              }
-            }
-            else if (item.x != 0 || item.y != 0)
-            {
-
-              bleMouse.move(item.x, item.y);
-            }
-            else
-            {
-              if (tap_and_pan_as_drag_detected)
-              {
-                tap_and_pan_as_drag_detected = false;
-                tap_and_pan_as_drag_start_tick = 0;
-                bleMouse.release(MOUSE_LEFT);
-                debug_println("*** Drag released ***");
-              }
-            }
-          }
-        }
-        // previousItem = item;
+        decoder::lift_pen();
       }
+      info_println("Tuning applied.");
     }
 
-    if (xQueueReceive(mouseEventQueue, &packet, pdMS_TO_TICKS(10)))
+    decoder::tick();
+
+    // 空闲且没有报告要发送时，一直等到下一个数据包
+    TickType_t wait = idle && decoder::delayed_reports() == 0 ? portMAX_DELAY : pdMS_TO_TICKS(10);
+    core_busy_us[1] += micros() - busy_since;
+    BaseType_t received = xQueueReceive(mouseEventQueue, &captured, wait);
+    busy_since = micros();
+    if (received)
     {
-      // 处理packet数据
-      uint8_t w = (packet >> 26) & 0x01 | (packet >> 1) & 0x2 | (packet >> 2) & 0x0C;
-      switch (w) // 文档 3.2.6 节，Figure 3-9
+      last_packet_ms = millis();
+      packets_decoded++;
+      if (idle)
       {
-      case 3: // 当w=3时，表示是Pass-Through encapsulation packet（直通式封装数据包）
-        break;
-      case 2: // 当w=2时，表示是Extended W mode packet（扩展W模式数据包）
-        parse_extended_packet(packet);
-        break;
-      default: // 当w=0或w=1时，表示是capMultiFinger，0是两根手指，1是三根及以上手指
-        parse_primary_packet(packet, w);
-        break;
+        // The packet that woke us up is still decoded below.
+        leave_idle();
       }
-    }
 
-    // vTaskDelay(xDelay);
+      if (capture_packets)
+      {
+        uint64_t p = captured.packet;
+        trace::event(trace::TRACE_PACKET, p & 0xFF, (p >> 8) & 0xFF, (p >> 16) & 0xFF, (p >> 24) & 0xFF,
+                     (p >> 32) & 0xFF, (p >> 40) & 0xFF);
+      }
+      decoder::decode(captured);
+      update_cpu_level(true);
+
+      // Between two packets, the next one being a frame away. A packet the
+      // commands cut short is dropped by the decoder.
+      if (rate_change_pending && uxQueueMessagesWaiting(mouseEventQueue) == 0)
+      {
+        rate_change_pending = false;
+        synaptics::set_high_rate(true);
+        decoder::resync();
+      }
+    }
+    // A mouse or pointing stick sends nothing while it is held still, so a
+    // button held on it doesn't time out.
+    else if (!idle && decoder::delayed_reports() == 0 && !decoder::guest_buttons_held() &&
+             millis() - last_packet_ms >= decoder::settings.idle_timeout_ms)
+    {
+      enter_idle();
+    }
+    else
+    {
+      update_cpu_level(false);
+    }
   }
 }
 
+// Prints where the memory went, once BLE is up. Stack sizes are in bytes, and
+// "left" is the least free stack the task ever had.
+void print_memory_budget()
+{
+  Serial.println("Memory budget:");
+  Serial.printf("  %-14s %8u bytes\n", "heap free", heap_caps_get_free_size(MALLOC_CAP_8BIT));
+  Serial.printf("  %-14s %8u bytes\n", "heap min free", heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT));
+  Serial.printf("  %-14s %8u bytes\n", "largest block", heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+  Serial.printf("  %-14s %8s %8s\n", "task", "stack", "left");
+  Serial.printf("  %-14s %8u %8u\n", "TouchpadTask", touchpad_stack_size,
+                uxTaskGetStackHighWaterMark(touchpadTaskHandle));
+  Serial.printf("  %-14s %8u %8u\n", "OutputTask", output_stack_size,
+                uxTaskGetStackHighWaterMark(outputTaskHandle));
+  Serial.printf("  %-14s %8u %8u\n", "loopTask", CONFIG_ARDUINO_LOOP_STACK_SIZE,
+                uxTaskGetStackHighWaterMark(NULL));
+  Serial.printf("  %-14s %8s %8u (deleted)\n", "BLE setup", "-", bleMouse.setupStackHighWater());
+}
+
 void setup()
 {
   Serial.begin(115200);
   delay(1000);
   Serial.println("ESP32 Touchpad Test");
-  bleMouse.begin();
+  trace::begin();
+
+  // 读取可调参数，调参服务在蓝牙启动时就要用到
+  if (tuning::load(decoder::settings))
+  {
+    Serial.println("Tuning loaded from NVS.");
+  }
 
   // 创建队列 - 在使用之前必须先创建
-  mouseEventQueue = xQueueCreate(32, sizeof(uint64_t)); // 32是队列长度
-  if (mouseEventQueue == NULL)
+  mouseEventQueue = xQueueCreateStatic(packet_queue_length, sizeof(decoder::captured_packet),
+                                       packet_queue_storage, &packet_queue_buffer);
+  settingsQueue = xQueueCreateStatic(1, sizeof(tuning::Settings), settings_queue_storage,
+                                     &settings_queue_buffer);
+  if (mouseEventQueue == NULL || settingsQueue == NULL)
   {
     Serial.println("Queue creation failed!");
     while (1)
       ; // 如果队列创建失败，停止运行
   }
 
+  bleMouse.begin();
+
+  // 解析流程要在第一个字节到来之前准备好
+  decoder::begin(decoder::settings, {.report_ready = report_ready,
+                                     .wait_for_output = wait_for_output,
+                                     .save_calibration = request_save});
+
   // 初始化PS2通信
+#ifdef SIMULATED_TOUCHPAD
+  ps2::begin(simulated_touchpad, byte_received);
+#else
   ps2::begin(CLOCK_PIN, DATA_PIN, byte_received);
+#endif
   ps2::reset();
   synaptics::init();
+#ifdef SIMULATED_TOUCHPAD
+  // 每 12.5ms 一帧，和真实触控板一样在核心1的中断里送出数据包
+  simulated_timer = timerBegin(0, 80, true);
+  timerAttachInterrupt(simulated_timer, simulated_frame, true);
+  timerAlarmWrite(simulated_timer, 12500, true);
+  timerAlarmEnable(simulated_timer);
+#endif
 
-  // 初始化变量
-  scale_tracking_x = scale_tracking_mm / synaptics::units_per_mm_x;
-  scale_tracking_y = scale_tracking_mm / synaptics::units_per_mm_y;
-  scale_scroll_x = scale_scroll_mm / synaptics::units_per_mm_x;
-  scale_scroll_y = scale_scroll_mm / synaptics::units_per_mm_y;
-  noise_threshold_tracking_x =
-      noise_threshold_tracking_mm * synaptics::units_per_mm_x;
-  noise_threshold_tracking_y =
-      noise_threshold_tracking_mm * synaptics::units_per_mm_y;
-  noise_threshold_scrolling_x =
-      noise_threshold_scrolling_mm * synaptics::units_per_mm_x;
-  noise_threshold_scrolling_y =
-      noise_threshold_scrolling_mm * synaptics::units_per_mm_y;
-  max_delta_x = max_delta_mm * synaptics::units_per_mm_x;
-  max_delta_y = max_delta_mm * synaptics::units_per_mm_y;
-  slow_scroll_threshold = slow_scroll_threshold_mm * synaptics::units_per_mm_y;
-  proximity_threshold_x = proximity_threshold_mm * synaptics::units_per_mm_x;
-  proximity_threshold_y = proximity_threshold_mm * synaptics::units_per_mm_y;
+  // 按触控板报告的尺寸重新计算可调参数派生的变量
+  decoder::apply_settings(decoder::settings);
+
+#if CONFIG_PM_ENABLE
+  // The CPU runs at the minimum frequency unless update_cpu_level() holds the
+  // maximum one. Light sleep is entered automatically whenever all tasks are
+  // blocked, which is only allowed while the touchpad is idle.
+  esp_pm_config_esp32_t pm_config = {
+      .max_freq_mhz = 240, .min_freq_mhz = 80, .light_sleep_enable = light_sleep};
+  esp_pm_configure(&pm_config);
+  esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "burst", &cpu_max_lock);
+  if (light_sleep)
+  {
+    esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "touchpad", &no_sleep_lock);
+    esp_pm_lock_acquire(no_sleep_lock);
+  }
+#else
+  Serial.println("CPU frequency scaling and light sleep need CONFIG_PM_ENABLE.");
+#endif
+  if (light_sleep)
+  {
+    esp_sleep_enable_gpio_wakeup();
+  }
+  cpu_level_since_ms = millis();
 
   // 初始化任务看门狗
   esp_task_wdt_init(100, true); // 100ms超时，任务看门狗启用
 
-  // 创建触摸板处理任务
-  xTaskCreatePinnedToCore(
+  // 创建报告发送任务，和蓝牙协议栈一起在核心0上运行，优先级低于协议栈的任务
+  outputTaskHandle = xTaskCreateStaticPinnedToCore(
+      outputTask,          // 任务函数
+      "OutputTask",        // 任务名称
+      output_stack_size,   // 堆栈大小
+      NULL,                // 参数
+      10,                  // 优先级
+      output_stack,        // 堆栈
+      &output_task_buffer, // 任务控制块
+      0                    // 在核心0上运行
+  );
+
+  // 创建触摸板处理任务，和 PS/2 中断（在 setup 所在的核心1上注册）一起运行
+  touchpadTaskHandle = xTaskCreateStaticPinnedToCore(
       touchpadTask,             // 任务函数
       "TouchpadTask",           // 任务名称
-      4096,                     // 堆栈大小
+      touchpad_stack_size,      // 堆栈大小
       NULL,                     // 参数
       configMAX_PRIORITIES - 1, // 优先级
-      NULL,                     // 任务句柄
-      0                         // 在核心0上运行
+      touchpad_stack,           // 堆栈
+      &touchpad_task_buffer,    // 任务控制块
+      1                         // 在核心1上运行
   );
 
   // 将当前运行的核心（通常是核心0）添加到看门狗
   esp_task_wdt_add(NULL);
 }
 
+// Serial commands for tools/tuning_block.py:
+//   tuning          prints the current block in hex
+//   tuning <hex>    applies and saves a block
+//   tuning reset    applies and saves the defaults
+void handle_tuning_command(String line)
+{
+  uint8_t block[tuning::block_size];
+  tuning::Settings changed = tuning::defaults;
+  line.trim();
+  if (!line.startsWith("tuning"))
+  {
+    return;
+  }
+  String argument = line.substring(6);
+  argument.trim();
+
+  if (argument.length() == 0)
+  {
+    // Settings are only written by the touchpad task. A torn read here just
+    // prints a block with a bad CRC, which the tool rejects.
+    size_t length = tuning::encode(decoder::settings, block, sizeof(block));
+    for (size_t i = 0; i < length; i++)
+    {
+      Serial.printf("%02x", block[i]);
+    }
+    Serial.println();
+    return;
+  }
+
+  if (argument != "reset")
+  {
+    size_t length = argument.length() / 2;
+    if (argument.length() % 2 != 0 || length > sizeof(block))
+    {
+      Serial.println("Tuning block has a bad length.");
+      return;
+    }
+    for (size_t i = 0; i < length; i++)
+    {
+      block[i] = strtoul(argument.substring(i * 2, i * 2 + 2).c_str(), NULL, 16);
+    }
+    if (!tuning::decode(block, length, changed))
+    {
+      Serial.println("Tuning block rejected.");
+      return;
+    }
+  }
+
+  queue_settings(changed);
+  tuning::update_service(changed);
+  Serial.println(tuning::save(changed) ? "Tuning saved." : "Tuning could not be saved.");
+}
+
+// Serial commands for tools/trace_decode.py --capture, which writes the
+// packets out as a capture for tools/gesture_trace.py:
+//   capture on      traces every packet received from the pad
+//   capture off     stops it
+void handle_capture_command(String line)
+{
+  line.trim();
+  if (line == "capture on" || line == "capture off")
+  {
+    capture_packets = line == "capture on";
+    Serial.println(capture_packets ? "Capturing packets." : "Capture stopped.");
+  }
+}
+
 void loop()
 {
   // 主循环喂狗
   esp_task_wdt_reset();
 
+  static bool budget_printed = false;
+  if (!budget_printed && bleMouse.isStarted())
+  {
+    print_memory_budget();
+    budget_printed = true;
+  }
+
+  if (Serial.available())
+  {
+    String line = Serial.readStringUntil('\n');
+    handle_tuning_command(line);
+    handle_capture_command(line);
+  }
+
+  if (save_pending)
+  {
+    portENTER_CRITICAL(&save_mux);
+    tuning::Settings values = settings_to_save;
+    save_pending = false;
+    portEXIT_CRITICAL(&save_mux);
+    tuning::update_service(values);
+    // Only the calibration is saved. Whatever else is in effect may be a
+    // change over BLE that hasn't been saved on purpose, so it is left as
+    // it is stored.
+    tuning::Settings stored;
+    tuning::load(stored);
+    stored.noise_floor_x_mm = values.noise_floor_x_mm;
+    stored.noise_floor_y_mm = values.noise_floor_y_mm;
+    if (!tuning::save(stored))
+    {
+      Serial.println("Tuning could not be saved.");
+    }
+  }
+
+  // Load of the pipeline on each core, in percent of the time since the last
+  // round, and how deep the queues between the stages are.
+  static unsigned long load_since = micros();
+  static uint32_t busy_before[2] = {0, 0};
+  unsigned long now = micros();
+  uint8_t output_load = (core_busy_us[0] - busy_before[0]) * 100ULL / max(now - load_since, 1UL);
+  uint8_t decode_load = (core_busy_us[1] - busy_before[1]) * 100ULL / max(now - load_since, 1UL);
+  busy_before[0] = core_busy_us[0];
+  busy_before[1] = core_busy_us[1];
+  load_since = now;
+  UBaseType_t packet_queue_depth = uxQueueMessagesWaiting(mouseEventQueue);
+  // The counters are written by the touchpad task. Being off by one packet
+  // doesn't matter here.
+  const decoder::Stats &decoded = decoder::stats();
+  if (!idle)
+  {
+    info_printf("Load, output (core 0): %d%%, decode (core 1): %d%%, packets waiting: %d, "
+                "reports delayed: %d, folded: %lu, channel max: %d, overflows: %lu, waits: %lu\n",
+                output_load, decode_load, (int)packet_queue_depth, decoder::delayed_reports(),
+                (unsigned long)decoder::folded_reports(), decoded.channel_max_depth,
+                (unsigned long)decoded.channel_overflows, (unsigned long)decoded.channel_waits);
+    const ps2::Stats &line = ps2::stats();
+    info_printf("PS/2 line, parity: %lu, framing: %lu, timeouts: %lu, resends: %lu, "
+                "nacks: %lu, overruns: %lu\n",
+                (unsigned long)line.parity_errors, (unsigned long)line.framing_errors,
+                (unsigned long)line.timeouts, (unsigned long)line.resends,
+                (unsigned long)line.nacks, (unsigned long)line.overruns);
+    // Received against expected, expected being received plus lost.
+    uint32_t frames_expected = decoded.frames_received + decoded.frames_lost;
+    info_printf("Frames, received: %lu of %lu (%lu.%lu%%), interpolated: %lu\n",
+                (unsigned long)decoded.frames_received, (unsigned long)frames_expected,
+                (unsigned long)(decoded.frames_received * 1000ULL / max(frames_expected, (uint32_t)1) / 10),
+                (unsigned long)(decoded.frames_received * 1000ULL / max(frames_expected, (uint32_t)1) % 10),
+                (unsigned long)decoded.frames_interpolated);
+    // False clicks are speculative presses taken back because the touch was
+    // no tap after all.
+    info_printf("Taps, clicks: %lu, mean latency: %lu ticks, speculative: %lu, false: %lu, "
+                "taken over by drags: %lu, palms: %lu\n",
+                (unsigned long)decoded.tap_clicks,
+                (unsigned long)(decoded.tap_click_ticks / max(decoded.tap_clicks, (uint32_t)1)),
+                (unsigned long)decoded.speculative_clicks, (unsigned long)decoded.speculative_cancels,
+                (unsigned long)decoded.speculative_drags, (unsigned long)decoded.palms);
+  }
+
+  if (bleMouse.isConnected())
+  {
+    tuning::Stats stats = {.packets = packets_decoded,
+                           .reports = reports_sent,
+                           .packet_errors = decoded.packet_errors,
+                           .finger_matches = decoded.finger_matches,
+                           .finger_resets = decoded.finger_resets,
+                           .speculative_clicks = decoded.speculative_clicks,
+                           .speculative_cancels = decoded.speculative_cancels,
+                           .report_depth = (uint16_t)decoder::delayed_reports(),
+                           .cpu_level = (uint8_t)cpu_current,
+                           .idle = (uint8_t)idle,
+                           .output_load = output_load,
+                           .decode_load = decode_load,
+                           .packet_queue_depth = (uint8_t)packet_queue_depth,
+                           .channel_max_depth = (uint8_t)decoded.channel_max_depth,
+                           .channel_overflows = decoded.channel_overflows,
+                           .frames_received = decoded.frames_received,
+                           .frames_lost = decoded.frames_lost};
+    tuning::notify_stats(stats);
+  }
+
   // 可以在这里添加其他非关键任务
   delay(1000);
 }
\ No newline at end of file
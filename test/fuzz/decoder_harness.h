@@ -0,0 +1,190 @@
+// decoder_harness.h
+#ifndef DECODER_HARNESS_H
+#define DECODER_HARNESS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <decoder.h>
+
+// Drives the decoder with arbitrary bytes off the line, the way the touchpad
+// task does, and checks what has to hold whatever the bytes are:
+//
+//   - every report the host gets is in range,
+//   - the report delay stays bounded and empties once the pad is quiet,
+//   - once the fingers lift and the guest lets go, no button is held, and
+//     no pen is down.
+//
+// Out of bounds accesses are left to the sanitizers. The first byte of the
+// input picks the device and the settings, the rest is the stream. Shared
+// by fuzz_decoder.cpp, for libFuzzer, and by test/test_fuzz, which replays
+// inputs on every test run.
+namespace harness
+{
+
+  // Microseconds per byte at 80 packets of 6 bytes per second.
+  const uint32_t byte_micros = 2083;
+  const int delayed_reports_max = 32;
+
+  struct Run
+  {
+    decoder::Buttons buttons;
+    uint8_t pen;
+    int packets;
+    int drain_every; // packets between two rounds of the consumer
+    const char *failure;
+  };
+
+  inline Run &run_state()
+  {
+    static Run run;
+    return run;
+  }
+
+  inline void fail(const char *failure)
+  {
+    if (run_state().failure == nullptr)
+    {
+      run_state().failure = failure;
+    }
+  }
+
+  // The output task: takes every report out of the channel and checks it.
+  inline void drain()
+  {
+    Run &run = run_state();
+    decoder::report item;
+    while (decoder::next_report(item))
+    {
+      if (item.absolute)
+      {
+        if ((item.pen & ~(PEN_TIP | PEN_BARREL | PEN_IN_RANGE)) != 0 || item.position_x > PEN_MAX ||
+            item.position_y > PEN_MAX || item.pressure > PEN_PRESSURE_MAX)
+        {
+          fail("pen report out of range");
+        }
+        run.pen = item.pen;
+        continue;
+      }
+      if (item.buttons > 5 || item.x == -128 || item.y == -128 || item.scroll == -128)
+      {
+        fail("report out of range");
+      }
+      if ((item.held_buttons & ~(MOUSE_LEFT | MOUSE_RIGHT | MOUSE_MIDDLE)) != 0)
+      {
+        fail("held buttons out of range");
+      }
+      run.buttons.update(item);
+    }
+  }
+
+  inline void feed(const uint8_t *bytes, size_t size, uint32_t &now)
+  {
+    Run &run = run_state();
+    for (size_t i = 0; i < size; i++)
+    {
+      now += byte_micros;
+      decoder::captured_packet packet;
+      if (decoder::frame_byte(bytes[i], now, packet))
+      {
+        decoder::decode(packet);
+        if (++run.packets % run.drain_every == 0)
+        {
+          drain();
+        }
+      }
+      // The touchpad task ticks once per packet period.
+      if (i % 6 == 5)
+      {
+        decoder::tick();
+      }
+      if (decoder::delayed_reports() > delayed_reports_max)
+      {
+        fail("report delay overflowed");
+      }
+    }
+  }
+
+  // Returns nullptr if every check held, or the first one that didn't.
+  inline const char *run(const uint8_t *data, size_t size)
+  {
+    if (size == 0)
+    {
+      return nullptr;
+    }
+    uint8_t config = data[0];
+    const synaptics::Protocol protocols[] = {synaptics::Protocol::Synaptics, synaptics::Protocol::IntelliMouse,
+                                             synaptics::Protocol::Mouse, synaptics::Protocol::Synaptics};
+    synaptics::protocol = protocols[config & 0x03];
+    synaptics::pass_through = config & 0x04;
+    tuning::Settings settings = tuning::defaults;
+    settings.absolute_mode = config & 0x08;
+    settings.speculative_tap = config & 0x10;
+    settings.deep_press_button = config & 0x20 ? 1 : 0;
+    // The consumer may fall behind, so that the channel fills up.
+    const int drain_every[] = {1, 4, 16, 64};
+
+    Run &run = run_state();
+    run = Run();
+    run.drain_every = drain_every[config >> 6];
+    decoder::Hooks hooks = {.report_ready = nullptr, .wait_for_output = drain, .save_calibration = nullptr};
+    decoder::begin(settings, hooks);
+
+    uint32_t now = 0;
+    feed(data + 1, size - 1, now);
+
+    // A line that has gone quiet in the middle of a packet drops it, and
+    // then the pad sends its lifted fingers, and the guest its buttons up.
+    decoder::captured_packet partial;
+    for (int i = 0; i < 5 && !decoder::frame_byte(0, now, partial); i++)
+    {
+    }
+    now += 1000000;
+    if (synaptics::protocol == synaptics::Protocol::Synaptics)
+    {
+      // w = 4, z = 0 and no button, then a guest packet with nothing held.
+      const uint8_t lifted[] = {0x90, 0x00, 0x00, 0xC0, 0x00, 0x00};
+      const uint8_t guest[] = {0x84, 0x08, 0x00, 0xC4, 0x00, 0x00};
+      for (int i = 0; i < 3; i++)
+      {
+        feed(lifted, sizeof(lifted), now);
+      }
+      feed(guest, sizeof(guest), now);
+    }
+    else
+    {
+      const uint8_t released[] = {0x08, 0x00, 0x00, 0x00};
+      size_t length = synaptics::protocol == synaptics::Protocol::IntelliMouse ? 4 : 3;
+      feed(released, length, now);
+    }
+    for (int i = 0; i < settings.frames_delay + 2; i++)
+    {
+      decoder::tick();
+    }
+    drain();
+    if (decoder::delayed_reports() != 0)
+    {
+      fail("reports still delayed after the fingers lifted");
+    }
+    if (run.buttons.held() != 0)
+    {
+      fail("a button is still held after the fingers lifted");
+    }
+    if (run.pen != 0)
+    {
+      fail("the pen is still down after the fingers lifted");
+    }
+
+    // And going idle lets go of everything, whatever was left.
+    decoder::release_buttons();
+    decoder::lift_pen();
+    drain();
+    if (run.buttons.held() != 0 || run.pen != 0)
+    {
+      fail("a button or the pen is still held after going idle");
+    }
+    return run.failure;
+  }
+
+} // namespace harness
+
+#endif // DECODER_HARNESS_H
@@ -0,0 +1,19 @@
+// libFuzzer target for the decoder, built by `pio run -e fuzz` and run as
+//
+//   .pio/build/fuzz/program -max_total_time=60
+//
+// See decoder_harness.h for what it checks.
+#include <cstdio>
+#include <cstdlib>
+#include "decoder_harness.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  const char *failure = harness::run(data, size);
+  if (failure != nullptr)
+  {
+    fprintf(stderr, "decoder: %s\n", failure);
+    abort();
+  }
+  return 0;
+}
@@ -0,0 +1,170 @@
+// replay.h
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <ps2.h>
+#include <synaptics.h>
+#include <simulated_synaptics.h>
+#include <decoder.h>
+
+// Replays a script of the simulated pad through synaptics::init() and the
+// decoder, the way the firmware runs them, and keeps what the host would see:
+//
+//   replay::Frames frames = replay::record(script, length, 400);
+//   replay::Host host = replay::play(frames, settings);
+//
+// A frame is 1/80 s, with a tick of the decoder each. Header-only, for the
+// test suites of the decoder.
+namespace replay
+{
+
+  using Step = ps2::SimulatedSynaptics::Step;
+  using Device = ps2::SimulatedSynaptics::Device;
+
+  const uint32_t frame_us = 1000000 / 80;
+  const uint32_t byte_us = 1100;
+
+  // The bytes the device sent in each frame, none at the low rate every
+  // other one.
+  typedef std::vector<std::vector<uint8_t>> Frames;
+
+  inline std::vector<uint8_t> &received()
+  {
+    static std::vector<uint8_t> bytes;
+    return bytes;
+  }
+
+  inline void byte_received(uint8_t data) { received().push_back(data); }
+
+  // Finds the device with synaptics::init() and records frames frames of
+  // the script.
+  inline Frames record(const Step *script, size_t length, int frames, Device device = Device::Synaptics)
+  {
+    ps2::SimulatedSynaptics pad(script, length, device);
+    ps2::begin(pad, byte_received);
+    ps2::reset();
+    synaptics::init();
+    Frames result;
+    for (int i = 0; i < frames; i++)
+    {
+      received().clear();
+      pad.frame();
+      result.push_back(received());
+    }
+    received().clear();
+    return result;
+  }
+
+  // How many frames the script takes.
+  inline int length_of(const Step *script, size_t length)
+  {
+    int frames = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+      frames += script[i].frames;
+    }
+    return frames;
+  }
+
+  // A report as the host got it, and when.
+  struct Received
+  {
+    int frame;
+    decoder::report item;
+    uint8_t held; // the buttons the host holds after it
+  };
+
+  struct Host
+  {
+    std::vector<Received> reports;
+    std::vector<uint8_t> held; // the buttons the host holds after each frame
+    long x;
+    long y;
+    long scroll; // as the host gets it, see decoder::host_scroll()
+    int clicks[6]; // by the buttons of a tap report
+    decoder::Stats stats;
+
+    // How many times the buttons in mask went down.
+    int presses(uint8_t mask) const
+    {
+      int count = 0;
+      uint8_t last = 0;
+      for (uint8_t buttons : held)
+      {
+        count += (buttons & mask) != 0 && (last & mask) == 0;
+        last = buttons;
+      }
+      return count;
+    }
+
+    // The first frame at or after from in which a button in mask is held,
+    // or a click of it, or -1.
+    int first_press(uint8_t mask, int from = 0) const
+    {
+      for (const Received &received : reports)
+      {
+        bool clicked = received.item.buttons != 0 && (1 << (received.item.buttons - 1)) & mask;
+        if (received.frame >= from && ((received.held & mask) != 0 || clicked))
+        {
+          return received.frame;
+        }
+      }
+      return -1;
+    }
+  };
+
+  // Runs the decoder over frames with values, and then over quiet frames
+  // until the report delay is empty. The pad is whatever record() found.
+  inline Host play(const Frames &frames, const tuning::Settings &values, int quiet_frames = 40)
+  {
+    Host host = {};
+    decoder::Buttons buttons;
+    decoder::begin(values, {.report_ready = nullptr, .wait_for_output = nullptr, .save_calibration = nullptr});
+
+    int total = frames.size() + quiet_frames;
+    for (int frame = 0; frame < total; frame++)
+    {
+      uint32_t start = frame * frame_us;
+      if (frame < (int)frames.size())
+      {
+        const std::vector<uint8_t> &bytes = frames[frame];
+        for (size_t i = 0; i < bytes.size(); i++)
+        {
+          decoder::captured_packet packet;
+          if (decoder::frame_byte(bytes[i], start + i * byte_us, packet))
+          {
+            decoder::decode(packet);
+          }
+        }
+      }
+      decoder::tick();
+
+      decoder::report item;
+      while (decoder::next_report(item))
+      {
+        uint8_t held = buttons.update(item);
+        host.reports.push_back({frame, item, held});
+        if (item.absolute || item.speculative)
+        {
+          continue;
+        }
+        host.x += item.x;
+        host.y += item.y;
+        host.scroll += decoder::host_scroll(item, values);
+        if (item.buttons < 6)
+        {
+          host.clicks[item.buttons]++;
+        }
+      }
+      host.held.push_back(buttons.held());
+    }
+    host.stats = decoder::stats();
+    return host;
+  }
+
+} // namespace replay
+
+#endif // REPLAY_H
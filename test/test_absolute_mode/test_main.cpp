@@ -0,0 +1,222 @@
+// The absolute mode end to end: a region of the simulated pad mapped to the
+// whole screen, as pen reports, in scripts through the decoder.
+#include <unity.h>
+#include "../replay/replay.h"
+
+namespace
+{
+  typedef ps2::SimulatedSynaptics Pad;
+
+  // The region of the tuning below, in touchpad units.
+  const int left = Pad::min_x + (Pad::max_x - Pad::min_x) * 100 / 1000;
+  const int right = Pad::min_x + (Pad::max_x - Pad::min_x) * 900 / 1000;
+  const int bottom = Pad::min_y + (Pad::max_y - Pad::min_y) * 200 / 1000;
+  const int top = Pad::min_y + (Pad::max_y - Pad::min_y) * 800 / 1000;
+
+#define CONTACT(x, y) {(int16_t)(x), (int16_t)(y), 60, 6}
+#define LIFTED {0, 0, 0, 0}
+#define NOTHING(frames) {(frames), 0, false, {LIFTED, LIFTED}, {LIFTED, LIFTED}}
+#define HOVER(frames, x, y) {(frames), 1, false, {CONTACT(x, y), LIFTED}, {CONTACT(x, y), LIFTED}}
+  // The top left and bottom right corners of the region, and then the same
+  // corners of the pad, beyond the region.
+  replay::Step corners[] = {
+      NOTHING(4),
+      HOVER(4, left, top),
+      NOTHING(4),
+      HOVER(4, right, bottom),
+      NOTHING(4),
+      HOVER(4, Pad::min_x + 10, Pad::max_y - 10),
+      NOTHING(4),
+      HOVER(4, Pad::max_x - 10, Pad::min_y + 10),
+      NOTHING(4),
+  };
+  // A finger going up the pad.
+  replay::Step upwards[] = {
+      NOTHING(4),
+      {20, 1, false, {CONTACT(3000, 2000), LIFTED}, {CONTACT(3000, 3800), LIFTED}},
+      NOTHING(4),
+  };
+  // A press with one finger, and then with two.
+  replay::Step presses[] = {
+      NOTHING(4),
+      HOVER(4, 3000, 3000),
+      {6, 1, true, {CONTACT(3000, 3000), LIFTED}, {CONTACT(3000, 3000), LIFTED}},
+      HOVER(4, 3000, 3000),
+      NOTHING(4),
+      {4, 2, false, {CONTACT(3000, 3000), CONTACT(3600, 3000)}, {CONTACT(3000, 3000), CONTACT(3600, 3000)}},
+      {8, 2, true, {CONTACT(3000, 3000), CONTACT(3600, 3000)}, {CONTACT(3000, 3000), CONTACT(3600, 3000)}},
+      {4, 2, false, {CONTACT(3000, 3000), CONTACT(3600, 3000)}, {CONTACT(3000, 3000), CONTACT(3600, 3000)}},
+      NOTHING(4),
+  };
+  // Hovers to a spot and lifts there, or stays on the pad.
+  replay::Step hover_and_lift[] = {
+      NOTHING(4),
+      {12, 1, false, {CONTACT(2000, 2000), LIFTED}, {CONTACT(4200, 3600), LIFTED}},
+      NOTHING(4),
+  };
+#undef HOVER
+#undef NOTHING
+#undef CONTACT
+#undef LIFTED
+
+  tuning::Settings absolute()
+  {
+    tuning::Settings values = tuning::defaults;
+    values.absolute_mode = true;
+    values.absolute_left = 100;
+    values.absolute_right = 900;
+    values.absolute_bottom = 200;
+    values.absolute_top = 800;
+    return values;
+  }
+
+  replay::Host play(const replay::Step *script, size_t length)
+  {
+    replay::Frames frames = replay::record(script, length, replay::length_of(script, length));
+    return replay::play(frames, absolute());
+  }
+
+  // The pen reports, each ending with the pen lifted out of range.
+  std::vector<decoder::report> pens(const replay::Host &host)
+  {
+    std::vector<decoder::report> result;
+    for (const replay::Received &received : host.reports)
+    {
+      TEST_ASSERT_TRUE(received.item.absolute);
+      result.push_back(received.item);
+    }
+    return result;
+  }
+
+  // The first report of each touch.
+  std::vector<decoder::report> touches(const replay::Host &host)
+  {
+    std::vector<decoder::report> result;
+    bool lifted = true;
+    for (const decoder::report &item : pens(host))
+    {
+      if (lifted && item.pen != 0)
+      {
+        result.push_back(item);
+      }
+      lifted = item.pen == 0;
+    }
+    return result;
+  }
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_region_corners_map_to_the_screen_corners()
+{
+  std::vector<decoder::report> first = touches(play(corners, sizeof(corners) / sizeof(corners[0])));
+
+  TEST_ASSERT_EQUAL_INT(4, (int)first.size());
+  TEST_ASSERT_EQUAL_UINT8(PEN_IN_RANGE, first[0].pen);
+  TEST_ASSERT_EQUAL_UINT16(0, first[0].position_x);
+  TEST_ASSERT_EQUAL_UINT16(0, first[0].position_y);
+  TEST_ASSERT_EQUAL_UINT16(PEN_MAX, first[1].position_x);
+  TEST_ASSERT_EQUAL_UINT16(PEN_MAX, first[1].position_y);
+}
+
+void test_pen_stays_on_the_edge_beyond_the_region()
+{
+  std::vector<decoder::report> first = touches(play(corners, sizeof(corners) / sizeof(corners[0])));
+
+  TEST_ASSERT_EQUAL_INT(4, (int)first.size());
+  TEST_ASSERT_EQUAL_UINT16(0, first[2].position_x);
+  TEST_ASSERT_EQUAL_UINT16(0, first[2].position_y);
+  TEST_ASSERT_EQUAL_UINT16(PEN_MAX, first[3].position_x);
+  TEST_ASSERT_EQUAL_UINT16(PEN_MAX, first[3].position_y);
+}
+
+void test_y_points_down_the_screen()
+{
+  std::vector<decoder::report> reports = pens(play(upwards, sizeof(upwards) / sizeof(upwards[0])));
+
+  TEST_ASSERT_TRUE(reports.size() > 10);
+  int last = PEN_MAX + 1;
+  for (const decoder::report &item : reports)
+  {
+    if (item.pen == 0)
+    {
+      continue;
+    }
+    TEST_ASSERT_TRUE(item.position_y < last);
+    last = item.position_y;
+  }
+}
+
+void test_press_puts_the_tip_down_and_two_fingers_the_barrel()
+{
+  std::vector<decoder::report> reports = pens(play(presses, sizeof(presses) / sizeof(presses[0])));
+
+  int tip = 0;
+  int barrel = 0;
+  for (const decoder::report &item : reports)
+  {
+    if (item.pen & PEN_TIP)
+    {
+      TEST_ASSERT_TRUE(item.pressure > 0);
+      tip++;
+      barrel += (item.pen & PEN_BARREL) != 0;
+    }
+    else
+    {
+      TEST_ASSERT_EQUAL_UINT8(0, item.pressure);
+      TEST_ASSERT_EQUAL_UINT8(0, item.pen & PEN_BARREL);
+    }
+  }
+  TEST_ASSERT_EQUAL_INT(6 + 8 / 2, tip);
+  TEST_ASSERT_EQUAL_INT(8 / 2, barrel);
+  TEST_ASSERT_EQUAL_UINT8(0, reports.back().pen);
+}
+
+void test_pen_lifts_where_it_was_last_seen()
+{
+  std::vector<decoder::report> reports = pens(play(hover_and_lift, sizeof(hover_and_lift) / sizeof(hover_and_lift[0])));
+
+  TEST_ASSERT_TRUE(reports.size() >= 2);
+  const decoder::report &seen = reports[reports.size() - 2];
+  const decoder::report &lifted = reports.back();
+  TEST_ASSERT_EQUAL_UINT8(PEN_IN_RANGE, seen.pen);
+  TEST_ASSERT_TRUE(seen.position_x > PEN_MAX / 2);
+  TEST_ASSERT_EQUAL_UINT8(0, lifted.pen);
+  TEST_ASSERT_EQUAL_UINT16(seen.position_x, lifted.position_x);
+  TEST_ASSERT_EQUAL_UINT16(seen.position_y, lifted.position_y);
+}
+
+// Leaving the absolute mode with a finger on the pad lifts the pen there
+// too.
+void test_leaving_the_mode_lifts_the_pen_where_it_was()
+{
+  replay::Frames frames = replay::record(hover_and_lift, 2, replay::length_of(hover_and_lift, 2));
+  std::vector<decoder::report> reports = pens(replay::play(frames, absolute(), 0));
+  TEST_ASSERT_TRUE(reports.size() > 0);
+  const decoder::report &seen = reports.back();
+  TEST_ASSERT_EQUAL_UINT8(PEN_IN_RANGE, seen.pen);
+
+  decoder::apply_settings(tuning::defaults);
+  decoder::lift_pen();
+  decoder::report lifted;
+  TEST_ASSERT_TRUE(decoder::next_report(lifted));
+  TEST_ASSERT_TRUE(lifted.absolute);
+  TEST_ASSERT_EQUAL_UINT8(0, lifted.pen);
+  TEST_ASSERT_EQUAL_UINT16(seen.position_x, lifted.position_x);
+  TEST_ASSERT_EQUAL_UINT16(seen.position_y, lifted.position_y);
+  TEST_ASSERT_FALSE(decoder::next_report(lifted));
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_region_corners_map_to_the_screen_corners);
+  RUN_TEST(test_pen_stays_on_the_edge_beyond_the_region);
+  RUN_TEST(test_y_points_down_the_screen);
+  RUN_TEST(test_press_puts_the_tip_down_and_two_fingers_the_barrel);
+  RUN_TEST(test_pen_lifts_where_it_was_last_seen);
+  RUN_TEST(test_leaving_the_mode_lifts_the_pen_where_it_was);
+  return UNITY_END();
+}
@@ -0,0 +1,151 @@
+// Clickpad button zones end to end: a finger resting in a zone presses the
+// pad while another one moves the cursor, in scripts of the simulated pad
+// through the decoder. The zones are the bottom button_zone_height_mm of the
+// pad, left and right of the middle.
+#include <unity.h>
+#include "../replay/replay.h"
+
+namespace
+{
+#define CONTACT(x, y) {(x), (y), 60, 6}
+#define LIFTED {0, 0, 0, 0}
+#define NOTHING(frames) {(frames), 0, false, {LIFTED, LIFTED}, {LIFTED, LIFTED}}
+  // The primary finger moves the cursor, and the secondary one rests in the
+  // right zone and presses the pad.
+  replay::Step resting_secondary[] = {
+      NOTHING(8),
+      {16, 2, false, {CONTACT(2500, 3000), CONTACT(4800, 1500)}, {CONTACT(2500, 3000), CONTACT(4800, 1500)}},
+      {40, 2, true, {CONTACT(2500, 3000), CONTACT(4800, 1500)}, {CONTACT(3500, 3800), CONTACT(4800, 1500)}},
+      {8, 2, false, {CONTACT(3500, 3800), CONTACT(4800, 1500)}, {CONTACT(3500, 3800), CONTACT(4800, 1500)}},
+      NOTHING(8),
+  };
+  // The primary finger rests in the left zone and presses the pad, and the
+  // secondary one moves the cursor.
+  replay::Step resting_primary[] = {
+      NOTHING(8),
+      {16, 2, false, {CONTACT(2000, 1500), CONTACT(3500, 3000)}, {CONTACT(2000, 1500), CONTACT(3500, 3000)}},
+      {40, 2, true, {CONTACT(2000, 1500), CONTACT(3500, 3000)}, {CONTACT(2000, 1500), CONTACT(4500, 3800)}},
+      {8, 2, false, {CONTACT(2000, 1500), CONTACT(4500, 3800)}, {CONTACT(2000, 1500), CONTACT(4500, 3800)}},
+      NOTHING(8),
+  };
+  // The moving finger lifts while the resting one keeps the pad down.
+  replay::Step moving_finger_lifts[] = {
+      NOTHING(8),
+      {16, 2, false, {CONTACT(2500, 3000), CONTACT(4800, 1500)}, {CONTACT(2500, 3000), CONTACT(4800, 1500)}},
+      {24, 2, true, {CONTACT(2500, 3000), CONTACT(4800, 1500)}, {CONTACT(3500, 3800), CONTACT(4800, 1500)}},
+      {24, 1, true, {CONTACT(4800, 1500), LIFTED}, {CONTACT(4800, 1500), LIFTED}},
+      {8, 1, false, {CONTACT(4800, 1500), LIFTED}, {CONTACT(4800, 1500), LIFTED}},
+      NOTHING(8),
+  };
+  // Two fingers, and then one, press the middle of the pad, outside the
+  // zones.
+  replay::Step outside_zones[] = {
+      NOTHING(8),
+      {16, 2, false, {CONTACT(3000, 3000), CONTACT(3800, 3000)}, {CONTACT(3000, 3000), CONTACT(3800, 3000)}},
+      {20, 2, true, {CONTACT(3000, 3000), CONTACT(3800, 3000)}, {CONTACT(3000, 3000), CONTACT(3800, 3000)}},
+      {8, 2, false, {CONTACT(3000, 3000), CONTACT(3800, 3000)}, {CONTACT(3000, 3000), CONTACT(3800, 3000)}},
+      NOTHING(40),
+      {16, 1, false, {CONTACT(3000, 3000), LIFTED}, {CONTACT(3000, 3000), LIFTED}},
+      {20, 1, true, {CONTACT(3000, 3000), LIFTED}, {CONTACT(3000, 3000), LIFTED}},
+      {8, 1, false, {CONTACT(3000, 3000), LIFTED}, {CONTACT(3000, 3000), LIFTED}},
+      NOTHING(8),
+  };
+#undef NOTHING
+#undef CONTACT
+#undef LIFTED
+
+  replay::Host play(const replay::Step *script, size_t length, const tuning::Settings &values = tuning::defaults)
+  {
+    replay::Frames frames = replay::record(script, length, replay::length_of(script, length));
+    return replay::play(frames, values);
+  }
+
+  // How far the cursor moved while the buttons in mask were held.
+  long moved_while_held(const replay::Host &host, uint8_t mask)
+  {
+    long moved = 0;
+    for (const replay::Received &received : host.reports)
+    {
+      if (received.held & mask)
+      {
+        moved += abs(received.item.x) + abs(received.item.y);
+      }
+    }
+    return moved;
+  }
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_resting_secondary_finger_presses_its_zone()
+{
+  replay::Host host = play(resting_secondary, sizeof(resting_secondary) / sizeof(resting_secondary[0]));
+
+  TEST_ASSERT_EQUAL_INT(1, host.presses(MOUSE_RIGHT));
+  TEST_ASSERT_EQUAL_INT(0, host.presses(MOUSE_LEFT | MOUSE_MIDDLE));
+  // The primary finger drags with the button held, up and to the right.
+  TEST_ASSERT_TRUE(moved_while_held(host, MOUSE_RIGHT) > 20);
+  TEST_ASSERT_TRUE(host.x > 0);
+  TEST_ASSERT_TRUE(host.y < 0);
+  TEST_ASSERT_EQUAL_INT(0, host.scroll);
+  TEST_ASSERT_EQUAL_UINT8(0, host.held.back());
+}
+
+void test_resting_primary_finger_presses_its_zone()
+{
+  replay::Host host = play(resting_primary, sizeof(resting_primary) / sizeof(resting_primary[0]));
+
+  TEST_ASSERT_EQUAL_INT(1, host.presses(MOUSE_LEFT));
+  TEST_ASSERT_EQUAL_INT(0, host.presses(MOUSE_RIGHT | MOUSE_MIDDLE));
+  // Here it is the secondary finger that drags.
+  TEST_ASSERT_TRUE(moved_while_held(host, MOUSE_LEFT) > 20);
+  TEST_ASSERT_TRUE(host.x > 0);
+  TEST_ASSERT_TRUE(host.y < 0);
+  TEST_ASSERT_EQUAL_INT(0, host.scroll);
+  TEST_ASSERT_EQUAL_UINT8(0, host.held.back());
+}
+
+void test_press_survives_the_moving_finger_lifting()
+{
+  replay::Host host = play(moving_finger_lifts, sizeof(moving_finger_lifts) / sizeof(moving_finger_lifts[0]));
+
+  // A single press from start to end, without the button turning into a
+  // left one when a single finger is left.
+  TEST_ASSERT_EQUAL_INT(1, host.presses(MOUSE_RIGHT));
+  TEST_ASSERT_EQUAL_INT(0, host.presses(MOUSE_LEFT | MOUSE_MIDDLE));
+  TEST_ASSERT_EQUAL_UINT8(0, host.held.back());
+}
+
+void test_press_outside_the_zones_counts_fingers()
+{
+  replay::Host host = play(outside_zones, sizeof(outside_zones) / sizeof(outside_zones[0]));
+
+  TEST_ASSERT_EQUAL_INT(1, host.presses(MOUSE_RIGHT));
+  TEST_ASSERT_EQUAL_INT(1, host.presses(MOUSE_LEFT));
+  TEST_ASSERT_TRUE(host.first_press(MOUSE_RIGHT) < host.first_press(MOUSE_LEFT));
+  TEST_ASSERT_EQUAL_UINT8(0, host.held.back());
+}
+
+void test_zones_can_be_turned_off()
+{
+  tuning::Settings values = tuning::defaults;
+  values.button_zones_enabled = false;
+  replay::Host host = play(resting_primary, sizeof(resting_primary) / sizeof(resting_primary[0]), values);
+
+  // Two fingers on the pad, wherever they are.
+  TEST_ASSERT_EQUAL_INT(1, host.presses(MOUSE_RIGHT));
+  TEST_ASSERT_EQUAL_INT(0, host.presses(MOUSE_LEFT));
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_resting_secondary_finger_presses_its_zone);
+  RUN_TEST(test_resting_primary_finger_presses_its_zone);
+  RUN_TEST(test_press_survives_the_moving_finger_lifting);
+  RUN_TEST(test_press_outside_the_zones_counts_fingers);
+  RUN_TEST(test_zones_can_be_turned_off);
+  return UNITY_END();
+}
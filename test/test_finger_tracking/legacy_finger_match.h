@@ -0,0 +1,122 @@
+// The proximity rule that told fingers apart before the tracker, kept as the
+// reference the tracker is measured against. It follows the same packets,
+// and says what it would have done with the finger left after a drop in the
+// finger count.
+#ifndef LEGACY_FINGER_MATCH_H
+#define LEGACY_FINGER_MATCH_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <synaptics.h>
+#include <decoder.h>
+
+class LegacyFingerMatch
+{
+public:
+  enum Decision
+  {
+    None,    // no finger left after a drop, or no drop
+    Kept,    // carried on with the primary finger
+    Swapped, // carried on with the secondary finger
+    Reset,   // didn't know, and started over
+  };
+
+  LegacyFingerMatch(int threshold_x, int threshold_y)
+      : m_threshold_x(threshold_x), m_threshold_y(threshold_y), m_fingers(0) {}
+
+  // Takes a packet of the pad, bytes in order in the low bits.
+  Decision packet(uint64_t packet)
+  {
+    int w = (packet >> 26) & 0x01 | (packet >> 1) & 0x02 | (packet >> 2) & 0x0C;
+    if (w == 2)
+    {
+      extended(packet);
+      return None;
+    }
+    if (w == 3)
+    {
+      return None;
+    }
+
+    int x = (packet >> 32) & 0x00FF | (packet >> 0) & 0x0F00 | (packet >> 16) & 0x1000;
+    int y = (packet >> 40) & 0x00FF | (packet >> 4) & 0x0F00 | (packet >> 17) & 0x1000;
+    int z = (packet >> 16) & 0xFF;
+    int fingers = z == 0 ? 0 : w >= 4 ? 1 : w == 0 ? 2 : 3;
+
+    Decision decision = None;
+    if (fingers > m_fingers)
+    {
+      reset(1);
+      if (m_fingers == 0)
+      {
+        reset(0);
+      }
+    }
+    if (fingers < m_fingers)
+    {
+      if (m_fingers == 2)
+      {
+        decision = Kept;
+        if (abs(x - m_x[0].average()) >= m_threshold_x || abs(y - m_y[0].average()) >= m_threshold_y)
+        {
+          if (abs(x - m_x[1].average()) < m_threshold_x && abs(y - m_y[1].average()) < m_threshold_y)
+          {
+            m_x[0] = m_x[1];
+            m_y[0] = m_y[1];
+            decision = Swapped;
+          }
+          else
+          {
+            reset(0);
+            decision = Reset;
+          }
+        }
+      }
+      else
+      {
+        reset(0);
+        reset(1);
+        decision = Reset;
+      }
+      if (fingers == 0)
+      {
+        decision = None;
+      }
+    }
+    m_fingers = fingers;
+    if (fingers > 0)
+    {
+      m_x[0].filter(x);
+      m_y[0].filter(y);
+    }
+    return decision;
+  }
+
+private:
+  void extended(uint64_t packet)
+  {
+    int x = (packet >> 7) & 0x01FE | (packet >> 23) & 0x1E00;
+    int y = (packet >> 15) & 0x01FE | (packet >> 27) & 0x1E00;
+    if (x == 0 || y == 0)
+    {
+      reset(1);
+      return;
+    }
+    m_x[1].filter(x);
+    m_y[1].filter(y);
+  }
+
+  void reset(int finger)
+  {
+    m_x[finger].reset();
+    m_y[finger].reset();
+  }
+
+  int m_threshold_x;
+  int m_threshold_y;
+  int m_fingers;
+  SimpleAverage<int16_t, decoder::position_average_frames> m_x[2];
+  SimpleAverage<int16_t, decoder::position_average_frames> m_y[2];
+};
+
+#endif // LEGACY_FINGER_MATCH_H
@@ -0,0 +1,184 @@
+// Finger identity across drops in the finger count, on multi-finger sessions
+// of the simulated pad: how often the tracker has to start a finger over, and
+// how often the cursor jumps, against the proximity rule it replaced.
+#include <unity.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include "../replay/replay.h"
+#include "legacy_finger_match.h"
+
+namespace
+{
+#define CONTACT(x, y) {(x), (y), 60, 6}
+#define LIFTED {0, 0, 0, 0}
+#define NOTHING(frames) {(frames), 0, false, {LIFTED, LIFTED}, {LIFTED, LIFTED}}
+  // A session, and which finger is left once a finger of two has been
+  // lifted: the primary one (Kept) or the secondary one (Swapped).
+  struct Session
+  {
+    const char *name;
+    LegacyFingerMatch::Decision left;
+    replay::Step steps[5];
+  };
+
+  const Session sessions[] = {
+      {"primary lifts during a two finger swipe", LegacyFingerMatch::Swapped,
+       {NOTHING(8),
+        {8, 2, false, {CONTACT(1600, 3000), CONTACT(2200, 3000)}, {CONTACT(1600, 3000), CONTACT(2200, 3000)}},
+        {12, 2, false, {CONTACT(1600, 3000), CONTACT(2200, 3000)}, {CONTACT(3500, 3000), CONTACT(4100, 3000)}},
+        {8, 1, false, {CONTACT(4260, 3000), LIFTED}, {CONTACT(5300, 3000), LIFTED}},
+        NOTHING(8)}},
+      {"secondary lifts during a two finger swipe", LegacyFingerMatch::Kept,
+       {NOTHING(8),
+        {8, 2, false, {CONTACT(1600, 3000), CONTACT(2200, 3000)}, {CONTACT(1600, 3000), CONTACT(2200, 3000)}},
+        {12, 2, false, {CONTACT(1600, 3000), CONTACT(2200, 3000)}, {CONTACT(3500, 3000), CONTACT(4100, 3000)}},
+        {12, 1, false, {CONTACT(3660, 3000), LIFTED}, {CONTACT(5300, 3000), LIFTED}},
+        NOTHING(8)}},
+      {"primary lifts next to the secondary", LegacyFingerMatch::Swapped,
+       {NOTHING(8),
+        {8, 2, false, {CONTACT(3000, 3800), CONTACT(3400, 3800)}, {CONTACT(3000, 3800), CONTACT(3400, 3800)}},
+        {16, 2, false, {CONTACT(3000, 3800), CONTACT(3400, 3800)}, {CONTACT(3000, 3000), CONTACT(3400, 3000)}},
+        {20, 1, false, {CONTACT(3400, 2950), LIFTED}, {CONTACT(4000, 2200), LIFTED}},
+        NOTHING(8)}},
+      {"thumb rests during a swipe", LegacyFingerMatch::Kept,
+       {NOTHING(8),
+        {6, 1, false, {CONTACT(1600, 3000), LIFTED}, {CONTACT(2400, 3000), LIFTED}},
+        {12, 2, false, {CONTACT(2400, 3000), CONTACT(3000, 1400)}, {CONTACT(4300, 3000), CONTACT(3000, 1400)}},
+        {8, 1, false, {CONTACT(4460, 3000), LIFTED}, {CONTACT(5400, 3000), LIFTED}},
+        NOTHING(8)}},
+      {"three fingers, then two, then one", LegacyFingerMatch::Kept,
+       {NOTHING(8),
+        {16, 3, false, {CONTACT(3000, 3800), CONTACT(3600, 3800)}, {CONTACT(3000, 3200), CONTACT(3600, 3200)}},
+        {16, 2, false, {CONTACT(3000, 3160), CONTACT(3600, 3160)}, {CONTACT(3000, 2600), CONTACT(3600, 2600)}},
+        {16, 1, false, {CONTACT(3000, 2560), LIFTED}, {CONTACT(3000, 2000), LIFTED}},
+        NOTHING(8)}},
+  };
+  const size_t session_count = sizeof(sessions) / sizeof(sessions[0]);
+  // Both fingers lift, and a new one lands far from them, in the same frame.
+  replay::Step new_finger[] = {
+      NOTHING(8),
+      {16, 2, false, {CONTACT(2000, 3800), CONTACT(2600, 3800)}, {CONTACT(2000, 3200), CONTACT(2600, 3200)}},
+      {16, 1, false, {CONTACT(4800, 1800), LIFTED}, {CONTACT(4800, 2200), LIFTED}},
+      NOTHING(8),
+  };
+#undef NOTHING
+#undef CONTACT
+#undef LIFTED
+
+  replay::Frames record(const Session &session)
+  {
+    size_t length = sizeof(session.steps) / sizeof(session.steps[0]);
+    return replay::record(session.steps, length, replay::length_of(session.steps, length));
+  }
+
+  // Fingers started over, and fingers mistaken for one another, which jump
+  // the cursor by the distance between them. Each session lifts a finger of
+  // two once.
+  struct Counts
+  {
+    int resets;
+    int jumps;
+  };
+
+  Counts legacy(const Session &session, const replay::Frames &frames)
+  {
+    const tuning::Settings &values = tuning::defaults;
+    LegacyFingerMatch match(values.proximity_threshold_mm * synaptics::units_per_mm_x,
+                            values.proximity_threshold_mm * synaptics::units_per_mm_y);
+    Counts counts = {};
+    for (const std::vector<uint8_t> &bytes : frames)
+    {
+      if (bytes.size() != 6)
+      {
+        continue;
+      }
+      uint64_t packet = 0;
+      for (int i = 0; i < 6; i++)
+      {
+        packet |= (uint64_t)bytes[i] << (8 * i);
+      }
+      LegacyFingerMatch::Decision decision = match.packet(packet);
+      counts.resets += decision == LegacyFingerMatch::Reset;
+      counts.jumps += (decision == LegacyFingerMatch::Kept || decision == LegacyFingerMatch::Swapped) &&
+                      decision != session.left;
+    }
+    return counts;
+  }
+
+  // Whether the cursor jumped: a report that moves it more than three times
+  // as far as the median report of the session.
+  bool jumped(const replay::Host &host)
+  {
+    std::vector<int> moves;
+    for (const replay::Received &received : host.reports)
+    {
+      int moved = abs(received.item.x) + abs(received.item.y);
+      if (moved > 0)
+      {
+        moves.push_back(moved);
+      }
+    }
+    if (moves.empty())
+    {
+      return false;
+    }
+    std::sort(moves.begin(), moves.end());
+    return moves.back() > 3 * moves[moves.size() / 2];
+  }
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_tracker_resets_less_than_the_proximity_rule()
+{
+  Counts before = {};
+  Counts after = {};
+  for (size_t i = 0; i < session_count; i++)
+  {
+    replay::Frames frames = record(sessions[i]);
+    replay::Host host = replay::play(frames, tuning::defaults);
+    Counts legacy_counts = legacy(sessions[i], frames);
+    Counts counts = {(int)host.stats.finger_resets, jumped(host)};
+
+    char line[160];
+    snprintf(line, sizeof(line), "%s: resets %d -> %d, jumps %d -> %d",
+             sessions[i].name, legacy_counts.resets, counts.resets, legacy_counts.jumps, counts.jumps);
+    TEST_MESSAGE(line);
+    before.resets += legacy_counts.resets;
+    before.jumps += legacy_counts.jumps;
+    after.resets += counts.resets;
+    after.jumps += counts.jumps;
+  }
+
+  char line[120];
+  snprintf(line, sizeof(line), "%u sessions, resets: %d -> %d, jumps: %d -> %d",
+           (unsigned)session_count, before.resets, after.resets, before.jumps, after.jumps);
+  TEST_MESSAGE(line);
+
+  TEST_ASSERT_TRUE(before.resets + before.jumps > 0);
+  TEST_ASSERT_EQUAL_INT(0, after.resets);
+  TEST_ASSERT_EQUAL_INT(0, after.jumps);
+}
+
+// A finger the tracker has never seen is still started over.
+void test_unknown_finger_is_not_matched()
+{
+  size_t length = sizeof(new_finger) / sizeof(new_finger[0]);
+  replay::Frames frames = replay::record(new_finger, length, replay::length_of(new_finger, length));
+  replay::Host host = replay::play(frames, tuning::defaults);
+
+  TEST_ASSERT_EQUAL_UINT32(1, host.stats.finger_resets);
+  TEST_ASSERT_EQUAL_UINT32(0, host.stats.finger_matches);
+  TEST_ASSERT_FALSE(jumped(host));
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_tracker_resets_less_than_the_proximity_rule);
+  RUN_TEST(test_unknown_finger_is_not_matched);
+  return UNITY_END();
+}
@@ -0,0 +1,159 @@
+// The checks of the fuzz harness on every test run: random and garbled
+// streams through the decoder, without needing clang for libFuzzer. The
+// fuzzer itself is `pio run -e fuzz`, see test/fuzz.
+#include <unity.h>
+#include <random>
+#include <vector>
+#include <ps2.h>
+#include <synaptics.h>
+#include <simulated_synaptics.h>
+#include <decoder.h>
+#include "../fuzz/decoder_harness.h"
+
+namespace
+{
+  std::vector<uint8_t> received;
+
+  void byte_received(uint8_t data) { received.push_back(data); }
+
+  // The bytes of frames frames of script, streamed by a simulated pad after
+  // synaptics::init().
+  std::vector<uint8_t> stream(const ps2::SimulatedSynaptics::Step *script, size_t length, int frames)
+  {
+    ps2::SimulatedSynaptics pad(script, length);
+    ps2::begin(pad, byte_received);
+    ps2::reset();
+    synaptics::init();
+    received.clear();
+    for (int i = 0; i < frames; i++)
+    {
+      pad.frame();
+    }
+    return received;
+  }
+
+  void run(const std::vector<uint8_t> &input)
+  {
+    const char *failure = harness::run(input.data(), input.size());
+    if (failure != nullptr)
+    {
+      char message[128];
+      snprintf(message, sizeof(message), "config 0x%02X, %d bytes: %s", input[0], (int)input.size(), failure);
+      TEST_FAIL_MESSAGE(message);
+    }
+  }
+
+  // The consumer of the full channel test: only runs when the decoder waits.
+  decoder::Buttons seen;
+  uint8_t seen_held_max = 0;
+
+  void drain_when_full()
+  {
+    decoder::report item;
+    while (decoder::next_report(item))
+    {
+      seen_held_max |= seen.update(item);
+    }
+  }
+} // namespace
+
+void setUp() { received.clear(); }
+
+void tearDown() {}
+
+void test_random_streams_keep_the_invariants()
+{
+  std::mt19937 random(42);
+  for (int i = 0; i < 2000; i++)
+  {
+    std::vector<uint8_t> input(1 + random() % 600);
+    for (uint8_t &byte : input)
+    {
+      byte = random();
+    }
+    run(input);
+  }
+}
+
+// Random bytes rarely make it past the checks of byte 0 and 3, so also
+// garble a real stream: bits flipped, bytes lost and repeated.
+void test_garbled_streams_keep_the_invariants()
+{
+  std::vector<uint8_t> clean = stream(ps2::demo_script, ps2::demo_script_length, 1400);
+  TEST_ASSERT_TRUE(clean.size() > 6 * 1000);
+
+  std::mt19937 random(7);
+  for (int i = 0; i < 256; i++)
+  {
+    std::vector<uint8_t> input;
+    // Only the Synaptics protocol makes sense for this stream.
+    input.push_back(i & ~0x03);
+    for (uint8_t byte : clean)
+    {
+      switch (random() % 400)
+      {
+      case 0:
+        input.push_back(byte ^ (1 << random() % 8));
+        break;
+      case 1:
+        break;
+      case 2:
+        input.push_back(byte);
+        input.push_back(byte);
+        break;
+      default:
+        input.push_back(byte);
+      }
+    }
+    run(input);
+  }
+}
+
+void test_button_changes_wait_for_a_full_channel()
+{
+#define CONTACT(x, y) {(x), (y), 60, 6}
+#define LIFTED {0, 0, 0, 0}
+  // Enough moves to fill the channel, then a click in the button zone.
+  ps2::SimulatedSynaptics::Step script[] = {
+      {100, 1, false, {CONTACT(2500, 2500), LIFTED}, {CONTACT(4500, 3500), LIFTED}},
+      {40, 0, false, {LIFTED, LIFTED}, {LIFTED, LIFTED}},
+      {10, 1, false, {CONTACT(2000, 1600), LIFTED}, {CONTACT(2000, 1600), LIFTED}},
+      {12, 1, true, {CONTACT(2000, 1600), LIFTED}, {CONTACT(2000, 1600), LIFTED}},
+      {10, 1, false, {CONTACT(2000, 1600), LIFTED}, {CONTACT(2000, 1600), LIFTED}},
+      {80, 0, false, {LIFTED, LIFTED}, {LIFTED, LIFTED}},
+  };
+#undef CONTACT
+#undef LIFTED
+  size_t length = sizeof(script) / sizeof(script[0]);
+  std::vector<uint8_t> bytes = stream(script, length, 252);
+
+  seen = decoder::Buttons();
+  seen_held_max = 0;
+  decoder::begin(tuning::defaults, {.report_ready = nullptr, .wait_for_output = drain_when_full, .save_calibration = nullptr});
+  uint32_t now = 0;
+  for (size_t i = 0; i < bytes.size(); i++)
+  {
+    now += harness::byte_micros;
+    decoder::captured_packet packet;
+    if (decoder::frame_byte(bytes[i], now, packet))
+    {
+      decoder::decode(packet);
+      decoder::tick();
+    }
+  }
+
+  TEST_ASSERT_TRUE(decoder::stats().channel_waits > 0);
+  TEST_ASSERT_TRUE(decoder::stats().channel_overflows > 0);
+  drain_when_full();
+  TEST_ASSERT_EQUAL_UINT8(MOUSE_LEFT, seen_held_max & MOUSE_LEFT);
+  TEST_ASSERT_EQUAL_UINT8(0, seen.held());
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_random_streams_keep_the_invariants);
+  RUN_TEST(test_garbled_streams_keep_the_invariants);
+  RUN_TEST(test_button_changes_wait_for_a_full_channel);
+  return UNITY_END();
+}
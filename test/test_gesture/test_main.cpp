@@ -0,0 +1,360 @@
+// The gesture engine on its own, fed typed frames: taps, drags, scrolls,
+// what ends a tap, speculative presses, and the trace of its transitions.
+#include <unity.h>
+#include <random>
+#include <string>
+#include <vector>
+#include <gesture.h>
+
+namespace
+{
+  const gesture::Config config = {
+      .tap_time = 10,
+      .tap_movement = 100,
+      .tap_z = 100,
+      .drag_window = 20,
+      .speculative = false,
+      .speculative_delay = 3,
+  };
+
+  gesture::Config speculative()
+  {
+    gesture::Config result = config;
+    result.speculative = true;
+    return result;
+  }
+
+  std::vector<std::string> transitions;
+
+  void trace(gesture::State from, gesture::Event event, gesture::State to)
+  {
+    transitions.push_back(std::string(gesture::state_name(from)) + " " + gesture::event_name(event) + " " +
+                          gesture::state_name(to));
+  }
+
+  // Feeds the engine a frame per tick, and keeps what came out.
+  class Driver
+  {
+  public:
+    explicit Driver(const gesture::Config &values) : engine(values), tick(100) {}
+
+    // Fingers down for frames ticks, moving each by movement.
+    void touch(uint8_t fingers, int frames, uint16_t movement = 0, int16_t z = 50)
+    {
+      for (int i = 0; i < frames; i++)
+      {
+        frame({.tick = 0, .fingers = fingers, .movement = movement, .z = z, .button = false, .palm = false});
+      }
+    }
+
+    void lift(int frames = 1) { touch(0, frames, 0, 0); }
+
+    void frame(gesture::Frame item)
+    {
+      item.tick = tick++;
+      gesture::Output buffer[gesture::Engine::max_outputs];
+      int count = engine.consume(item, buffer);
+      TEST_ASSERT_TRUE(count >= 0 && count <= gesture::Engine::max_outputs);
+      outputs.insert(outputs.end(), buffer, buffer + count);
+    }
+
+    int count(gesture::OutputType type, uint8_t buttons = 0) const
+    {
+      int result = 0;
+      for (const gesture::Output &output : outputs)
+      {
+        result += output.type == type && (buttons == 0 || output.buttons == buttons);
+      }
+      return result;
+    }
+
+    gesture::Engine engine;
+    unsigned long tick;
+    std::vector<gesture::Output> outputs;
+  };
+} // namespace
+
+void setUp()
+{
+  transitions.clear();
+}
+
+void tearDown() {}
+
+void test_tap_clicks_and_arms_a_drag()
+{
+  Driver driver(config);
+  driver.touch(1, 4);
+  driver.lift();
+
+  TEST_ASSERT_EQUAL_INT(1, (int)driver.outputs.size());
+  TEST_ASSERT_EQUAL_INT(1, driver.count(gesture::OutputType::Click, 1));
+  TEST_ASSERT_TRUE(driver.engine.state() == gesture::State::DragArmed);
+
+  driver.lift(config.drag_window + 1);
+  TEST_ASSERT_TRUE(driver.engine.state() == gesture::State::Idle);
+  TEST_ASSERT_EQUAL_INT(1, (int)driver.outputs.size());
+}
+
+void test_multi_finger_taps_click_other_buttons()
+{
+  Driver driver(config);
+  driver.touch(1, 1);
+  driver.touch(2, 3);
+  driver.lift();
+  TEST_ASSERT_TRUE(driver.engine.state() == gesture::State::Idle);
+  driver.touch(3, 3);
+  driver.touch(2, 1);
+  driver.lift();
+
+  TEST_ASSERT_EQUAL_INT(2, (int)driver.outputs.size());
+  TEST_ASSERT_EQUAL_INT(1, driver.count(gesture::OutputType::Click, 2));
+  TEST_ASSERT_EQUAL_INT(1, driver.count(gesture::OutputType::Click, 3));
+}
+
+void test_long_moving_heavy_or_pressed_touches_are_no_taps()
+{
+  Driver driver(config);
+  driver.touch(1, config.tap_time + 2);
+  TEST_ASSERT_TRUE(driver.engine.state() == gesture::State::Track);
+  driver.lift();
+  driver.touch(1, 3, 40);
+  TEST_ASSERT_TRUE(driver.engine.state() == gesture::State::Track);
+  driver.lift();
+  driver.touch(1, 3, 0, config.tap_z);
+  driver.lift();
+  driver.touch(1, 1);
+  driver.frame({.tick = 0, .fingers = 1, .movement = 0, .z = 50, .button = true, .palm = false});
+  driver.lift();
+  driver.touch(1, 1);
+  driver.frame({.tick = 0, .fingers = 1, .movement = 0, .z = 50, .button = false, .palm = true});
+  driver.lift();
+
+  TEST_ASSERT_EQUAL_INT(0, (int)driver.outputs.size());
+  TEST_ASSERT_TRUE(driver.engine.state() == gesture::State::Idle);
+}
+
+// A quick press lifts like a tap, and the next tap still clicks.
+void test_tap_after_a_quick_press_clicks()
+{
+  Driver driver(config);
+  driver.touch(1, 1);
+  driver.frame({.tick = 0, .fingers = 1, .movement = 0, .z = 50, .button = true, .palm = false});
+  driver.lift(3);
+  TEST_ASSERT_TRUE(driver.engine.state() == gesture::State::Idle);
+  driver.touch(1, 3);
+  driver.lift();
+
+  TEST_ASSERT_EQUAL_INT(1, driver.count(gesture::OutputType::Click, 1));
+}
+
+void test_double_tap_clicks_twice()
+{
+  Driver driver(config);
+  driver.touch(1, 3);
+  driver.lift(3);
+  driver.touch(1, 3);
+  driver.lift();
+
+  TEST_ASSERT_EQUAL_INT(2, driver.count(gesture::OutputType::Click, 1));
+  TEST_ASSERT_EQUAL_INT(0, driver.count(gesture::OutputType::ButtonDown));
+}
+
+void test_tap_and_move_drags()
+{
+  Driver driver(config);
+  driver.touch(1, 3);
+  driver.lift(3);
+  driver.touch(1, 2);
+  TEST_ASSERT_TRUE(driver.engine.state() == gesture::State::DragTouch);
+  TEST_ASSERT_EQUAL_UINT8(0, driver.engine.held_buttons());
+  driver.touch(1, 30, 50);
+
+  TEST_ASSERT_TRUE(driver.engine.dragging());
+  TEST_ASSERT_EQUAL_UINT8(0x01, driver.engine.held_buttons());
+  TEST_ASSERT_EQUAL_INT(1, driver.count(gesture::OutputType::ButtonDown, 1));
+  driver.lift();
+
+  TEST_ASSERT_TRUE(driver.engine.state() == gesture::State::Idle);
+  TEST_ASSERT_EQUAL_UINT8(0, driver.engine.held_buttons());
+  TEST_ASSERT_EQUAL_INT(1, driver.count(gesture::OutputType::ButtonUp, 1));
+  TEST_ASSERT_EQUAL_INT(1, driver.count(gesture::OutputType::Click));
+}
+
+void test_drag_window_closes()
+{
+  Driver driver(config);
+  driver.touch(1, 3);
+  driver.lift(config.drag_window + 2);
+  driver.touch(1, 10, 50);
+  driver.lift();
+
+  TEST_ASSERT_EQUAL_INT(0, driver.count(gesture::OutputType::ButtonDown));
+  TEST_ASSERT_EQUAL_INT(1, driver.count(gesture::OutputType::Click));
+}
+
+void test_two_fingers_moving_scroll()
+{
+  Driver driver(config);
+  driver.touch(2, 4, 40);
+  TEST_ASSERT_TRUE(driver.engine.state() == gesture::State::Scroll);
+  driver.touch(1, 2, 40);
+  TEST_ASSERT_TRUE(driver.engine.state() == gesture::State::Track);
+  driver.lift();
+
+  TEST_ASSERT_EQUAL_INT(0, (int)driver.outputs.size());
+}
+
+void test_speculative_tap_presses_on_touch()
+{
+  Driver driver(speculative());
+  driver.touch(1, config.speculative_delay + 1);
+
+  TEST_ASSERT_EQUAL_INT(1, (int)driver.outputs.size());
+  TEST_ASSERT_EQUAL_INT(1, driver.count(gesture::OutputType::SpeculativeDown, 1));
+  driver.lift();
+  TEST_ASSERT_EQUAL_INT(1, driver.count(gesture::OutputType::SpeculativeUp, 1));
+  TEST_ASSERT_EQUAL_INT(0, driver.count(gesture::OutputType::Click));
+}
+
+void test_speculative_press_is_taken_back()
+{
+  Driver driver(speculative());
+  // Moves after the press.
+  driver.touch(1, config.speculative_delay + 1);
+  driver.touch(1, 3, 50);
+  driver.lift();
+  // A second finger joins after the press: the tap is a right click.
+  driver.touch(1, config.speculative_delay + 1);
+  driver.touch(2, 2);
+  driver.lift();
+
+  TEST_ASSERT_EQUAL_INT(2, driver.count(gesture::OutputType::SpeculativeDown, 1));
+  TEST_ASSERT_EQUAL_INT(2, driver.count(gesture::OutputType::SpeculativeCancel, 1));
+  TEST_ASSERT_EQUAL_INT(0, driver.count(gesture::OutputType::SpeculativeUp));
+  TEST_ASSERT_EQUAL_INT(1, driver.count(gesture::OutputType::Click, 2));
+}
+
+void test_drag_takes_over_a_speculative_press()
+{
+  Driver driver(speculative());
+  driver.touch(1, 2);
+  driver.lift(2);
+  driver.touch(1, config.speculative_delay + 1);
+  driver.touch(1, 10, 50);
+  TEST_ASSERT_TRUE(driver.engine.dragging());
+  driver.lift();
+
+  // The button that went down on touch stays down through the drag, and the
+  // drag lets go of it.
+  TEST_ASSERT_EQUAL_INT(1, driver.count(gesture::OutputType::SpeculativeDown, 1));
+  TEST_ASSERT_EQUAL_INT(1, driver.count(gesture::OutputType::SpeculativeHold, 1));
+  TEST_ASSERT_EQUAL_INT(0, driver.count(gesture::OutputType::SpeculativeCancel));
+  TEST_ASSERT_EQUAL_INT(0, driver.count(gesture::OutputType::ButtonDown));
+  TEST_ASSERT_EQUAL_INT(1, driver.count(gesture::OutputType::ButtonUp, 1));
+}
+
+// Random frames never leave a button down or the engine out of Idle once
+// lifted, and every speculative press ends exactly once.
+void test_random_frames_keep_presses_balanced()
+{
+  std::mt19937 random(29);
+  for (int run = 0; run < 200; run++)
+  {
+    Driver driver(run % 2 ? speculative() : config);
+    for (int i = 0; i < 200; i++)
+    {
+      uint8_t fingers = random() % 5 == 0 ? 0 : random() % 4;
+      driver.frame({.tick = 0,
+                    .fingers = fingers,
+                    .movement = (uint16_t)(random() % 4 == 0 ? random() % 80 : 0),
+                    .z = (int16_t)(random() % 140),
+                    .button = random() % 20 == 0,
+                    .palm = random() % 30 == 0});
+    }
+    driver.lift(config.drag_window + 2);
+    TEST_ASSERT_TRUE(driver.engine.state() == gesture::State::Idle);
+
+    int down = 0;
+    int speculative_down = 0;
+    for (const gesture::Output &output : driver.outputs)
+    {
+      switch (output.type)
+      {
+      case gesture::OutputType::ButtonDown:
+        down++;
+        break;
+      case gesture::OutputType::ButtonUp:
+        down--;
+        break;
+      case gesture::OutputType::SpeculativeDown:
+        TEST_ASSERT_EQUAL_INT(0, speculative_down);
+        speculative_down++;
+        break;
+      case gesture::OutputType::SpeculativeHold:
+        // The drag's ButtonUp ends it.
+        speculative_down--;
+        down++;
+        break;
+      case gesture::OutputType::SpeculativeUp:
+      case gesture::OutputType::SpeculativeCancel:
+        speculative_down--;
+        break;
+      default:
+        break;
+      }
+      TEST_ASSERT_TRUE(down == 0 || down == 1);
+      TEST_ASSERT_TRUE(speculative_down == 0 || speculative_down == 1);
+    }
+    TEST_ASSERT_EQUAL_INT(0, down);
+    TEST_ASSERT_EQUAL_INT(0, speculative_down);
+    TEST_ASSERT_EQUAL_UINT8(0, driver.engine.held_buttons());
+  }
+}
+
+void test_trace_logs_each_transition()
+{
+  Driver driver(config);
+  driver.engine.set_trace(trace);
+  driver.touch(1, 3);
+  driver.lift(3);
+  driver.touch(1, 2);
+  driver.touch(1, 2, 60);
+  driver.lift();
+
+  const char *expected[] = {
+      "Idle Touch Touch",
+      "Touch Tap DragArmed",
+      "DragArmed Touch DragTouch",
+      "DragTouch Move Drag",
+      "Drag Lift Idle",
+  };
+  TEST_ASSERT_EQUAL_INT(sizeof(expected) / sizeof(expected[0]), (int)transitions.size());
+  for (size_t i = 0; i < transitions.size(); i++)
+  {
+    TEST_ASSERT_EQUAL_STRING(expected[i], transitions[i].c_str());
+  }
+
+  driver.engine.set_trace(nullptr);
+  driver.touch(1, 3);
+  TEST_ASSERT_EQUAL_INT(sizeof(expected) / sizeof(expected[0]), (int)transitions.size());
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_tap_clicks_and_arms_a_drag);
+  RUN_TEST(test_multi_finger_taps_click_other_buttons);
+  RUN_TEST(test_long_moving_heavy_or_pressed_touches_are_no_taps);
+  RUN_TEST(test_tap_after_a_quick_press_clicks);
+  RUN_TEST(test_double_tap_clicks_twice);
+  RUN_TEST(test_tap_and_move_drags);
+  RUN_TEST(test_drag_window_closes);
+  RUN_TEST(test_two_fingers_moving_scroll);
+  RUN_TEST(test_speculative_tap_presses_on_touch);
+  RUN_TEST(test_speculative_press_is_taken_back);
+  RUN_TEST(test_drag_takes_over_a_speculative_press);
+  RUN_TEST(test_random_frames_keep_presses_balanced);
+  RUN_TEST(test_trace_logs_each_transition);
+  return UNITY_END();
+}
@@ -0,0 +1,118 @@
+// Lost packets, counted and filled in by the decoder, on streams of the
+// simulated pad with packets dropped. With two fingers the pad sends the
+// extended and the primary packets in turns, one per report period.
+#include <stdlib.h>
+#include <unity.h>
+#include "../replay/replay.h"
+
+namespace
+{
+#define CONTACT(x, y) {(x), (y), 60, 6}
+#define LIFTED {0, 0, 0, 0}
+  replay::Step one_finger[] = {
+      {8, 0, false, {LIFTED, LIFTED}, {LIFTED, LIFTED}},
+      {80, 1, false, {CONTACT(2500, 2500), LIFTED}, {CONTACT(4500, 3500), LIFTED}},
+      {8, 0, false, {LIFTED, LIFTED}, {LIFTED, LIFTED}},
+  };
+  replay::Step two_fingers[] = {
+      {8, 0, false, {LIFTED, LIFTED}, {LIFTED, LIFTED}},
+      {120, 2, false, {CONTACT(3300, 3800), CONTACT(3900, 3800)}, {CONTACT(3300, 2200), CONTACT(3900, 2200)}},
+      {8, 0, false, {LIFTED, LIFTED}, {LIFTED, LIFTED}},
+  };
+#undef CONTACT
+#undef LIFTED
+
+  replay::Frames record(const replay::Step *script, size_t length)
+  {
+    return replay::record(script, length, replay::length_of(script, length));
+  }
+
+  int packet_w(const std::vector<uint8_t> &bytes)
+  {
+    return (bytes[3] >> 2) & 0x01 | (bytes[0] >> 1) & 0x02 | (bytes[0] >> 2) & 0x0C;
+  }
+
+  // Drops the next count packets with w, from the middle of the stream on.
+  replay::Frames drop(replay::Frames frames, int w, int count)
+  {
+    for (size_t i = frames.size() / 2; i < frames.size() && count > 0; i++)
+    {
+      if (frames[i].size() == 6 && packet_w(frames[i]) == w)
+      {
+        frames[i].clear();
+        count--;
+      }
+    }
+    return frames;
+  }
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_alternating_packets_are_not_lost()
+{
+  replay::Frames frames = record(two_fingers, 3);
+  for (size_t i = 0; i < frames.size(); i++)
+  {
+    // A packet per frame, never two back to back.
+    TEST_ASSERT_TRUE(frames[i].size() <= 6);
+  }
+  replay::Host host = replay::play(frames, tuning::defaults);
+
+  TEST_ASSERT_EQUAL_UINT32(0, host.stats.frames_lost);
+  TEST_ASSERT_EQUAL_UINT32(0, host.stats.frames_interpolated);
+  TEST_ASSERT_TRUE(host.scroll != 0);
+}
+
+void test_lost_primary_packet_is_filled_in()
+{
+  replay::Frames frames = record(two_fingers, 3);
+  replay::Host clean = replay::play(frames, tuning::defaults);
+  replay::Host host = replay::play(drop(frames, 0, 1), tuning::defaults);
+
+  TEST_ASSERT_EQUAL_UINT32(1, host.stats.frames_lost);
+  TEST_ASSERT_EQUAL_UINT32(1, host.stats.frames_interpolated);
+  TEST_ASSERT_EQUAL_UINT32(clean.stats.finger_resets, host.stats.finger_resets);
+  TEST_ASSERT_INT_WITHIN(2, clean.scroll, host.scroll);
+}
+
+void test_lost_extended_packet_is_filled_in()
+{
+  replay::Frames frames = record(two_fingers, 3);
+  replay::Host clean = replay::play(frames, tuning::defaults);
+  replay::Host host = replay::play(drop(frames, 2, 1), tuning::defaults);
+
+  TEST_ASSERT_EQUAL_UINT32(1, host.stats.frames_lost);
+  TEST_ASSERT_EQUAL_UINT32(1, host.stats.frames_interpolated);
+  // The primary packets all came, so none may be made up.
+  TEST_ASSERT_EQUAL_UINT32(clean.reports.size(), host.reports.size());
+  TEST_ASSERT_EQUAL_UINT32(clean.stats.finger_resets, host.stats.finger_resets);
+  TEST_ASSERT_INT_WITHIN(2, clean.scroll, host.scroll);
+}
+
+void test_lost_packets_of_one_finger_are_filled_in()
+{
+  replay::Frames frames = record(one_finger, 3);
+  replay::Host clean = replay::play(frames, tuning::defaults);
+  replay::Host host = replay::play(drop(frames, 4 + 2, 2), tuning::defaults);
+
+  TEST_ASSERT_EQUAL_UINT32(0, clean.stats.frames_lost);
+  TEST_ASSERT_EQUAL_UINT32(2, host.stats.frames_lost);
+  TEST_ASSERT_EQUAL_UINT32(2, host.stats.frames_interpolated);
+  // The filled in packets reach the report delay together, which moves
+  // the reports trimmed at the lift by as many, hence the 5%.
+  TEST_ASSERT_INT_WITHIN(clean.x / 20 + 3, clean.x, host.x);
+  TEST_ASSERT_INT_WITHIN(abs(clean.y) / 20 + 3, clean.y, host.y);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_alternating_packets_are_not_lost);
+  RUN_TEST(test_lost_primary_packet_is_filled_in);
+  RUN_TEST(test_lost_extended_packet_is_filled_in);
+  RUN_TEST(test_lost_packets_of_one_finger_are_filled_in);
+  return UNITY_END();
+}
@@ -0,0 +1,115 @@
+// A wheel mouse found instead of the pad, and a guest device behind it:
+// their reports through the decoder, against the simulated devices.
+#include <unity.h>
+#include "../replay/replay.h"
+
+namespace
+{
+#define CONTACT(x, y) {(x), (y), 60, 6}
+#define LIFTED {0, 0, 0, 0}
+  // Two fingers down, which turns the wheel of the simulated mouse towards
+  // the user, and scrolls the pad down.
+  replay::Step scroll_down[] = {
+      {8, 0, false, {LIFTED, LIFTED}, {LIFTED, LIFTED}},
+      {4, 1, false, {CONTACT(3300, 3800), LIFTED}, {CONTACT(3300, 3800), LIFTED}},
+      {80, 2, false, {CONTACT(3300, 3800), CONTACT(3900, 3800)}, {CONTACT(3300, 2200), CONTACT(3900, 2200)}},
+      {40, 0, false, {LIFTED, LIFTED}, {LIFTED, LIFTED}},
+  };
+#undef CONTACT
+#undef LIFTED
+  const size_t scroll_down_length = sizeof(scroll_down) / sizeof(scroll_down[0]);
+
+  tuning::Settings reversed(bool reverse)
+  {
+    tuning::Settings values = tuning::defaults;
+    values.reverse_UD_scroll = reverse;
+    values.reverse_LR_scroll = reverse;
+    return values;
+  }
+
+  replay::Host scroll(replay::Device device, bool reverse)
+  {
+    replay::Frames frames = replay::record(scroll_down, scroll_down_length,
+                                           replay::length_of(scroll_down, scroll_down_length), device);
+    return replay::play(frames, reversed(reverse));
+  }
+
+  // A packet of the guest, encapsulated in one of the pad with w = 3.
+  void send_guest(uint8_t status, uint8_t x, uint8_t y)
+  {
+    const uint8_t bytes[] = {0x84, status, 0x00, 0xC4, x, y};
+    for (uint8_t data : bytes)
+    {
+      decoder::captured_packet packet;
+      if (decoder::frame_byte(data, 0, packet))
+      {
+        decoder::decode(packet);
+      }
+    }
+  }
+} // namespace
+
+void setUp() {}
+
+void tearDown() { synaptics::pass_through = false; }
+
+// Rolling the wheel towards the user scrolls down, whatever the reverse
+// settings of the pad say.
+void test_wheel_scrolls_the_same_way_reversed_or_not()
+{
+  replay::Host plain = scroll(replay::Device::IntelliMouse, false);
+  replay::Host reverse = scroll(replay::Device::IntelliMouse, true);
+
+  TEST_ASSERT_TRUE(synaptics::protocol == synaptics::Protocol::IntelliMouse);
+  TEST_ASSERT_TRUE(plain.scroll < 0);
+  TEST_ASSERT_EQUAL_INT32(plain.scroll, reverse.scroll);
+}
+
+// The pad itself still follows the settings.
+void test_pad_scroll_follows_the_reverse_setting()
+{
+  replay::Host plain = scroll(replay::Device::Synaptics, false);
+  replay::Host reverse = scroll(replay::Device::Synaptics, true);
+
+  TEST_ASSERT_TRUE(synaptics::protocol == synaptics::Protocol::Synaptics);
+  TEST_ASSERT_TRUE(plain.scroll != 0);
+  TEST_ASSERT_EQUAL_INT32(-plain.scroll, reverse.scroll);
+}
+
+void test_guest_reports_are_marked_as_mouse()
+{
+  replay::record(scroll_down, 1, 0);
+  synaptics::pass_through = true;
+  decoder::begin(tuning::defaults, {.report_ready = nullptr, .wait_for_output = nullptr, .save_calibration = nullptr});
+
+  // Right and 5 counts up, with the left button.
+  send_guest(0x08 | MOUSE_LEFT, 5, 3);
+  decoder::report item;
+  TEST_ASSERT_TRUE(decoder::next_report(item));
+  TEST_ASSERT_TRUE(item.mouse);
+  TEST_ASSERT_EQUAL_INT8(5, item.x);
+  TEST_ASSERT_EQUAL_INT8(-3, item.y);
+  TEST_ASSERT_EQUAL_UINT8(MOUSE_LEFT, item.held_buttons);
+}
+
+// A pad found again, e.g. after a reset, has no guest until it says so.
+void test_init_forgets_the_guest()
+{
+  synaptics::pass_through = true;
+  replay::record(scroll_down, 1, 0, replay::Device::IntelliMouse);
+  TEST_ASSERT_FALSE(synaptics::pass_through);
+
+  synaptics::pass_through = true;
+  replay::record(scroll_down, 1, 0);
+  TEST_ASSERT_FALSE(synaptics::pass_through);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_wheel_scrolls_the_same_way_reversed_or_not);
+  RUN_TEST(test_pad_scroll_follows_the_reverse_setting);
+  RUN_TEST(test_guest_reports_are_marked_as_mouse);
+  RUN_TEST(test_init_forgets_the_guest);
+  return UNITY_END();
+}
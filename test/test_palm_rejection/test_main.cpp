@@ -0,0 +1,178 @@
+// Palm rejection on a labeled corpus of touches of the simulated pad: the
+// precision and recall of the palm classifier, and what palms still get
+// through to the host.
+#include <unity.h>
+#include <cstdio>
+#include "../replay/replay.h"
+
+namespace
+{
+#define TOUCH(x, y, z, w) {(x), (y), (z), (w)}
+#define LIFTED {0, 0, 0, 0}
+  // A touch of one or two contacts, in two steps, and how many of them are
+  // palms.
+  struct Sample
+  {
+    const char *name;
+    int palms;
+    replay::Step touch[2];
+  };
+
+  const Sample corpus[] = {
+      {"resting heel of the hand", 1,
+       {{20, 1, false, {TOUCH(3000, 1400, 130, 12), LIFTED}, {TOUCH(3000, 1400, 130, 12), LIFTED}},
+        {20, 1, false, {TOUCH(3000, 1400, 130, 12), LIFTED}, {TOUCH(3000, 1400, 130, 12), LIFTED}}}},
+      {"creeping palm", 1,
+       {{20, 1, false, {TOUCH(2000, 1600, 120, 11), LIFTED}, {TOUCH(2040, 1620, 120, 11), LIFTED}},
+        {20, 1, false, {TOUCH(2040, 1620, 120, 11), LIFTED}, {TOUCH(2090, 1640, 115, 11), LIFTED}}}},
+      {"edge of the hand", 1,
+       {{20, 1, false, {TOUCH(5200, 2500, 140, 8), LIFTED}, {TOUCH(5200, 2500, 140, 8), LIFTED}},
+        {20, 1, false, {TOUCH(5200, 2500, 140, 8), LIFTED}, {TOUCH(5200, 2520, 140, 8), LIFTED}}}},
+      {"wide light palm", 1,
+       {{20, 1, false, {TOUCH(4000, 1500, 80, 13), LIFTED}, {TOUCH(4000, 1500, 80, 13), LIFTED}},
+        {20, 1, false, {TOUCH(4000, 1500, 80, 13), LIFTED}, {TOUCH(4000, 1500, 75, 13), LIFTED}}}},
+      {"palm brushing the pad", 1,
+       {{4, 1, false, {TOUCH(3500, 1500, 90, 11), LIFTED}, {TOUCH(3500, 1500, 120, 12), LIFTED}},
+        {6, 1, false, {TOUCH(3500, 1500, 120, 12), LIFTED}, {TOUCH(3500, 1500, 120, 12), LIFTED}}}},
+      {"palm resting while a finger moves", 1,
+       {{10, 2, false, {TOUCH(2000, 1500, 130, 12), TOUCH(3500, 3000, 60, 6)}, {TOUCH(2000, 1500, 130, 12), TOUCH(3500, 3000, 60, 6)}},
+        {40, 2, false, {TOUCH(2000, 1500, 130, 12), TOUCH(3500, 3000, 60, 6)}, {TOUCH(2000, 1500, 130, 12), TOUCH(4500, 3800, 60, 6)}}}},
+      {"finger moving", 0,
+       {{10, 1, false, {TOUCH(2500, 2500, 60, 6), LIFTED}, {TOUCH(2500, 2500, 60, 6), LIFTED}},
+        {40, 1, false, {TOUCH(2500, 2500, 60, 6), LIFTED}, {TOUCH(4000, 3500, 60, 6), LIFTED}}}},
+      {"tap", 0,
+       {{3, 1, false, {TOUCH(3500, 3000, 40, 5), LIFTED}, {TOUCH(3500, 3000, 50, 5), LIFTED}},
+        {3, 1, false, {TOUCH(3500, 3000, 50, 5), LIFTED}, {TOUCH(3500, 3000, 40, 5), LIFTED}}}},
+      {"heavy finger swiping", 0,
+       {{4, 1, false, {TOUCH(2000, 2500, 110, 8), LIFTED}, {TOUCH(2200, 2600, 110, 8), LIFTED}},
+        {20, 1, false, {TOUCH(2200, 2600, 110, 8), LIFTED}, {TOUCH(4600, 3800, 110, 8), LIFTED}}}},
+      {"finger resting, then moving", 0,
+       {{20, 1, false, {TOUCH(3000, 3000, 70, 7), LIFTED}, {TOUCH(3000, 3000, 70, 7), LIFTED}},
+        {30, 1, false, {TOUCH(3000, 3000, 70, 7), LIFTED}, {TOUCH(4200, 2400, 70, 7), LIFTED}}}},
+      {"thumb moving slowly", 0,
+       {{10, 1, false, {TOUCH(2500, 2000, 95, 9), LIFTED}, {TOUCH(2500, 2000, 95, 9), LIFTED}},
+        {40, 1, false, {TOUCH(2500, 2000, 95, 9), LIFTED}, {TOUCH(3300, 2400, 95, 9), LIFTED}}}},
+      {"two fingers scrolling", 0,
+       {{8, 2, false, {TOUCH(3300, 3800, 60, 6), TOUCH(3900, 3800, 60, 6)}, {TOUCH(3300, 3800, 60, 6), TOUCH(3900, 3800, 60, 6)}},
+        {40, 2, false, {TOUCH(3300, 3800, 60, 6), TOUCH(3900, 3800, 60, 6)}, {TOUCH(3300, 2400, 60, 6), TOUCH(3900, 2400, 60, 6)}}}},
+  };
+  const size_t corpus_length = sizeof(corpus) / sizeof(corpus[0]);
+
+  replay::Host play(const Sample &sample)
+  {
+    replay::Step script[] = {
+        {8, 0, false, {LIFTED, LIFTED}, {LIFTED, LIFTED}},
+        sample.touch[0],
+        sample.touch[1],
+        {8, 0, false, {LIFTED, LIFTED}, {LIFTED, LIFTED}},
+    };
+    size_t length = sizeof(script) / sizeof(script[0]);
+    replay::Frames frames = replay::record(script, length, replay::length_of(script, length));
+    return replay::play(frames, tuning::defaults);
+  }
+#undef TOUCH
+#undef LIFTED
+
+  long moved(const replay::Host &host)
+  {
+    return abs(host.x) + abs(host.y) + abs(host.scroll);
+  }
+
+  int clicks(const replay::Host &host)
+  {
+    int count = 0;
+    for (int i = 1; i < 6; i++)
+    {
+      count += host.clicks[i];
+    }
+    return count + host.presses(0xFF);
+  }
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_palm_precision_and_recall()
+{
+  int true_positives = 0;
+  int false_positives = 0;
+  int false_negatives = 0;
+  for (size_t i = 0; i < corpus_length; i++)
+  {
+    replay::Host host = play(corpus[i]);
+    // Which contact was flagged isn't known, only how many.
+    int found = host.stats.palms;
+    int correct = found < corpus[i].palms ? found : corpus[i].palms;
+    true_positives += correct;
+    false_positives += found - correct;
+    false_negatives += corpus[i].palms - correct;
+    if (found != corpus[i].palms)
+    {
+      char line[120];
+      snprintf(line, sizeof(line), "%s: %d palms, %d found", corpus[i].name, corpus[i].palms, found);
+      TEST_MESSAGE(line);
+    }
+  }
+
+  float precision = (float)true_positives / (true_positives + false_positives);
+  float recall = (float)true_positives / (true_positives + false_negatives);
+  char line[120];
+  snprintf(line, sizeof(line), "%u touches, precision: %.2f, recall: %.2f",
+           (unsigned)corpus_length, (double)precision, (double)recall);
+  TEST_MESSAGE(line);
+
+  // What the defaults get. A heavy finger that lands before it swipes is
+  // still taken for a palm.
+  TEST_ASSERT_TRUE(precision >= 0.85F);
+  TEST_ASSERT_TRUE(recall >= 0.95F);
+}
+
+// Contacts taken for palms neither move nor click, and every other touch of
+// a finger does one or the other.
+void test_palms_are_dropped_through_the_pipeline()
+{
+  for (size_t i = 0; i < corpus_length; i++)
+  {
+    if (corpus[i].touch[0].fingers != 1)
+    {
+      continue;
+    }
+    replay::Host host = play(corpus[i]);
+    if (host.stats.palms > 0)
+    {
+      TEST_ASSERT_EQUAL_INT_MESSAGE(0, clicks(host), corpus[i].name);
+      TEST_ASSERT_TRUE_MESSAGE(moved(host) <= 2, corpus[i].name);
+    }
+    else
+    {
+      TEST_ASSERT_TRUE_MESSAGE(clicks(host) > 0 || moved(host) > 10, corpus[i].name);
+    }
+  }
+}
+
+// A finger moving next to a resting palm still moves the cursor, rather
+// than scrolling.
+void test_finger_next_to_a_palm_moves_the_cursor()
+{
+  const Sample *sample = &corpus[0];
+  while (sample->touch[0].fingers != 2 || sample->palms != 1)
+  {
+    sample++;
+  }
+  replay::Host host = play(*sample);
+
+  TEST_ASSERT_TRUE(host.x > 20);
+  TEST_ASSERT_TRUE(host.y < -20);
+  TEST_ASSERT_EQUAL_INT(0, host.scroll);
+  TEST_ASSERT_EQUAL_INT(0, clicks(host));
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_palm_precision_and_recall);
+  RUN_TEST(test_palms_are_dropped_through_the_pipeline);
+  RUN_TEST(test_finger_next_to_a_palm_moves_the_cursor);
+  return UNITY_END();
+}
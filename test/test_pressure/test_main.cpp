@@ -0,0 +1,185 @@
+// How hard a finger presses, read from z: the tip pressure of the pen in the
+// absolute mode, and deep presses, in scripts through the decoder.
+#include <unity.h>
+#include "../replay/replay.h"
+
+namespace
+{
+#define CONTACT(z) {3000, 3000, (int16_t)(z), 6}
+#define LIFTED {0, 0, 0, 0}
+#define NOTHING(frames) {(frames), 0, false, {LIFTED, LIFTED}, {LIFTED, LIFTED}}
+#define HOVER(frames) {(frames), 1, false, {CONTACT(60), LIFTED}, {CONTACT(60), LIFTED}}
+#define PRESS(frames, from, to) {(frames), 1, true, {CONTACT(from), LIFTED}, {CONTACT(to), LIFTED}}
+  // Two presses that keep pressing well past the click.
+  replay::Step deep_presses[] = {
+      NOTHING(4),
+      HOVER(4),
+      PRESS(20, 60, 160),
+      PRESS(10, 160, 160),
+      HOVER(4),
+      NOTHING(8),
+      HOVER(4),
+      PRESS(20, 60, 160),
+      PRESS(10, 160, 160),
+      HOVER(4),
+      NOTHING(8),
+  };
+  // A press past deep_press_z that rises too little, since it starts firm,
+  // and one that rises a lot but stays below deep_press_z.
+  replay::Step shallow_presses[] = {
+      NOTHING(4),
+      HOVER(4),
+      PRESS(20, 95, 130),
+      HOVER(4),
+      NOTHING(8),
+      HOVER(4),
+      PRESS(20, 50, 115),
+      HOVER(4),
+      NOTHING(8),
+  };
+  // Presses held at one z each: below pressure_z_min, at it, halfway, at
+  // pressure_z_max, and beyond it.
+  const int held_z[] = {20, 30, 75, 120, 200};
+  replay::Step held_presses[] = {
+      NOTHING(4),
+      PRESS(6, 20, 20),
+      NOTHING(4),
+      PRESS(6, 30, 30),
+      NOTHING(4),
+      PRESS(6, 75, 75),
+      NOTHING(4),
+      PRESS(6, 120, 120),
+      NOTHING(4),
+      PRESS(6, 200, 200),
+      NOTHING(4),
+  };
+#undef PRESS
+#undef HOVER
+#undef NOTHING
+#undef CONTACT
+#undef LIFTED
+
+  const uint8_t deep_press_button = 3;
+
+  tuning::Settings deep(bool absolute_mode)
+  {
+    tuning::Settings values = tuning::defaults;
+    values.deep_press_button = deep_press_button;
+    values.absolute_mode = absolute_mode;
+    return values;
+  }
+
+  replay::Host play(const replay::Step *script, size_t length, const tuning::Settings &values)
+  {
+    replay::Frames frames = replay::record(script, length, replay::length_of(script, length));
+    return replay::play(frames, values);
+  }
+
+  // The pen reports with the tip down, in order.
+  std::vector<decoder::report> tips(const replay::Host &host)
+  {
+    std::vector<decoder::report> result;
+    for (const replay::Received &received : host.reports)
+    {
+      TEST_ASSERT_TRUE(received.item.absolute);
+      if (received.item.pen & PEN_TIP)
+      {
+        result.push_back(received.item);
+      }
+    }
+    return result;
+  }
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_deep_press_clicks_once_per_press()
+{
+  replay::Host host = play(deep_presses, 6, deep(false));
+  TEST_ASSERT_EQUAL_INT(1, host.clicks[deep_press_button]);
+
+  host = play(deep_presses, sizeof(deep_presses) / sizeof(deep_presses[0]), deep(false));
+  TEST_ASSERT_EQUAL_INT(2, host.clicks[deep_press_button]);
+  TEST_ASSERT_EQUAL_INT(2, host.presses(0x01));
+}
+
+void test_deep_press_is_off_without_a_button()
+{
+  replay::Host host = play(deep_presses, sizeof(deep_presses) / sizeof(deep_presses[0]), tuning::defaults);
+
+  TEST_ASSERT_EQUAL_INT(0, host.clicks[deep_press_button]);
+  TEST_ASSERT_EQUAL_INT(2, host.presses(0x01));
+}
+
+void test_shallow_press_is_not_deep()
+{
+  replay::Host host = play(shallow_presses, sizeof(shallow_presses) / sizeof(shallow_presses[0]), deep(false));
+
+  for (int i = 1; i < 6; i++)
+  {
+    TEST_ASSERT_EQUAL_INT(0, host.clicks[i]);
+  }
+  TEST_ASSERT_EQUAL_INT(2, host.presses(0x01));
+}
+
+void test_tip_pressure_follows_z_between_the_limits()
+{
+  replay::Host host = play(held_presses, sizeof(held_presses) / sizeof(held_presses[0]), deep(true));
+  std::vector<decoder::report> reports = tips(host);
+
+  const int presses = sizeof(held_z) / sizeof(held_z[0]);
+  const uint8_t expected[presses] = {0, 0, PEN_PRESSURE_MAX / 2, PEN_PRESSURE_MAX, PEN_PRESSURE_MAX};
+  TEST_ASSERT_EQUAL_INT(presses * 6, (int)reports.size());
+  for (int i = 0; i < presses; i++)
+  {
+    for (int frame = 0; frame < 6; frame++)
+    {
+      TEST_ASSERT_EQUAL_UINT8(expected[i], reports[i * 6 + frame].pressure);
+    }
+  }
+}
+
+// Pressing past a click adds the barrel button until the pad comes up, and
+// only while deep presses have a button.
+void test_deep_press_adds_the_barrel_in_absolute_mode()
+{
+  replay::Host host = play(deep_presses, sizeof(deep_presses) / sizeof(deep_presses[0]), deep(true));
+  std::vector<decoder::report> reports = tips(host);
+
+  int barrels = 0;
+  bool barrel = false;
+  for (const replay::Received &received : host.reports)
+  {
+    bool now = (received.item.pen & PEN_BARREL) != 0;
+    if (barrel && (received.item.pen & PEN_TIP))
+    {
+      TEST_ASSERT_TRUE(now);
+    }
+    barrels += now && !barrel;
+    barrel = now;
+  }
+  TEST_ASSERT_EQUAL_INT(2, barrels);
+  TEST_ASSERT_EQUAL_UINT8(0, reports.front().pen & PEN_BARREL);
+  TEST_ASSERT_EQUAL_UINT8(PEN_TIP | PEN_BARREL, reports.back().pen & (PEN_TIP | PEN_BARREL));
+  TEST_ASSERT_EQUAL_INT(0, host.clicks[deep_press_button]);
+
+  tuning::Settings values = deep(true);
+  values.deep_press_button = 0;
+  for (const decoder::report &item : tips(play(deep_presses, sizeof(deep_presses) / sizeof(deep_presses[0]), values)))
+  {
+    TEST_ASSERT_EQUAL_UINT8(0, item.pen & PEN_BARREL);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_deep_press_clicks_once_per_press);
+  RUN_TEST(test_deep_press_is_off_without_a_button);
+  RUN_TEST(test_shallow_press_is_not_deep);
+  RUN_TEST(test_tip_pressure_follows_z_between_the_limits);
+  RUN_TEST(test_deep_press_adds_the_barrel_in_absolute_mode);
+  return UNITY_END();
+}
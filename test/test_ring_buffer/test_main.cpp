@@ -0,0 +1,315 @@
+// RingBuffer and SpscQueue: behaviour, and microbenchmarks against the ring
+// they replaced. The timings are printed, not checked, since they depend on
+// the machine.
+#include <unity.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <synaptics.h>
+#include "legacy_ring_buffer.h"
+
+namespace
+{
+  // The size of a delayed report in the firmware.
+  struct item
+  {
+    uint8_t buttons;
+    int8_t x;
+    int8_t y;
+    int8_t scroll;
+    uint32_t sequence;
+    uint16_t position_x;
+    uint16_t position_y;
+    uint32_t pressure;
+  };
+
+  const int rounds = 400000;
+  const int handovers = 5000;
+  // The report ring holds frames_delay reports most of the time.
+  const int depth = 20;
+  volatile int sink;
+
+  double elapsed_ns(std::chrono::steady_clock::time_point started, int count)
+  {
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - started;
+    return elapsed.count() / count;
+  }
+
+  void print_timing(const char *name, double legacy_ns, double current_ns)
+  {
+    char line[128];
+    snprintf(line, sizeof(line), "%s: %.2f ns before, %.2f ns now", name, legacy_ns, current_ns);
+    TEST_MESSAGE(line);
+  }
+
+  // One packet of the touchpad task: a report in, the oldest one out.
+  template <class Ring>
+  double time_push_pop()
+  {
+    Ring ring;
+    for (int i = 0; i < depth; i++)
+    {
+      ring.push_back(item{});
+    }
+    auto started = std::chrono::steady_clock::now();
+    int total = 0;
+    for (int i = 0; i < rounds; i++)
+    {
+      item next = {};
+      next.x = i;
+      ring.push_back(next);
+      total += ring.pop_front().x;
+    }
+    sink = total;
+    return elapsed_ns(started, rounds);
+  }
+
+  // Freezing every delayed report, one item at a time through operator[].
+  double time_legacy_freeze()
+  {
+    LegacyRingBuffer<item, 32> ring;
+    for (int i = 0; i < 16; i++)
+    {
+      ring.push_back(item{});
+      ring.pop_front();
+    }
+    for (int i = 0; i < depth; i++)
+    {
+      ring.push_back(item{1, 1, 1, 1});
+    }
+    auto started = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds / depth; i++)
+    {
+      for (int j = 0; j < ring.size(); j++)
+      {
+        ring[j].x = 0;
+        ring[j].y = 0;
+        ring[j].scroll = 0;
+      }
+      ring[i % depth].x = 1;
+    }
+    sink = ring[0].x;
+    return elapsed_ns(started, rounds / depth * depth);
+  }
+
+  // The same through the two contiguous segments.
+  double time_segment_freeze()
+  {
+    RingBuffer<item, 32> ring;
+    for (int i = 0; i < 16; i++)
+    {
+      ring.push_back(item{});
+      ring.pop_front();
+    }
+    for (int i = 0; i < depth; i++)
+    {
+      ring.push_back(item{1, 1, 1, 1});
+    }
+    auto started = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds / depth; i++)
+    {
+      for (int part = 0; part < 2; part++)
+      {
+        for (item &frozen : ring.segment(part))
+        {
+          frozen.x = 0;
+          frozen.y = 0;
+          frozen.scroll = 0;
+        }
+      }
+      ring[i % depth].x = 1;
+    }
+    sink = ring[0].x;
+    return elapsed_ns(started, rounds / depth * depth);
+  }
+
+  // The ring under a lock, which is what the output channel would otherwise
+  // be between the two tasks.
+  class LockedQueue
+  {
+  public:
+    bool push(const item &next)
+    {
+      std::lock_guard<std::mutex> guard(m_lock);
+      return m_ring.push_back(next);
+    }
+
+    bool pop(item &next)
+    {
+      std::lock_guard<std::mutex> guard(m_lock);
+      return m_ring.try_pop(next);
+    }
+
+  private:
+    std::mutex m_lock;
+    RingBuffer<item, 32> m_ring;
+  };
+
+  // A producer and a consumer thread passing rounds items, in order.
+  template <class Queue>
+  double time_handover(Queue &queue, bool &in_order)
+  {
+    const int count = handovers;
+    std::atomic<bool> ordered(true);
+    auto started = std::chrono::steady_clock::now();
+    std::thread consumer([&]() {
+      item next;
+      for (uint32_t expected = 0; expected < (uint32_t)count;)
+      {
+        if (queue.pop(next))
+        {
+          if (next.sequence != expected)
+          {
+            ordered = false;
+          }
+          expected++;
+        }
+      }
+    });
+    for (int i = 0; i < count;)
+    {
+      item next = {};
+      next.sequence = i;
+      if (queue.push(next))
+      {
+        i++;
+      }
+    }
+    consumer.join();
+    in_order = ordered;
+    return elapsed_ns(started, count);
+  }
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_ring_buffer_is_a_fifo_across_the_wrap()
+{
+  RingBuffer<int, 4> ring;
+  for (int i = 0; i < 10; i++)
+  {
+    TEST_ASSERT_TRUE(ring.push_back(i));
+    TEST_ASSERT_TRUE(ring.push_back(i + 100));
+    TEST_ASSERT_EQUAL_INT(i, ring.pop_front());
+    TEST_ASSERT_EQUAL_INT(i + 100, ring.pop_front());
+  }
+  TEST_ASSERT_TRUE(ring.empty());
+}
+
+void test_ring_buffer_pop_on_empty_leaves_it_empty()
+{
+  RingBuffer<int, 4> ring;
+  TEST_ASSERT_EQUAL_INT(0, ring.pop_front());
+  int item = -1;
+  TEST_ASSERT_FALSE(ring.try_pop(item));
+  TEST_ASSERT_EQUAL_INT(-1, item);
+  TEST_ASSERT_EQUAL_INT(0, ring.size());
+  TEST_ASSERT_NULL(ring.peek());
+  TEST_ASSERT_NULL(ring.peek_back());
+  ring.push_back(7);
+  TEST_ASSERT_EQUAL_INT(1, ring.size());
+  TEST_ASSERT_EQUAL_INT(7, *ring.peek());
+}
+
+void test_ring_buffer_counts_overflows()
+{
+  RingBuffer<int, 4> ring;
+  for (int i = 0; i < 6; i++)
+  {
+    ring.push_back(i);
+  }
+  TEST_ASSERT_TRUE(ring.full());
+  TEST_ASSERT_EQUAL_UINT32(2, ring.overflows());
+  TEST_ASSERT_EQUAL_INT(3, *ring.peek_back());
+}
+
+void test_ring_buffer_segments_cover_the_items_in_order()
+{
+  RingBuffer<int, 8> ring;
+  for (int i = 0; i < 6; i++)
+  {
+    ring.push_back(-1);
+    ring.pop_front();
+  }
+  for (int i = 0; i < 5; i++)
+  {
+    ring.push_back(i);
+  }
+  // Two items up to the end of the storage, three from its start.
+  TEST_ASSERT_EQUAL_INT(2, ring.segment(0).size);
+  TEST_ASSERT_EQUAL_INT(3, ring.segment(1).size);
+  int expected = 0;
+  for (int part = 0; part < 2; part++)
+  {
+    for (int &item : ring.segment(part))
+    {
+      TEST_ASSERT_EQUAL_INT(expected++, item);
+      item = -item;
+    }
+  }
+  TEST_ASSERT_EQUAL_INT(-4, ring[4]);
+}
+
+void test_spsc_queue_hands_items_over_in_order()
+{
+  SpscQueue<item, 32> queue;
+  bool in_order = false;
+  time_handover(queue, in_order);
+  TEST_ASSERT_TRUE(in_order);
+  TEST_ASSERT_EQUAL_INT(0, queue.size());
+}
+
+void test_spsc_queue_holds_one_less_than_its_size()
+{
+  SpscQueue<int, 4> queue;
+  TEST_ASSERT_TRUE(queue.push(1));
+  TEST_ASSERT_TRUE(queue.push(2));
+  TEST_ASSERT_TRUE(queue.push(3));
+  TEST_ASSERT_FALSE(queue.push(4));
+  TEST_ASSERT_EQUAL_INT(3, queue.size());
+  int item;
+  TEST_ASSERT_TRUE(queue.pop(item));
+  TEST_ASSERT_EQUAL_INT(1, item);
+}
+
+void benchmark_push_pop()
+{
+  print_timing("push and pop", time_push_pop<LegacyRingBuffer<item, 32>>(),
+               time_push_pop<RingBuffer<item, 32>>());
+}
+
+void benchmark_freeze()
+{
+  print_timing("freeze per report", time_legacy_freeze(), time_segment_freeze());
+}
+
+void benchmark_handover()
+{
+  LockedQueue locked;
+  SpscQueue<item, 32> lock_free;
+  bool in_order;
+  double locked_ns = time_handover(locked, in_order);
+  TEST_ASSERT_TRUE(in_order);
+  double lock_free_ns = time_handover(lock_free, in_order);
+  TEST_ASSERT_TRUE(in_order);
+  print_timing("handover between threads, locked ring before", locked_ns, lock_free_ns);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_ring_buffer_is_a_fifo_across_the_wrap);
+  RUN_TEST(test_ring_buffer_pop_on_empty_leaves_it_empty);
+  RUN_TEST(test_ring_buffer_counts_overflows);
+  RUN_TEST(test_ring_buffer_segments_cover_the_items_in_order);
+  RUN_TEST(test_spsc_queue_hands_items_over_in_order);
+  RUN_TEST(test_spsc_queue_holds_one_less_than_its_size);
+  RUN_TEST(benchmark_push_pop);
+  RUN_TEST(benchmark_freeze);
+  RUN_TEST(benchmark_handover);
+  return UNITY_END();
+}
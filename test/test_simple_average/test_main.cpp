@@ -0,0 +1,213 @@
+// SimpleAverage against the implementation it replaced: the same averages
+// on the same samples, its sum type, and how much faster a packet is.
+#include <unity.h>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <random>
+#include <synaptics.h>
+#include "legacy_simple_average.h"
+
+static_assert(std::is_same<SimpleAverage<int16_t, 8>::sum_type, int32_t>::value,
+              "16 bit samples add up in 32 bits");
+static_assert(std::is_same<SimpleAverage<int32_t, 8>::sum_type, int64_t>::value,
+              "32 bit samples add up in 64 bits");
+static_assert(std::is_same<SimpleAverage<float, 8>::sum_type, float>::value,
+              "floats add up in floats");
+
+namespace
+{
+  volatile int sink;
+
+  // Feeds both implementations the same samples, with a reset now and then
+  // like a lifted finger, and compares everything they tell.
+  template <int N>
+  void check_equivalence(unsigned seed, int low, int high)
+  {
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> sample(low, high);
+    LegacySimpleAverage<int16_t, N> legacy;
+    SimpleAverage<int16_t, N> current;
+    for (int i = 0; i < 20000; i++)
+    {
+      if (random() % 50 == 0)
+      {
+        legacy.reset();
+        current.reset();
+      }
+      int16_t data = sample(random);
+      TEST_ASSERT_EQUAL_INT(legacy.filter(data), current.filter(data));
+      TEST_ASSERT_EQUAL_INT(legacy.average(), current.average());
+      TEST_ASSERT_EQUAL_INT(legacy.count(), current.count());
+      TEST_ASSERT_EQUAL_INT(legacy.sum(), current.sum());
+      TEST_ASSERT_EQUAL_INT(legacy.oldest(), current.oldest());
+      TEST_ASSERT_EQUAL_INT(legacy.newest(), current.newest());
+    }
+  }
+
+  // What a packet costs in the touchpad task: each axis of a finger is
+  // filtered, and its average read before and after.
+  template <class Average>
+  double time_packets(const int16_t *samples, int count)
+  {
+    Average x;
+    Average y;
+    int total = 0;
+    auto started = std::chrono::steady_clock::now();
+    for (int round = 0; round < 50; round++)
+    {
+      for (int i = 0; i < count; i++)
+      {
+        total += x.average();
+        total += x.filter(samples[i]);
+        total += y.average();
+        total += y.filter(samples[count - 1 - i]);
+      }
+    }
+    sink = total;
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - started;
+    return elapsed.count() / (50.0 * count);
+  }
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_matches_the_legacy_average_on_positions()
+{
+  check_equivalence<5>(1, 1000, 6000);
+  check_equivalence<8>(2, 1000, 6000);
+}
+
+void test_matches_the_legacy_average_on_signed_speeds()
+{
+  // Negative sums round towards zero in both.
+  check_equivalence<5>(3, -300, 300);
+  check_equivalence<8>(4, -300, 300);
+  check_equivalence<3>(5, SHRT_MIN, SHRT_MAX);
+}
+
+void test_extreme_samples_fill_the_sum_exactly()
+{
+  SimpleAverage<int16_t, 8> highest;
+  SimpleAverage<int16_t, 8> lowest;
+  for (int i = 0; i < 20; i++)
+  {
+    highest.filter(SHRT_MAX);
+    lowest.filter(SHRT_MIN);
+  }
+  TEST_ASSERT_EQUAL_INT(SHRT_MAX, highest.average());
+  TEST_ASSERT_EQUAL_INT(8 * SHRT_MAX, highest.sum());
+  TEST_ASSERT_EQUAL_INT(SHRT_MIN, lowest.average());
+}
+
+void test_wide_samples_use_a_wide_sum()
+{
+  SimpleAverage<int32_t, 4> average;
+  for (int i = 0; i < 6; i++)
+  {
+    average.filter(INT_MAX);
+  }
+  TEST_ASSERT_EQUAL_INT(INT_MAX, average.average());
+  TEST_ASSERT_TRUE(average.sum() == 4LL * INT_MAX);
+}
+
+void test_average_grows_until_the_window_is_full()
+{
+  SimpleAverage<int16_t, 4> average;
+  TEST_ASSERT_EQUAL_INT(0, average.average());
+  TEST_ASSERT_EQUAL_INT(10, average.filter(10));
+  TEST_ASSERT_EQUAL_INT(15, average.filter(20));
+  TEST_ASSERT_EQUAL_INT(20, average.filter(30));
+  TEST_ASSERT_EQUAL_INT(25, average.filter(40));
+  TEST_ASSERT_EQUAL_INT(35, average.filter(50));
+  TEST_ASSERT_EQUAL_INT(4, average.count());
+}
+
+void test_seeded_average_starts_with_a_full_window()
+{
+  SimpleAverage<int16_t, 4, AverageWarmUp::Seed> average;
+  TEST_ASSERT_EQUAL_INT(0, average.average());
+  TEST_ASSERT_EQUAL_INT(0, average.count());
+  TEST_ASSERT_EQUAL_INT(10, average.filter(10));
+  TEST_ASSERT_EQUAL_INT(4, average.count());
+  TEST_ASSERT_EQUAL_INT(40, average.sum());
+  TEST_ASSERT_EQUAL_INT(10, average.oldest());
+  // Each sample replaces a copy of the first one.
+  TEST_ASSERT_EQUAL_INT(12, average.filter(20));
+  TEST_ASSERT_EQUAL_INT(17, average.filter(30));
+  TEST_ASSERT_EQUAL_INT(25, average.filter(40));
+  TEST_ASSERT_EQUAL_INT(35, average.filter(50));
+  TEST_ASSERT_EQUAL_INT(50, average.newest());
+  TEST_ASSERT_EQUAL_INT(20, average.oldest());
+
+  // A reset seeds again.
+  average.reset();
+  TEST_ASSERT_EQUAL_INT(-7, average.filter(-7));
+  TEST_ASSERT_EQUAL_INT(-28, average.sum());
+}
+
+// On a steady motion, the growing average moves at half the speed of the
+// motion until the window is full, while the seeded one ramps up to it
+// without ever overshooting.
+void test_seeded_average_ramps_up_to_a_steady_motion()
+{
+  SimpleAverage<int16_t, 5> grow;
+  SimpleAverage<int16_t, 5, AverageWarmUp::Seed> seed;
+  int grow_last = grow.filter(1000);
+  int seed_last = seed.filter(1000);
+  int seed_step = 0;
+  for (int i = 1; i < 5; i++)
+  {
+    int position = 1000 + 100 * i;
+    int grow_now = grow.filter(position);
+    int seed_now = seed.filter(position);
+    TEST_ASSERT_EQUAL_INT(50, grow_now - grow_last);
+    TEST_ASSERT_TRUE(seed_now - seed_last >= seed_step);
+    TEST_ASSERT_TRUE(seed_now - seed_last <= 100);
+    seed_step = seed_now - seed_last;
+    grow_last = grow_now;
+    seed_last = seed_now;
+  }
+  // Once the window has filled with the motion, the two agree.
+  for (int i = 5; i < 10; i++)
+  {
+    grow.filter(1000 + 100 * i);
+    seed.filter(1000 + 100 * i);
+  }
+  TEST_ASSERT_EQUAL_INT(grow.average(), seed.average());
+  TEST_ASSERT_EQUAL_INT(grow.sum(), seed.sum());
+}
+
+void benchmark_packet()
+{
+  int16_t samples[1024];
+  std::mt19937 random(6);
+  for (int16_t &sample : samples)
+  {
+    sample = 1000 + random() % 5000;
+  }
+  const int count = sizeof(samples) / sizeof(samples[0]);
+  char line[160];
+  snprintf(line, sizeof(line), "per packet, N = 5: %.2f ns before, %.2f ns now; N = 8: %.2f ns before, %.2f ns now",
+           time_packets<LegacySimpleAverage<int16_t, 5>>(samples, count),
+           time_packets<SimpleAverage<int16_t, 5>>(samples, count),
+           time_packets<LegacySimpleAverage<int16_t, 8>>(samples, count),
+           time_packets<SimpleAverage<int16_t, 8>>(samples, count));
+  TEST_MESSAGE(line);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_matches_the_legacy_average_on_positions);
+  RUN_TEST(test_matches_the_legacy_average_on_signed_speeds);
+  RUN_TEST(test_extreme_samples_fill_the_sum_exactly);
+  RUN_TEST(test_wide_samples_use_a_wide_sum);
+  RUN_TEST(test_average_grows_until_the_window_is_full);
+  RUN_TEST(test_seeded_average_starts_with_a_full_window);
+  RUN_TEST(test_seeded_average_ramps_up_to_a_steady_motion);
+  RUN_TEST(benchmark_packet);
+  return UNITY_END();
+}
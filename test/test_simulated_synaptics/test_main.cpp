@@ -0,0 +1,204 @@
+// synaptics::init() and the packet stream against the simulated pad, so that
+// the PS/2 protocol runs without a pad on the bench.
+#include <unity.h>
+#include <vector>
+#include <ps2.h>
+#include <synaptics.h>
+#include <simulated_synaptics.h>
+
+namespace
+{
+#define CONTACT(x, y) {(x), (y), 60, 6}
+#define LIFTED {0, 0, 0, 0}
+  ps2::SimulatedSynaptics::Step one_finger[] = {
+      {4, 1, false, {CONTACT(3000, 2000), LIFTED}, {CONTACT(3000, 2000), LIFTED}},
+  };
+  ps2::SimulatedSynaptics::Step two_fingers[] = {
+      {4, 2, false, {CONTACT(3000, 2000), CONTACT(4000, 3000)}, {CONTACT(3000, 2000), CONTACT(4000, 3000)}},
+  };
+#undef CONTACT
+#undef LIFTED
+
+  std::vector<uint8_t> received;
+
+  void byte_received(uint8_t data) { received.push_back(data); }
+
+  // The packets streamed so far, 6 bytes each, as the decoder sees them.
+  std::vector<uint64_t> packets()
+  {
+    std::vector<uint64_t> result;
+    for (size_t i = 0; i + 6 <= received.size(); i += 6)
+    {
+      uint64_t packet = 0;
+      for (int j = 0; j < 6; j++)
+      {
+        packet |= (uint64_t)received[i + j] << (j * 8);
+      }
+      result.push_back(packet);
+    }
+    return result;
+  }
+
+  int packet_w(uint64_t packet)
+  {
+    return (packet >> 26) & 0x01 | (packet >> 1) & 0x2 | (packet >> 2) & 0x0C;
+  }
+
+  void start(ps2::SimulatedSynaptics &pad)
+  {
+    ps2::begin(pad, byte_received);
+    ps2::reset();
+    synaptics::init();
+    received.clear();
+  }
+} // namespace
+
+void setUp() { received.clear(); }
+
+void tearDown() {}
+
+void test_init_reads_the_identity_of_the_pad()
+{
+  ps2::SimulatedSynaptics pad(one_finger, 1);
+  start(pad);
+
+  TEST_ASSERT_TRUE(synaptics::protocol == synaptics::Protocol::Synaptics);
+  TEST_ASSERT_EQUAL_INT(ps2::SimulatedSynaptics::units_per_mm_x, synaptics::units_per_mm_x);
+  TEST_ASSERT_EQUAL_INT(ps2::SimulatedSynaptics::units_per_mm_y, synaptics::units_per_mm_y);
+  TEST_ASSERT_EQUAL_INT(1, synaptics::clickpad_type);
+  TEST_ASSERT_EQUAL_INT(ps2::SimulatedSynaptics::min_x, synaptics::min_x);
+  TEST_ASSERT_EQUAL_INT(ps2::SimulatedSynaptics::max_x, synaptics::max_x);
+  TEST_ASSERT_EQUAL_INT(ps2::SimulatedSynaptics::min_y, synaptics::min_y);
+  TEST_ASSERT_EQUAL_INT(ps2::SimulatedSynaptics::max_y, synaptics::max_y);
+  TEST_ASSERT_FALSE(synaptics::pass_through);
+}
+
+void test_init_sets_the_mode_byte_and_streams()
+{
+  ps2::SimulatedSynaptics pad(one_finger, 1);
+  start(pad);
+
+  TEST_ASSERT_EQUAL_HEX8(SYNAPTICS_MODE_ABSOLUTE | SYNAPTICS_MODE_HIGH_RATE |
+                             SYNAPTICS_MODE_DISABLE_GESTURE | SYNAPTICS_MODE_W,
+                         pad.mode_byte());
+  TEST_ASSERT_TRUE(pad.streaming());
+  TEST_ASSERT_TRUE(synaptics::high_rate());
+}
+
+void test_status_request_answers_the_resolution_query()
+{
+  ps2::SimulatedSynaptics pad(one_finger, 1);
+  start(pad);
+
+  uint8_t result[3];
+  synaptics::status_request(0x08, result);
+  TEST_ASSERT_EQUAL_UINT8(ps2::SimulatedSynaptics::units_per_mm_x, result[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x80, result[1] & 0x80);
+  TEST_ASSERT_EQUAL_UINT8(ps2::SimulatedSynaptics::units_per_mm_y, result[2]);
+}
+
+void test_one_finger_streams_absolute_packets()
+{
+  ps2::SimulatedSynaptics pad(one_finger, 1);
+  start(pad);
+
+  pad.frame();
+  std::vector<uint64_t> sent = packets();
+  TEST_ASSERT_EQUAL_INT(1, sent.size());
+  uint64_t packet = sent[0];
+  // Reference: Section 3.2.1, Figure 3-4
+  int x = (packet >> 32) & 0x00FF | (packet >> 0) & 0x0F00 | (packet >> 16) & 0x1000;
+  int y = (packet >> 40) & 0x00FF | (packet >> 4) & 0x0F00 | (packet >> 17) & 0x1000;
+  TEST_ASSERT_EQUAL_HEX8(0x80, packet & 0xC8);
+  TEST_ASSERT_EQUAL_HEX8(0xC0, (packet >> 24) & 0xC8);
+  TEST_ASSERT_EQUAL_INT(3000, x);
+  TEST_ASSERT_EQUAL_INT(2000, y);
+  TEST_ASSERT_EQUAL_INT(60, (packet >> 16) & 0xFF);
+  TEST_ASSERT_EQUAL_INT(6, packet_w(packet));
+}
+
+void test_two_fingers_stream_extended_packets()
+{
+  ps2::SimulatedSynaptics pad(two_fingers, 1);
+  start(pad);
+
+  for (int i = 0; i < 4; i++)
+  {
+    pad.frame();
+  }
+  // One packet a frame, extended and primary in turn.
+  std::vector<uint64_t> streamed = packets();
+  TEST_ASSERT_EQUAL_INT(4, streamed.size());
+  int primary = 0;
+  int extended = 0;
+  for (size_t i = 0; i < streamed.size(); i++)
+  {
+    uint64_t packet = streamed[i];
+    TEST_ASSERT_EQUAL_INT(i % 2 == 0, packet_w(packet) == 2);
+    if (packet_w(packet) == 2)
+    {
+      // Reference: Section 3.2.9.2. Figure 3-14, half the resolution.
+      int x = (packet >> 7) & 0x01FE | (packet >> 23) & 0x1E00;
+      int y = (packet >> 15) & 0x01FE | (packet >> 27) & 0x1E00;
+      TEST_ASSERT_EQUAL_INT(1, (packet >> 44) & 0x0F);
+      TEST_ASSERT_INT_WITHIN(1, 4000, x);
+      TEST_ASSERT_INT_WITHIN(1, 3000, y);
+      extended++;
+    }
+    else
+    {
+      TEST_ASSERT_EQUAL_INT(0, packet_w(packet)); // two fingers
+      primary++;
+    }
+  }
+  TEST_ASSERT_GREATER_THAN(0, primary);
+  TEST_ASSERT_GREATER_THAN(0, extended);
+}
+
+void test_low_rate_skips_every_other_frame()
+{
+  ps2::SimulatedSynaptics pad(one_finger, 1);
+  start(pad);
+
+  synaptics::set_high_rate(false);
+  TEST_ASSERT_FALSE(synaptics::high_rate());
+  TEST_ASSERT_EQUAL_HEX8(0, pad.mode_byte() & SYNAPTICS_MODE_HIGH_RATE);
+  received.clear();
+  for (int i = 0; i < 4; i++)
+  {
+    pad.frame();
+  }
+  TEST_ASSERT_EQUAL_INT(2, packets().size());
+
+  synaptics::set_high_rate(true);
+  received.clear();
+  for (int i = 0; i < 4; i++)
+  {
+    pad.frame();
+  }
+  TEST_ASSERT_EQUAL_INT(4, packets().size());
+}
+
+void test_no_packets_while_a_command_is_in_progress()
+{
+  ps2::SimulatedSynaptics pad(one_finger, 1);
+  start(pad);
+
+  pad.pause();
+  pad.frame();
+  pad.resume();
+  TEST_ASSERT_EQUAL_INT(0, received.size());
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_init_reads_the_identity_of_the_pad);
+  RUN_TEST(test_init_sets_the_mode_byte_and_streams);
+  RUN_TEST(test_status_request_answers_the_resolution_query);
+  RUN_TEST(test_one_finger_streams_absolute_packets);
+  RUN_TEST(test_two_fingers_stream_extended_packets);
+  RUN_TEST(test_low_rate_skips_every_other_frame);
+  RUN_TEST(test_no_packets_while_a_command_is_in_progress);
+  return UNITY_END();
+}
@@ -0,0 +1,138 @@
+// Speculative taps end to end: scripts of the simulated pad through the
+// decoder, and the buttons the host holds as a result.
+#include <unity.h>
+#include <cstdio>
+#include "../replay/replay.h"
+
+namespace
+{
+#define CONTACT(x, y) {(x), (y), 60, 6}
+#define LIFTED {0, 0, 0, 0}
+#define STILL(frames, x, y) {(frames), 1, false, {CONTACT(x, y), LIFTED}, {CONTACT(x, y), LIFTED}}
+#define NOTHING(frames) {(frames), 0, false, {LIFTED, LIFTED}, {LIFTED, LIFTED}}
+  // Tap, touch again and rest until the press, then drag and lift.
+  replay::Step tap_and_drag[] = {
+      NOTHING(8),
+      STILL(8, 3500, 3000),
+      NOTHING(8),
+      STILL(10, 3500, 3000),
+      {40, 1, false, {CONTACT(3500, 3000), LIFTED}, {CONTACT(4500, 3600), LIFTED}},
+      NOTHING(60),
+  };
+  // The same, and a tap right after the drag, while it is still in the
+  // report delay.
+  replay::Step drag_then_tap[] = {
+      NOTHING(8),
+      STILL(8, 3500, 3000),
+      NOTHING(8),
+      STILL(10, 3500, 3000),
+      {12, 1, false, {CONTACT(3500, 3000), LIFTED}, {CONTACT(4500, 3600), LIFTED}},
+      NOTHING(4),
+      STILL(8, 3000, 3000),
+      NOTHING(60),
+  };
+
+  // A corpus of touches for latency and false clicks: taps, a double tap,
+  // a tap and drag, and touches that rest and then move or scroll.
+  replay::Step corpus[] = {
+      NOTHING(8),
+      STILL(6, 3500, 3000),
+      NOTHING(80),
+      STILL(10, 2600, 2400),
+      NOTHING(80),
+      STILL(6, 4000, 3200),
+      NOTHING(6),
+      STILL(6, 4000, 3200),
+      NOTHING(80),
+      STILL(8, 3500, 3000),
+      NOTHING(8),
+      STILL(10, 3500, 3000),
+      {40, 1, false, {CONTACT(3500, 3000), LIFTED}, {CONTACT(4500, 3600), LIFTED}},
+      NOTHING(80),
+      STILL(8, 3000, 2500),
+      {60, 1, false, {CONTACT(3000, 2500), LIFTED}, {CONTACT(4400, 3500), LIFTED}},
+      NOTHING(80),
+      {8, 2, false, {CONTACT(3300, 3800), CONTACT(3900, 3800)}, {CONTACT(3300, 3800), CONTACT(3900, 3800)}},
+      {60, 2, false, {CONTACT(3300, 3800), CONTACT(3900, 3800)}, {CONTACT(3300, 2400), CONTACT(3900, 2400)}},
+      NOTHING(80),
+  };
+#undef CONTACT
+#undef LIFTED
+#undef STILL
+#undef NOTHING
+
+  tuning::Settings speculative()
+  {
+    tuning::Settings values = tuning::defaults;
+    values.speculative_tap = true;
+    return values;
+  }
+
+  replay::Host play(const replay::Step *script, size_t length, const tuning::Settings &values)
+  {
+    replay::Frames frames = replay::record(script, length, replay::length_of(script, length));
+    return replay::play(frames, values);
+  }
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_drag_takes_the_speculative_press_over()
+{
+  replay::Host host = play(tap_and_drag, sizeof(tap_and_drag) / sizeof(tap_and_drag[0]), speculative());
+
+  // The tap, then the drag, which holds the button from the press on.
+  TEST_ASSERT_EQUAL_INT(2, host.presses(MOUSE_LEFT));
+  TEST_ASSERT_EQUAL_INT(1, host.stats.speculative_clicks);
+  TEST_ASSERT_EQUAL_INT(1, host.stats.speculative_drags);
+  TEST_ASSERT_EQUAL_INT(0, host.stats.speculative_cancels);
+  TEST_ASSERT_TRUE(host.x > 0);
+  TEST_ASSERT_EQUAL_UINT8(0, host.held.back());
+}
+
+void test_tap_after_a_drag_waits_for_its_release()
+{
+  replay::Host host = play(drag_then_tap, sizeof(drag_then_tap) / sizeof(drag_then_tap[0]), speculative());
+
+  // Had the third press gone out right away, the host would have held the
+  // button from the drag on without a break.
+  TEST_ASSERT_EQUAL_INT(3, host.presses(MOUSE_LEFT));
+  TEST_ASSERT_EQUAL_INT(1, host.stats.speculative_drags);
+  TEST_ASSERT_EQUAL_UINT8(0, host.held.back());
+}
+
+// Click latency and false clicks with and without speculative taps, on the
+// same corpus.
+void test_speculative_taps_click_sooner()
+{
+  size_t length = sizeof(corpus) / sizeof(corpus[0]);
+  replay::Host after_lift = play(corpus, length, tuning::defaults);
+  replay::Host on_touch = play(corpus, length, speculative());
+
+  char line[200];
+  snprintf(line, sizeof(line),
+           "on lift: %u clicks, %.1f ticks; speculative: %u clicks, %.1f ticks, %u false, %u taken over by drags",
+           (unsigned)after_lift.stats.tap_clicks,
+           (double)after_lift.stats.tap_click_ticks / after_lift.stats.tap_clicks,
+           (unsigned)on_touch.stats.tap_clicks, (double)on_touch.stats.tap_click_ticks / on_touch.stats.tap_clicks,
+           (unsigned)on_touch.stats.speculative_cancels, (unsigned)on_touch.stats.speculative_drags);
+  TEST_MESSAGE(line);
+
+  TEST_ASSERT_EQUAL_UINT32(after_lift.stats.tap_clicks, on_touch.stats.tap_clicks);
+  TEST_ASSERT_TRUE(on_touch.stats.tap_click_ticks < after_lift.stats.tap_click_ticks);
+  // Only the touches that rest before moving or scrolling.
+  TEST_ASSERT_TRUE(on_touch.stats.speculative_cancels <= 2);
+  TEST_ASSERT_EQUAL_UINT8(0, after_lift.held.back());
+  TEST_ASSERT_EQUAL_UINT8(0, on_touch.held.back());
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_drag_takes_the_speculative_press_over);
+  RUN_TEST(test_tap_after_a_drag_waits_for_its_release);
+  RUN_TEST(test_speculative_taps_click_sooner);
+  return UNITY_END();
+}
@@ -0,0 +1,118 @@
+// What the tuning block and single field writes accept, since both come
+// straight from a BLE host or the serial port.
+#include <unity.h>
+#include <cmath>
+#include <cstring>
+#include <tuning.h>
+
+namespace
+{
+  uint8_t block[tuning::block_size];
+
+  const tuning::Field &field(const char *name)
+  {
+    for (size_t i = 0; i < tuning::field_count; i++)
+    {
+      if (strcmp(tuning::fields[i].name, name) == 0)
+      {
+        return tuning::fields[i];
+      }
+    }
+    TEST_FAIL_MESSAGE(name);
+    return tuning::fields[0];
+  }
+
+  // Encodes the defaults, pokes a raw byte into the payload and fixes up the
+  // CRC, like a host that builds the block by hand.
+  size_t block_with_byte(size_t offset, uint8_t value)
+  {
+    size_t length = tuning::encode(tuning::defaults, block, sizeof(block));
+    block[sizeof(tuning::Header) + offset] = value;
+    uint32_t crc = tuning::crc32(block, sizeof(tuning::Header) + sizeof(tuning::Settings));
+    memcpy(block + sizeof(tuning::Header) + sizeof(tuning::Settings), &crc, sizeof(crc));
+    return length;
+  }
+
+  size_t block_with_float(size_t offset, float value)
+  {
+    size_t length = tuning::encode(tuning::defaults, block, sizeof(block));
+    memcpy(block + sizeof(tuning::Header) + offset, &value, sizeof(value));
+    uint32_t crc = tuning::crc32(block, sizeof(tuning::Header) + sizeof(tuning::Settings));
+    memcpy(block + sizeof(tuning::Header) + sizeof(tuning::Settings), &crc, sizeof(crc));
+    return length;
+  }
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_fields_know_their_kind()
+{
+  TEST_ASSERT_TRUE(field("reverse_UD_scroll").kind == tuning::Kind::Flag);
+  TEST_ASSERT_TRUE(field("slow_scroll_amount").kind == tuning::Kind::Real);
+  TEST_ASSERT_TRUE(field("frames_delay").kind == tuning::Kind::Integer);
+}
+
+void test_defaults_round_trip()
+{
+  tuning::Settings decoded;
+  size_t length = tuning::encode(tuning::defaults, block, sizeof(block));
+  TEST_ASSERT_TRUE(tuning::decode(block, length, decoded));
+  TEST_ASSERT_EQUAL_MEMORY(&tuning::defaults, &decoded, sizeof(decoded));
+}
+
+void test_block_with_a_flag_other_than_0_or_1_is_rejected()
+{
+  tuning::Settings decoded = tuning::defaults;
+  const tuning::Field &flag = field("speculative_tap");
+  TEST_ASSERT_TRUE(tuning::decode(block, block_with_byte(flag.offset, 1), decoded));
+  TEST_ASSERT_TRUE(decoded.speculative_tap);
+  TEST_ASSERT_FALSE(tuning::decode(block, block_with_byte(flag.offset, 2), decoded));
+  TEST_ASSERT_FALSE(tuning::decode(block, block_with_byte(flag.offset, 0xFF), decoded));
+}
+
+void test_block_with_a_float_that_isnt_finite_is_rejected()
+{
+  tuning::Settings decoded;
+  const char *names[] = {"slow_scroll_amount", "slow_scroll_threshold_mm", "palm_max_speed_mm",
+                         "scale_tracking_mm", "noise_floor_x_mm"};
+  for (const char *name : names)
+  {
+    const tuning::Field &real = field(name);
+    TEST_ASSERT_FALSE_MESSAGE(tuning::decode(block, block_with_float(real.offset, NAN), decoded), name);
+    TEST_ASSERT_FALSE_MESSAGE(tuning::decode(block, block_with_float(real.offset, INFINITY), decoded), name);
+    TEST_ASSERT_FALSE_MESSAGE(tuning::decode(block, block_with_float(real.offset, -INFINITY), decoded), name);
+  }
+}
+
+void test_set_field_checks_the_value()
+{
+  tuning::Settings settings = tuning::defaults;
+  const uint8_t on = 1;
+  const uint8_t bad = 2;
+  TEST_ASSERT_TRUE(tuning::set_field(settings, field("reverse_UD_scroll"), &on, 1));
+  TEST_ASSERT_FALSE(tuning::set_field(settings, field("reverse_UD_scroll"), &bad, 1));
+  TEST_ASSERT_EQUAL_MEMORY(&tuning::defaults.reverse_UD_scroll, &settings.reverse_UD_scroll, 1);
+
+  float amount = 0.5F;
+  TEST_ASSERT_FALSE(tuning::set_field(settings, field("slow_scroll_amount"), (const uint8_t *)&amount, 2));
+  TEST_ASSERT_TRUE(tuning::set_field(settings, field("slow_scroll_amount"), (const uint8_t *)&amount, 4));
+  TEST_ASSERT_EQUAL_FLOAT(0.5F, settings.slow_scroll_amount);
+
+  // A float that isn't finite is written, and then refused by valid().
+  amount = NAN;
+  TEST_ASSERT_TRUE(tuning::set_field(settings, field("slow_scroll_amount"), (const uint8_t *)&amount, 4));
+  TEST_ASSERT_FALSE(tuning::valid(settings));
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_fields_know_their_kind);
+  RUN_TEST(test_defaults_round_trip);
+  RUN_TEST(test_block_with_a_flag_other_than_0_or_1_is_rejected);
+  RUN_TEST(test_block_with_a_float_that_isnt_finite_is_rejected);
+  RUN_TEST(test_set_field_checks_the_value);
+  return UNITY_END();
+}
@@ -0,0 +1,208 @@
+// A model of waking up from idle, on a virtual clock: the simulated pad at
+// the idle rate, PS/2 commands that take as long as they do on the line, and
+// the decoder. It compares raising the rate before the packet that woke us up
+// is decoded, as leave_idle() used to, with raising it afterwards.
+#include <unity.h>
+#include <cstdio>
+#include <vector>
+#include <ps2.h>
+#include <synaptics.h>
+#include <simulated_synaptics.h>
+#include <decoder.h>
+
+namespace
+{
+  // A byte on the line is 11 bits of 60 to 100 us, and a command byte also
+  // waits for the acknowledge coming back.
+  const uint32_t byte_us = 1100;
+  const uint32_t command_byte_us = 2 * byte_us + 200;
+  const uint32_t frame_us = 1000000 / 80;
+
+  uint32_t now = 0;
+
+  // The simulated pad, with the time the commands take on the line.
+  class TimedTransport : public ps2::Transport
+  {
+  public:
+    explicit TimedTransport(ps2::SimulatedSynaptics &pad) : pad_(pad) {}
+
+    void begin(void (*byte_received)(uint8_t)) { pad_.begin(byte_received); }
+    bool write_byte(uint8_t data)
+    {
+      now += command_byte_us;
+      return pad_.write_byte(data);
+    }
+    uint8_t read_byte(uint32_t timeout_ms)
+    {
+      now += byte_us;
+      return pad_.read_byte(timeout_ms);
+    }
+    void pause() { pad_.pause(); }
+    void resume() { pad_.resume(); }
+
+  private:
+    ps2::SimulatedSynaptics &pad_;
+  };
+
+#define CONTACT(x, y) {(x), (y), 60, 6}
+#define LIFTED {0, 0, 0, 0}
+  ps2::SimulatedSynaptics::Step moving_finger[] = {
+      {400, 1, false, {CONTACT(2500, 2500), LIFTED}, {CONTACT(4500, 3500), LIFTED}},
+  };
+#undef CONTACT
+#undef LIFTED
+
+  // Bytes of the current frame, and the packets framed out of them.
+  std::vector<uint8_t> bytes;
+  std::vector<decoder::captured_packet> packets;
+
+  void byte_received(uint8_t data) { bytes.push_back(data); }
+
+  // The interrupt: the bytes of a frame come one after the other from start.
+  void receive(uint32_t start)
+  {
+    for (size_t i = 0; i < bytes.size(); i++)
+    {
+      decoder::captured_packet packet;
+      if (decoder::frame_byte(bytes[i], start + i * byte_us, packet))
+      {
+        packets.push_back(packet);
+      }
+    }
+    bytes.clear();
+  }
+
+  struct Wakeup
+  {
+    bool decoded;
+    uint32_t decoded_us;  // from the first packet to its decoding
+    bool reported;
+    uint32_t reported_us; // from the first packet to its report leaving the delay
+    uint32_t packet_errors;
+    bool high_rate;
+  };
+
+  // Wakes the idle decoder up with a finger put on the pad. A deferred rate
+  // change happens between packets, with a packet already started that the
+  // commands cut short.
+  Wakeup wake_up(bool deferred)
+  {
+    ps2::SimulatedSynaptics pad(moving_finger, 1);
+    TimedTransport transport(pad);
+    ps2::begin(transport, byte_received);
+    ps2::reset();
+    synaptics::init();
+    synaptics::set_high_rate(false);
+    decoder::begin(tuning::defaults, {.report_ready = nullptr, .wait_for_output = nullptr, .save_calibration = nullptr});
+    bytes.clear();
+    packets.clear();
+
+    Wakeup result = {};
+    bool idle = true;
+    bool rate_change_pending = false;
+    uint32_t woke_up = 0;
+    now = 0;
+    for (int frame = 0; frame < 40 && !result.reported; frame++)
+    {
+      uint32_t frame_start = frame * frame_us;
+      pad.frame();
+      if (now > frame_start)
+      {
+        // The pad was disabled by the commands, and this frame is lost.
+        bytes.clear();
+      }
+      else
+      {
+        now = frame_start;
+      }
+      receive(now);
+
+      for (size_t i = 0; i < packets.size(); i++)
+      {
+        if (idle)
+        {
+          idle = false;
+          woke_up = packets[i].micros;
+          if (deferred)
+          {
+            rate_change_pending = true;
+          }
+          else
+          {
+            synaptics::set_high_rate(true);
+          }
+        }
+        decoder::decode(packets[i]);
+        if (!result.decoded)
+        {
+          result.decoded = true;
+          result.decoded_us = now - woke_up;
+        }
+      }
+      packets.clear();
+
+      if (rate_change_pending)
+      {
+        rate_change_pending = false;
+        const uint8_t started[] = {0x80, 0x00, 0x3C};
+        bytes.assign(started, started + sizeof(started));
+        receive(now);
+        synaptics::set_high_rate(true);
+        decoder::resync();
+      }
+
+      decoder::tick();
+      decoder::report item;
+      while (decoder::next_report(item))
+      {
+        if (!item.speculative && !result.reported)
+        {
+          result.reported = true;
+          result.reported_us = now - woke_up;
+        }
+      }
+    }
+    result.packet_errors = decoder::stats().packet_errors;
+    result.high_rate = synaptics::high_rate();
+    return result;
+  }
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_rate_change_waits_for_the_first_packet()
+{
+  Wakeup before = wake_up(false);
+  Wakeup after = wake_up(true);
+
+  char line[160];
+  snprintf(line, sizeof(line), "first packet decoded after %u us before, %u us now; first report after %u us before, %u us now",
+           (unsigned)before.decoded_us, (unsigned)after.decoded_us, (unsigned)before.reported_us,
+           (unsigned)after.reported_us);
+  TEST_MESSAGE(line);
+
+  TEST_ASSERT_TRUE(before.high_rate);
+  TEST_ASSERT_TRUE(after.high_rate);
+  TEST_ASSERT_TRUE(before.reported);
+  TEST_ASSERT_TRUE(after.reported);
+  // The commands are no longer in the way of the first packet.
+  TEST_ASSERT_EQUAL_UINT32(0, after.decoded_us);
+  TEST_ASSERT_TRUE(before.decoded_us > 10 * command_byte_us);
+  TEST_ASSERT_TRUE(after.reported_us <= before.reported_us);
+}
+
+void test_packet_cut_short_by_the_rate_change_is_dropped()
+{
+  Wakeup result = wake_up(true);
+  TEST_ASSERT_EQUAL_UINT32(0, result.packet_errors);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_rate_change_waits_for_the_first_packet);
+  RUN_TEST(test_packet_cut_short_by_the_rate_change_is_dropped);
+  return UNITY_END();
+}
@@ -0,0 +1,7 @@
+# Builds the fuzz environment of platformio.ini with clang and libFuzzer, and
+# the sanitizers that catch what the harness can't check itself.
+Import("env")
+
+env.Replace(CC="clang", CXX="clang++", LINK="clang++")
+flags = ["-fsanitize=fuzzer,address,undefined", "-fno-sanitize-recover=undefined", "-g", "-O1"]
+env.Append(CCFLAGS=flags, LINKFLAGS=flags)
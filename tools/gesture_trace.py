@@ -0,0 +1,465 @@
+#!/usr/bin/env python3
+"""Generates synthetic Synaptics packet streams from scripted finger movements.
+
+Every gesture is a trajectory of up to three fingers, sampled at the packet
+rate and encoded the way the pad sends it in absolute mode with W and
+advanced gestures on: a packet per report period, and with two or more
+fingers, extended-W packets carrying the second finger take turns with the
+primary ones (RevB section 3.2.9.2). The bit layouts are the ones decoded by
+parse_primary_packet() and parse_extended_packet() in lib/decoder, and the
+same as ps2::SimulatedSynaptics writes.
+
+    gesture_trace.py list                       lists the gestures
+    gesture_trace.py gesture NAME [NAME ...]    plays gestures in a row
+    gesture_trace.py soak --hours H             random gestures for H hours
+    gesture_trace.py decode FILE                prints a capture as text
+    gesture_trace.py pressure FILE [FILE ...]   pressure settings from captures
+
+A capture is a sequence of 10 byte records, a little-endian uint32 capture
+time in microseconds followed by the 6 packet bytes. It is written to -o, or
+to stdout as hex lines with --hex. --noise adds jitter to every finger,
+--drop drops packets and --garble flips bits, to stand in for a sloppy hand
+and line noise.
+
+pressure calibrates the pressure settings of the tuning for one pad. It takes
+captures of ordinary use, with clicks but no deep presses, and prints the
+settings as JSON for tuning_block.py merge: the range of z from a light touch
+to a firm click, and a deep press threshold just beyond every click seen.
+Captures of the real pad are written by trace_decode.py --capture.
+"""
+
+import argparse
+import json
+import math
+import random
+import struct
+import sys
+
+RECORD = struct.Struct("<I6s")
+
+# Sensing area of the pad in touchpad units, as in synaptics.cpp, and the
+# resolution of ps2::SimulatedSynaptics.
+MIN_X, MAX_X = 1472, 5472
+MIN_Y, MAX_Y = 1408, 4448
+UNITS_PER_MM_X = 40
+UNITS_PER_MM_Y = 54
+
+FINGER_Z = 60  # a light touch
+FINGER_W = 6
+PALM_Z = 160
+PALM_W = 13
+
+
+class Contact:
+    __slots__ = ("x", "y", "z", "w")
+
+    def __init__(self, x, y, z=FINGER_Z, w=FINGER_W):
+        self.x, self.y, self.z, self.w = x, y, z, w
+
+
+class Frame:
+    """What is on the pad during one packet period."""
+
+    __slots__ = ("contacts", "button")
+
+    def __init__(self, contacts=(), button=False):
+        self.contacts = list(contacts)
+        self.button = button
+
+
+def clamp(value, low, high):
+    return max(low, min(high, value))
+
+
+def primary_packet(contact, w, button):
+    # Reference: Section 3.2.1, Figure 3-4
+    x, y = contact.x, contact.y
+    return bytes(
+        [
+            0x80 | (w & 0x0C) << 2 | (w & 0x02) << 1,
+            (y >> 4 & 0xF0) | (x >> 8 & 0x0F),
+            contact.z,
+            0xC0 | (y >> 7 & 0x20) | (x >> 8 & 0x10) | (w & 0x01) << 2 | int(button),
+            x & 0xFF,
+            y & 0xFF,
+        ]
+    )
+
+
+def extended_packet(contact):
+    # Reference: Section 3.2.9.2. Figure 3-14, packet code 1
+    x, y, z = contact.x, contact.y, contact.z
+    return bytes(
+        [
+            0x80 | 0x04,
+            x >> 1 & 0xFF,
+            y >> 1 & 0xFF,
+            0xC0 | (z >> 1 & 0x30),
+            (y >> 5 & 0xF0) | (x >> 9 & 0x0F),
+            0x10 | (z >> 1 & 0x0F),
+        ]
+    )
+
+
+def encode(frames):
+    """Yields the packet the pad sends for each frame. With two or more
+    fingers, an extended packet and a primary one take turns, starting with
+    the extended one, so each finger is only updated every other frame."""
+    extended = True
+    for frame in frames:
+        contacts = frame.contacts
+        if not contacts:
+            extended = True
+            yield primary_packet(Contact(0, 0, 0, 0), 0, frame.button)
+        elif len(contacts) == 1:
+            extended = True
+            yield primary_packet(contacts[0], clamp(contacts[0].w, 4, 15), frame.button)
+        elif extended:
+            extended = False
+            yield extended_packet(contacts[1])
+        else:
+            extended = True
+            yield primary_packet(contacts[0], 0 if len(contacts) == 2 else 1, frame.button)
+
+
+def decode(packet):
+    """Decodes a packet like touchpadTask does, for checking captures."""
+    p = int.from_bytes(packet, "little")
+    w = (p >> 26) & 0x01 | (p >> 1) & 0x2 | (p >> 2) & 0x0C
+    if w == 2:
+        x = (p >> 7) & 0x01FE | (p >> 23) & 0x1E00
+        y = (p >> 15) & 0x01FE | (p >> 27) & 0x1E00
+        z = (p >> 39) & 0x1D | (p >> 23) & 0x60
+        return "extended x=%d y=%d z=%d" % (x, y, z)
+    x = (p >> 32) & 0x00FF | (p >> 0) & 0x0F00 | (p >> 16) & 0x1000
+    y = (p >> 40) & 0x00FF | (p >> 4) & 0x0F00 | (p >> 17) & 0x1000
+    z = (p >> 16) & 0xFF
+    button = (p >> 24) & 0x01
+    return "w=%d x=%d y=%d z=%d button=%d" % (w, x, y, z, button)
+
+
+# Gestures. Each one yields frames, with positions in millimetres from the
+# bottom-left corner of the sensing area, and is picked at random places by
+# soak(). rng is a random.Random.
+
+WIDTH_MM = (MAX_X - MIN_X) / UNITS_PER_MM_X
+HEIGHT_MM = (MAX_Y - MIN_Y) / UNITS_PER_MM_Y
+
+
+def contact(x_mm, y_mm, z=FINGER_Z, w=FINGER_W):
+    return Contact(
+        int(clamp(MIN_X + x_mm * UNITS_PER_MM_X, MIN_X, MAX_X)),
+        int(clamp(MIN_Y + y_mm * UNITS_PER_MM_Y, MIN_Y, MAX_Y)),
+        z,
+        w,
+    )
+
+
+def spot(rng, margin=15):
+    return rng.uniform(margin, WIDTH_MM - margin), rng.uniform(margin, HEIGHT_MM - margin)
+
+
+def ease(t):
+    """Smooth start and stop, like a hand."""
+    return t * t * (3 - 2 * t)
+
+
+def lifted(frames):
+    for _ in range(frames):
+        yield Frame()
+
+
+def move(fingers, dx, dy, frames, spread=(0, 0), button=False, z=FINGER_Z, w=FINGER_W, curve=ease):
+    """Moves a group of fingers by (dx, dy) mm, each one starting at fingers[i].
+    spread makes them move apart (or together when negative) along x and y."""
+    for i in range(frames):
+        t = curve(i / max(frames - 1, 1))
+        contacts = []
+        for n, (x, y) in enumerate(fingers):
+            side = n - (len(fingers) - 1) / 2
+            contacts.append(
+                contact(x + dx * t + side * spread[0] * t, y + dy * t + side * spread[1] * t, z, w)
+            )
+        yield Frame(contacts, button)
+
+
+def tap(rng):
+    x, y = spot(rng)
+    yield from move([(x, y)], 0, 0, rng.randint(4, 12))
+    yield from lifted(rng.randint(20, 40))
+
+
+def double_tap(rng):
+    x, y = spot(rng)
+    for _ in range(2):
+        yield from move([(x, y)], 0, 0, rng.randint(4, 10))
+        yield from lifted(rng.randint(6, 12))
+    yield from lifted(30)
+
+
+def two_finger_tap(rng):
+    x, y = spot(rng)
+    yield from move([(x, y), (x + 18, y)], 0, 0, rng.randint(4, 12))
+    yield from lifted(rng.randint(20, 40))
+
+
+def track(rng):
+    x, y = spot(rng)
+    angle = rng.uniform(0, 2 * math.pi)
+    length = rng.uniform(10, 50)
+    yield from move([(x, y)], length * math.cos(angle), length * math.sin(angle), rng.randint(40, 160))
+    yield from lifted(rng.randint(10, 40))
+
+
+def drag(rng):
+    # Tap, then touch again and move: the gesture engine turns it into a drag.
+    x, y = spot(rng)
+    yield from move([(x, y)], 0, 0, 6)
+    yield from lifted(8)
+    yield from move([(x, y)], rng.uniform(-30, 30), rng.uniform(-20, 20), rng.randint(60, 120))
+    yield from lifted(40)
+
+
+def click_drag(rng):
+    # Press in the lower-left button zone and drag with a second finger.
+    bx, by = rng.uniform(5, 30), 5
+    x, y = spot(rng)
+    yield from move([(bx, by)], 0, 0, 8)
+    for frame in move([(bx, by), (x, y)], 0, 0, 1, button=True):
+        yield frame
+    for frame in move([(x, y)], rng.uniform(-30, 30), rng.uniform(-20, 20), rng.randint(40, 100), button=True):
+        frame.contacts.insert(0, contact(bx, by))
+        yield frame
+    yield from move([(bx, by)], 0, 0, 4)
+    yield from lifted(40)
+
+
+def flick(rng):
+    # A fast stroke that is still moving when the finger lifts.
+    x, y = spot(rng, 25)
+    angle = rng.uniform(0, 2 * math.pi)
+    length = rng.uniform(15, 30)
+    yield from move([(x, y)], length * math.cos(angle), length * math.sin(angle), rng.randint(6, 12),
+                    curve=lambda t: t * t)
+    yield from lifted(40)
+
+
+def scroll(rng):
+    x, y = spot(rng, 25)
+    yield from move([(x, y), (x + 18, y)], 0, rng.choice([-1, 1]) * rng.uniform(10, 30), rng.randint(40, 120))
+    yield from lifted(40)
+
+
+def pinch(rng):
+    x, y = spot(rng, 30)
+    sign = rng.choice([-1, 1])
+    yield from move([(x - 5, y - 5), (x + 5, y + 5)], 0, 0, rng.randint(40, 80), spread=(sign * 20, sign * 20))
+    yield from lifted(40)
+
+
+def swipe(rng):
+    x, y = spot(rng, 30)
+    angle = rng.choice([0, math.pi / 2, math.pi, 3 * math.pi / 2])
+    yield from move([(x - 15, y), (x, y + 3), (x + 15, y)], 30 * math.cos(angle), 20 * math.sin(angle),
+                    rng.randint(20, 40))
+    yield from lifted(40)
+
+
+def palm(rng):
+    x, y = spot(rng, 20)
+    yield from move([(x, y)], rng.uniform(-3, 3), rng.uniform(-3, 3), rng.randint(80, 240), z=PALM_Z, w=PALM_W)
+    yield from lifted(40)
+
+
+def rest(rng):
+    # A finger that doesn't move, for the noise calibration.
+    x, y = spot(rng)
+    yield from move([(x, y)], 0, 0, rng.randint(200, 800))
+    yield from lifted(40)
+
+
+def lift_and_touch(rng):
+    # One finger lifts and another lands elsewhere in the same frame, so the
+    # finger count never changes.
+    x, y = spot(rng)
+    yield from move([(x, y)], 10, 0, 40)
+    x2, y2 = spot(rng)
+    yield from move([(x2, y2)], -10, 0, 40)
+    yield from lifted(40)
+
+
+def three_to_one(rng):
+    # Three fingers, then two of them lift in the same frame.
+    x, y = spot(rng, 30)
+    yield from move([(x - 15, y), (x, y + 3), (x + 15, y)], 0, 0, 20)
+    yield from move([(x + 15, y)], 0, -15, 40)
+    yield from lifted(40)
+
+
+def press(rng):
+    # An ordinary click, pressing a little harder while the pad goes down.
+    x, y = spot(rng)
+    yield from move([(x, y)], 0, 0, 8)
+    for i in range(rng.randint(8, 16)):
+        yield Frame([contact(x, y, FINGER_Z + min(i * 4, 24))], True)
+    yield from move([(x, y)], 0, 0, 4)
+    yield from lifted(40)
+
+
+def deep_press(rng):
+    # A click that keeps pressing well past the click, like a force click.
+    x, y = spot(rng)
+    yield from move([(x, y)], 0, 0, 8)
+    for i in range(rng.randint(30, 50)):
+        yield Frame([contact(x, y, min(FINGER_Z + i * 4, 200))], True)
+    yield from move([(x, y)], 0, 0, 4)
+    yield from lifted(40)
+
+
+def idle(rng):
+    yield from lifted(rng.randint(80, 800))
+
+
+GESTURES = {
+    g.__name__: g
+    for g in [tap, double_tap, two_finger_tap, track, drag, click_drag, flick, scroll, pinch, swipe,
+              palm, rest, lift_and_touch, three_to_one, press, deep_press, idle]
+}
+
+
+def jitter(frames, rng, noise_mm):
+    for frame in frames:
+        for c in frame.contacts:
+            c.x = int(clamp(c.x + rng.gauss(0, noise_mm * UNITS_PER_MM_X), MIN_X, MAX_X))
+            c.y = int(clamp(c.y + rng.gauss(0, noise_mm * UNITS_PER_MM_Y), MIN_Y, MAX_Y))
+        yield frame
+
+
+def soak(rng, hours):
+    frames = int(hours * 3600 * 80)
+    while frames > 0:
+        for frame in GESTURES[rng.choice(list(GESTURES))](rng):
+            yield frame
+            frames -= 1
+
+
+def capture(frames, rng, rate, drop, garble):
+    """Yields (microseconds, packet) for the packets of frames."""
+    period = 1e6 / rate
+    for n, packet in enumerate(encode(frames)):
+        if drop and rng.random() < drop:
+            continue
+        if garble and rng.random() < garble:
+            packet = bytearray(packet)
+            packet[rng.randrange(6)] ^= 1 << rng.randrange(8)
+            packet = bytes(packet)
+        yield int(n * period) & 0xFFFFFFFF, packet
+
+
+def percentile(values, fraction):
+    values = sorted(values)
+    return values[min(int(len(values) * fraction), len(values) - 1)]
+
+
+def pressure(data):
+    """Returns the pressure settings for a capture of ordinary use."""
+    touches = []  # z of single fingers resting or tracking
+    peaks = []  # the highest z of each click
+    rises = []  # and how far it rose from the start of the click
+    press_z = None
+    for offset in range(0, len(data) - RECORD.size + 1, RECORD.size):
+        _, packet = RECORD.unpack_from(data, offset)
+        p = int.from_bytes(packet, "little")
+        w = (p >> 26) & 0x01 | (p >> 1) & 0x2 | (p >> 2) & 0x0C
+        z = (p >> 16) & 0xFF
+        button = (p >> 24) & 0x01
+        if packet[0] & 0xC8 != 0x80 or packet[3] & 0xC8 != 0xC0 or w < 4:
+            continue  # garbled, or not a single finger
+        if button and z > 0:
+            if press_z is None:
+                press_z = z
+                peaks.append(z)
+                rises.append(0)
+            peaks[-1] = max(peaks[-1], z)
+            rises[-1] = max(rises[-1], z - press_z)
+        else:
+            press_z = None
+            if z > 0:
+                touches.append(z)
+    if not touches or not peaks:
+        raise ValueError("the captures need touches and clicks")
+    z_min = percentile(touches, 0.05)
+    z_max = max(percentile(peaks, 0.95), z_min + 1)
+    return {
+        "pressure_z_min": z_min,
+        "pressure_z_max": z_max,
+        "deep_press_z": min(max(peaks) + 10, 255),
+        "deep_press_rise": min(max(rises) + 10, 255),
+    }
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("command", choices=["list", "gesture", "soak", "decode", "pressure"])
+    parser.add_argument("names", nargs="*", help="gestures, or the captures to read")
+    parser.add_argument("--hours", type=float, default=1.0)
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--rate", type=int, default=80, help="packets per second")
+    parser.add_argument("--noise", type=float, default=0.03, help="jitter in mm")
+    parser.add_argument("--drop", type=float, default=0, help="fraction of packets dropped")
+    parser.add_argument("--garble", type=float, default=0, help="fraction of packets with a flipped bit")
+    parser.add_argument("--hex", action="store_true", help="hex lines instead of binary")
+    parser.add_argument("-o", "--output")
+    args = parser.parse_args(argv[1:])
+
+    if args.command == "list":
+        print("\n".join(GESTURES))
+        return 0
+
+    if args.command == "decode":
+        if len(args.names) != 1:
+            parser.error("decode takes one capture")
+        with open(args.names[0], "rb") as f:
+            data = f.read()
+        for offset in range(0, len(data) - RECORD.size + 1, RECORD.size):
+            micros, packet = RECORD.unpack_from(data, offset)
+            print("%12.6f %s  %s" % (micros / 1e6, packet.hex(), decode(packet)))
+        return 0
+
+    if args.command == "pressure":
+        if not args.names:
+            parser.error("pressure takes captures")
+        data = b""
+        for name in args.names:
+            with open(name, "rb") as f:
+                data += f.read()
+        print(json.dumps(pressure(data), indent=2))
+        return 0
+
+    rng = random.Random(args.seed)
+    if args.command == "gesture":
+        unknown = [name for name in args.names if name not in GESTURES]
+        if unknown or not args.names:
+            parser.error("unknown gestures: %s" % " ".join(unknown) if unknown else "no gestures")
+        frames = (frame for name in args.names for frame in GESTURES[name](rng))
+    else:
+        frames = soak(rng, args.hours)
+    if args.noise:
+        frames = jitter(frames, rng, args.noise)
+    records = capture(frames, rng, args.rate, args.drop, args.garble)
+
+    if args.hex:
+        out = open(args.output, "w") if args.output else sys.stdout
+        for micros, packet in records:
+            out.write("%d %s\n" % (micros, packet.hex()))
+    else:
+        if not args.output:
+            parser.error("binary captures need -o")
+        with open(args.output, "wb") as out:
+            for micros, packet in records:
+                out.write(RECORD.pack(micros, packet))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+"""Turns the binary trace lines in a serial log back into text.
+
+The firmware prints each trace record as '#' followed by the record in hex
+(see lib/trace/trace.h). Those lines are decoded with the event formats from
+trace.h, and every other line is passed through as it is.
+
+    trace_decode.py [log file]        reads stdin without a file
+
+For a live view, pipe the serial monitor into it, e.g.
+
+    pio device monitor --raw | python tools/trace_decode.py
+
+With --capture FILE, the packets traced after `capture on` is sent to the
+firmware are also written to FILE as a capture for gesture_trace.py: 10 byte
+records of a little-endian uint32 time in microseconds and the 6 packet bytes.
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+HEADER = struct.Struct("<IHBB")
+CAPTURE = struct.Struct("<I6s")  # a record of gesture_trace.py
+TRACE_H = os.path.join(os.path.dirname(__file__), "..", "lib", "trace", "trace.h")
+
+
+def load_events(path=TRACE_H):
+    with open(path) as f:
+        text = f.read()
+    events = re.findall(r'X\((\w+),\s*"((?:[^"\\]|\\.)*)"\)', text)
+    return [(name, fmt.encode().decode("unicode_escape")) for name, fmt in events]
+
+
+def parse(line):
+    record = bytes.fromhex(line[1:].strip())
+    micros, event, count, core = HEADER.unpack_from(record)
+    args = struct.unpack_from("<%di" % count, record, HEADER.size)
+    return micros, event, core, args
+
+
+def decode(line, events):
+    micros, event, core, args = parse(line)
+    if event < len(events):
+        name, fmt = events[event]
+        try:
+            text = fmt % args
+        except (TypeError, ValueError):
+            text = "%s %s" % (name, args)
+    else:
+        text = "unknown event %d %s" % (event, args)
+    return "[%10.6f %d] %s" % (micros / 1e6, core, text)
+
+
+def capture(line, packet_event):
+    """Returns the capture record of a packet line, or None for other lines."""
+    micros, event, _, args = parse(line)
+    if event != packet_event or len(args) != 6:
+        return None
+    return CAPTURE.pack(micros, bytes(arg & 0xFF for arg in args))
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("log", nargs="?", help="reads stdin without a file")
+    parser.add_argument("--capture", help="writes the traced packets to this file")
+    args = parser.parse_args(argv[1:])
+
+    events = load_events()
+    packet_event = [name for name, _ in events].index("TRACE_PACKET")
+    source = open(args.log, errors="replace") if args.log else sys.stdin
+    out = open(args.capture, "wb") if args.capture else None
+    for line in source:
+        line = line.rstrip("\r\n")
+        if line.startswith("#"):
+            try:
+                record = capture(line, packet_event) if out else None
+                if record:
+                    out.write(record)
+                    out.flush()
+                line = decode(line, events)
+            except (ValueError, struct.error):
+                pass  # a garbled line, print it as it is
+        print(line, flush=True)
+    if out:
+        out.close()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,142 @@
+#!/usr/bin/env python3
+"""Encodes and decodes the tuning block stored in NVS.
+
+The layout must match tuning::Settings in lib/tuning/tuning.h. The firmware
+prints the current block when it receives `tuning` on the serial port, and
+applies one sent as `tuning <hex>`.
+
+    tuning_block.py decode <hex>         prints the settings as JSON
+    tuning_block.py encode <json file>   prints the block in hex
+    tuning_block.py merge <hex> <json>   prints the block with the JSON applied
+    tuning_block.py defaults             prints the default settings as JSON
+
+A JSON file for encode may leave out fields, which then keep their defaults.
+merge keeps them as they are in the given block instead, e.g. the current one
+read from the firmware, so that a few settings can be changed without losing
+the calibration or any other tuning.
+"""
+
+import json
+import struct
+import sys
+import zlib
+
+MAGIC = 0x44415054  # "TPAD"
+VERSION = 4
+HEADER = struct.Struct("<IHH")
+
+# (name, struct format, default), in the order of tuning::Settings. Reserved
+# bytes are padding ("x"), written as zeros and left out of the JSON.
+FIELDS = [
+    # Version 1
+    ("noise_threshold_tracking_mm", "f", 0.08),
+    ("noise_threshold_scrolling_mm", "f", 0.09),
+    ("scale_tracking_mm", "f", 12.0),
+    ("scale_scroll_mm", "f", 1.6),
+    ("slow_scroll_threshold_mm", "f", 2.0),
+    ("slow_scroll_amount", "f", 0.20),
+    ("max_delta_mm", "f", 3.0),
+    ("proximity_threshold_mm", "f", 15.0),
+    ("palm_max_speed_mm", "f", 1.0),
+    ("button_zone_height_mm", "f", 12.0),
+    ("idle_timeout_ms", "I", 5000),
+    ("frames_delay", "H", 20),
+    ("frames_stablization", "H", 15),
+    ("tap_time_threshold", "H", 35),
+    ("tap_tracking_threshold", "H", 15),
+    ("tap_z_threshold", "h", 100),
+    ("tap_and_pan_as_drag_threshold", "H", 70),
+    ("speculative_tap_delay", "H", 4),
+    ("palm_z_threshold", "h", 100),
+    ("palm_width_threshold", "h", 10),
+    ("palm_min_frames", "B", 3),
+    ("speculative_tap", "?", False),
+    ("reverse_LR_scroll", "?", True),
+    ("reverse_UD_scroll", "?", True),
+    ("button_zones_enabled", "?", True),
+    ("reserved", "x", None),
+    # Version 2
+    ("noise_floor_x_mm", "f", 0.0),
+    ("noise_floor_y_mm", "f", 0.0),
+    ("noise_calibration", "?", True),
+    ("reserved2", "3x", None),
+    # Version 3
+    ("absolute_left", "H", 0),
+    ("absolute_right", "H", 1000),
+    ("absolute_bottom", "H", 0),
+    ("absolute_top", "H", 1000),
+    ("absolute_mode", "?", False),
+    ("reserved3", "3x", None),
+    # Version 4
+    ("pressure_z_min", "B", 30),
+    ("pressure_z_max", "B", 120),
+    ("deep_press_z", "B", 120),
+    ("deep_press_rise", "B", 40),
+    ("deep_press_button", "B", 0),
+    ("reserved4", "3x", None),
+]
+
+VALUES = [field for field in FIELDS if not field[1].endswith("x")]
+SETTINGS = struct.Struct("<" + "".join(field[1] for field in FIELDS))
+assert SETTINGS.size == 100, "out of sync with tuning::Settings"
+
+
+def defaults():
+    return {name: default for name, _, default in VALUES}
+
+
+def encode(settings, base=None):
+    values = dict(base) if base else defaults()
+    for name in settings:
+        if name not in values:
+            raise ValueError("unknown setting: " + name)
+    values.update(settings)
+    body = HEADER.pack(MAGIC, VERSION, SETTINGS.size)
+    body += SETTINGS.pack(*(values[name] for name, _, _ in VALUES))
+    return body + struct.pack("<I", zlib.crc32(body))
+
+
+def decode(block):
+    if len(block) < HEADER.size + 4:
+        raise ValueError("block too short")
+    magic, version, size = HEADER.unpack_from(block)
+    if magic != MAGIC:
+        raise ValueError("bad magic")
+    if version > VERSION:
+        raise ValueError("block is from a newer firmware, version %d" % version)
+    if size > SETTINGS.size or len(block) != HEADER.size + size + 4:
+        raise ValueError("bad size")
+    (crc,) = struct.unpack_from("<I", block, HEADER.size + size)
+    if crc != zlib.crc32(block[: HEADER.size + size]):
+        raise ValueError("bad CRC")
+
+    # Older blocks are shorter, the missing fields keep their defaults.
+    payload = block[HEADER.size : HEADER.size + size]
+    payload += SETTINGS.pack(*(d for _, _, d in VALUES))[size:]
+    values = SETTINGS.unpack(payload)
+    # Floats come back as the nearest double of a float, e.g. 0.0799999982.
+    return {
+        name: round(value, 6) if fmt == "f" else value
+        for (name, fmt, _), value in zip(VALUES, values)
+    }
+
+
+def main(argv):
+    if len(argv) == 3 and argv[1] == "decode":
+        print(json.dumps(decode(bytes.fromhex(argv[2])), indent=2))
+    elif len(argv) == 3 and argv[1] == "encode":
+        with open(argv[2]) as f:
+            print(encode(json.load(f)).hex())
+    elif len(argv) == 4 and argv[1] == "merge":
+        with open(argv[3]) as f:
+            print(encode(json.load(f), decode(bytes.fromhex(argv[2]))).hex())
+    elif len(argv) == 2 and argv[1] == "defaults":
+        print(json.dumps(defaults(), indent=2))
+    else:
+        print(__doc__)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))